@@ -0,0 +1,81 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ork/core/Object.h"
+
+using namespace ork;
+
+BenchSuite *BenchSuite::getInstance()
+{
+    if (INSTANCE == NULL) {
+        INSTANCE = new BenchSuite();
+    }
+    return INSTANCE;
+}
+
+BenchSuite *BenchSuite::INSTANCE = NULL;
+
+Bench::Bench(const char *name, benchFunction bench)
+{
+    BenchSuite::getInstance()->benchs.push_back(bench);
+    BenchSuite::getInstance()->benchNames.push_back(name);
+}
+
+void report(const char *measure, double value, const char *unit)
+{
+    // measure names longer than the first column are not padded
+    int padding = 72 - int(strlen(measure));
+    printf("    %s%*s %12.3f %s\n", measure, padding > 0 ? padding : 0, "", value, unit);
+    fflush(NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    atexit(Object::exit);
+    const char *benchs = argc > 1 ? argv[1] : "ALL";
+    BenchSuite *suite = BenchSuite::getInstance();
+    int run = 0;
+    for (unsigned int i = 0; i < suite->benchs.size(); ++i) {
+        const char *name = suite->benchNames[i].c_str();
+        if (strcmp(benchs, "ALL") == 0 || strcmp(benchs, name) == 0) {
+            printf("%s\n", name);
+            fflush(NULL);
+            suite->benchs[i]();
+            ++run;
+        }
+    }
+    if (run == 0) {
+        printf("Unknown benchmark '%s'. Available benchmarks:\n", benchs);
+        for (unsigned int i = 0; i < suite->benchs.size(); ++i) {
+            printf("    %s\n", suite->benchNames[i].c_str());
+        }
+        return 1;
+    }
+    return 0;
+}
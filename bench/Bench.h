@@ -0,0 +1,68 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_BENCH_
+#define _ORK_BENCH_
+
+#include <string>
+#include <vector>
+
+typedef void (*benchFunction)();
+
+class BenchSuite
+{
+public:
+    std::vector<benchFunction> benchs;
+
+    std::vector<std::string> benchNames;
+
+    static BenchSuite *getInstance();
+
+private:
+    static BenchSuite *INSTANCE;
+};
+
+class Bench
+{
+public:
+    Bench(const char *name, benchFunction bench);
+};
+
+/**
+ * Prints a measured value of the current benchmark.
+ */
+void report(const char *measure, double value, const char *unit);
+
+/**
+ * Prevents the inlining of a function, so that the cost of its calls, such
+ * as the copy of its arguments, can be measured.
+ */
+#ifdef _MSC_VER
+#define ORK_NOINLINE __declspec(noinline)
+#else
+#define ORK_NOINLINE __attribute__((noinline))
+#endif
+
+#define BENCH(x) void x(); Bench _##x(#x, x); void x()
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "ork/core/Timer.h"
+#include "ork/taskgraph/MultithreadScheduler.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * A CPU task that spins during a given number of micro seconds.
+ */
+class SpinTask : public Task
+{
+public:
+    int duration;
+
+    SpinTask(int duration) : Task("SpinTask", false, 1), duration(duration)
+    {
+    }
+
+    virtual int getComplexity() const
+    {
+        return duration;
+    }
+
+    virtual bool run()
+    {
+        Timer t;
+        double end = t.start() + duration;
+        while (t.start() < end) {
+        }
+        return true;
+    }
+};
+
+/**
+ * A synthetic task graph, with the total duration of its tasks and the
+ * duration of its critical path.
+ */
+struct SyntheticGraph
+{
+    ptr<TaskGraph> graph;
+
+    double work;
+
+    double criticalPath;
+};
+
+/**
+ * Creates a graph made of a chain of tasks and of many independent tasks.
+ * The independent tasks are shorter than the chain tasks, so they are
+ * executed first in SHORTEST_FIRST mode, which delays the chain.
+ */
+static SyntheticGraph chainAndLeaves(int chainLength, int leaves)
+{
+    SyntheticGraph g;
+    g.graph = new TaskGraph();
+    g.work = 0.0;
+    ptr<Task> previous = NULL;
+    for (int i = 0; i < chainLength; ++i) {
+        ptr<Task> t = new SpinTask(400);
+        g.graph->addTask(t);
+        if (previous != NULL) {
+            g.graph->addDependency(t, previous);
+        }
+        previous = t;
+        g.work += 400;
+    }
+    for (int i = 0; i < leaves; ++i) {
+        int d = 100 + rand() % 200;
+        g.graph->addTask(new SpinTask(d));
+        g.work += d;
+    }
+    g.criticalPath = 400.0 * chainLength;
+    return g;
+}
+
+/**
+ * Creates a random layered graph, where each task depends on one to three
+ * random tasks of the previous layer.
+ */
+static SyntheticGraph layered(int layers, int width)
+{
+    SyntheticGraph g;
+    g.graph = new TaskGraph();
+    g.work = 0.0;
+    vector< ptr<Task> > previous;
+    vector<double> previousPaths;
+    g.criticalPath = 0.0;
+    for (int l = 0; l < layers; ++l) {
+        vector< ptr<Task> > current;
+        vector<double> currentPaths;
+        for (int i = 0; i < width; ++i) {
+            int d = 50 + rand() % 500;
+            ptr<Task> t = new SpinTask(d);
+            g.graph->addTask(t);
+            double path = 0.0;
+            int n = previous.empty() ? 0 : 1 + rand() % 3;
+            for (int j = 0; j < n; ++j) {
+                int k = rand() % previous.size();
+                g.graph->addDependency(t, previous[k]);
+                path = max(path, previousPaths[k]);
+            }
+            current.push_back(t);
+            currentPaths.push_back(path + d);
+            g.criticalPath = max(g.criticalPath, path + d);
+            g.work += d;
+        }
+        previous = current;
+        previousPaths = currentPaths;
+    }
+    return g;
+}
+
+/**
+ * Schedules the given graph and waits until it is completed.
+ *
+ * @return the time between the call to schedule and the completion of the
+ *      graph, in micro seconds.
+ */
+static double makespan(ptr<MultithreadScheduler> scheduler, ptr<TaskGraph> graph)
+{
+    Timer timer;
+    timer.start();
+    scheduler->schedule(graph);
+    while (!graph->isDone()) {
+        usleep(20);
+    }
+    return timer.end();
+}
+
+/**
+ * Executes tasks of each duration enough times so that the scheduler has
+ * statistics about them (see Task#getExpectedDuration).
+ */
+static void warmUp(int nThreads)
+{
+    // with a fixed framerate the scheduler threads measure task durations
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 1, 1e6f, nThreads);
+    for (int i = 0; i < 2; ++i) {
+        ptr<TaskGraph> graph = new TaskGraph();
+        for (int j = 0; j < 64; ++j) {
+            graph->addTask(new SpinTask(10 + rand() % 50));
+        }
+        makespan(scheduler, graph);
+    }
+}
+
+static void benchGraphs(const char *name, SyntheticGraph (*create)(int, int), int a, int b)
+{
+    const int N_THREADS = 4;
+    const int RUNS = 5;
+    warmUp(N_THREADS);
+    double results[2];
+    double work = 0.0;
+    double criticalPath = 0.0;
+    for (int mode = 0; mode < 2; ++mode) {
+        MultithreadScheduler::priorityMode priority = mode == 0 ? MultithreadScheduler::SHORTEST_FIRST : MultithreadScheduler::CRITICAL_PATH;
+        ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, N_THREADS, MultithreadScheduler::GLOBAL_QUEUE, priority);
+        vector<double> durations;
+        for (int i = 0; i < RUNS; ++i) {
+            // same graphs in both modes
+            srand(i);
+            SyntheticGraph g = create(a, b);
+            work = g.work;
+            criticalPath = g.criticalPath;
+            durations.push_back(makespan(scheduler, g.graph));
+        }
+        sort(durations.begin(), durations.end());
+        results[mode] = durations[RUNS / 2];
+    }
+    string s = string(name);
+    report((s + " lower bound").c_str(), max(criticalPath, work / N_THREADS) / 1e3, "ms");
+    report((s + " shortest first").c_str(), results[0] / 1e3, "ms");
+    report((s + " critical path").c_str(), results[1] / 1e3, "ms");
+}
+
+BENCH(criticalPathMakespan)
+{
+    benchGraphs("chain+leaves", chainAndLeaves, 40, 400);
+    benchGraphs("layered", layered, 30, 20);
+}
@@ -0,0 +1,136 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <cstdio>
+#include <sched.h>
+#include <algorithm>
+
+#include "ork/core/Timer.h"
+#include "ork/taskgraph/MultithreadScheduler.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * A CPU task that records the time at which it starts and ends.
+ */
+class StampTask : public Task
+{
+public:
+    double start;
+
+    double end;
+
+    StampTask() : Task("StampTask", false, 1), start(0.0), end(0.0)
+    {
+    }
+
+    virtual bool run()
+    {
+        Timer t;
+        start = t.start();
+        end = t.start();
+        return true;
+    }
+};
+
+/**
+ * Waits actively during the given number of micro seconds.
+ */
+static void spin(double duration)
+{
+    Timer t;
+    double end = t.start() + duration;
+    while (t.start() < end) {
+    }
+}
+
+static void waitUntilDone(ptr<Task> t)
+{
+    while (!t->isDone()) {
+        sched_yield();
+    }
+}
+
+static double percentile(vector<double> &values, int p)
+{
+    sort(values.begin(), values.end());
+    return values[(values.size() - 1) * p / 100];
+}
+
+/**
+ * Measures the delay between the scheduling of a task and the start of its
+ * execution by an idle thread, and the delay between the end of a task and
+ * the start of its two successors, which requires to wake up a second idle
+ * thread.
+ */
+static void benchHandoff(float spinTime)
+{
+    const int RUNS = 2000;
+    // the delay between runs, shorter than the active waiting time
+    const double GAP = 20.0;
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2);
+    scheduler->setSpinTime(spinTime);
+    vector<double> scheduleToStart;
+    vector<double> taskToTask;
+    Timer timer;
+    for (int i = 0; i < RUNS; ++i) {
+        ptr<StampTask> t = new StampTask();
+        spin(GAP);
+        double start = timer.start();
+        scheduler->schedule(t);
+        waitUntilDone(t);
+        scheduleToStart.push_back(t->start - start);
+
+        ptr<TaskGraph> g = new TaskGraph();
+        ptr<StampTask> a = new StampTask();
+        ptr<StampTask> b = new StampTask();
+        ptr<StampTask> c = new StampTask();
+        g->addTask(a);
+        g->addTask(b);
+        g->addTask(c);
+        g->addDependency(b, a);
+        g->addDependency(c, a);
+        spin(GAP);
+        scheduler->schedule(g);
+        waitUntilDone(g);
+        taskToTask.push_back(max(b->start, c->start) - a->end);
+    }
+    char name[256];
+    sprintf(name, "spin %g us schedule to start median", spinTime);
+    report(name, percentile(scheduleToStart, 50), "us");
+    sprintf(name, "spin %g us schedule to start p99", spinTime);
+    report(name, percentile(scheduleToStart, 99), "us");
+    sprintf(name, "spin %g us task to task median", spinTime);
+    report(name, percentile(taskToTask, 50), "us");
+    sprintf(name, "spin %g us task to task p99", spinTime);
+    report(name, percentile(taskToTask, 99), "us");
+}
+
+BENCH(handoffLatency)
+{
+    benchHandoff(0.0f);
+    benchHandoff(100.0f);
+}
@@ -0,0 +1,84 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <string>
+
+#include "ork/core/Logger.h"
+#include "ork/core/Timer.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * A logger that counts the messages it receives.
+ */
+class CountLogger : public Logger
+{
+public:
+    int count;
+
+    CountLogger() : Logger("DEBUG"), count(0)
+    {
+    }
+
+    virtual void log(const string &topic, const string &)
+    {
+        if (hasTopic(topic)) {
+            ++count;
+        }
+    }
+};
+
+/**
+ * Measures the cost of a debug message for a topic that is not logged,
+ * with a debug logger attached, formatted eagerly or with ORK_LOG_DEBUG.
+ */
+BENCH(disabledLogging)
+{
+    const int CALLS = 1000000;
+    string name = "myMesh";
+    ptr<CountLogger> logger = new CountLogger();
+    logger->addTopic("RESOURCE");
+    ptr<Logger> previous = Logger::DEBUG_LOGGER;
+    Logger::DEBUG_LOGGER = logger;
+
+    Timer timer;
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        if (Logger::DEBUG_LOGGER != NULL) {
+            Logger::DEBUG_LOGGER->log("SCENEGRAPH", "DrawMesh '" + name + "'");
+        }
+    }
+    report("eager formatting", timer.end() * 1e3 / CALLS, "ns/call");
+
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        ORK_LOG_DEBUG("SCENEGRAPH", "DrawMesh '" << name << "'");
+    }
+    report("ORK_LOG_DEBUG", timer.end() * 1e3 / CALLS, "ns/call");
+
+    Logger::DEBUG_LOGGER = previous;
+    report("logged messages", logger->count, "messages");
+}
@@ -0,0 +1,386 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "ork/core/Timer.h"
+#include "ork/math/half.h"
+#include "ork/math/mat4.h"
+#include "ork/math/transform.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * The number of matrices in the benchmarks.
+ */
+static const int MATRICES = 1024;
+
+/**
+ * The number of times each benchmark loop is repeated.
+ */
+static const int REPEAT = 500;
+
+/**
+ * The generic mat4 product, used as a reference.
+ */
+template <typename type>
+static mat4<type> scalarProduct(const mat4<type> &a, const mat4<type> &b)
+{
+    mat4<type> r;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            r[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + a[i][3] * b[3][j];
+        }
+    }
+    return r;
+}
+
+/**
+ * The generic mat4 and vec4 product, used as a reference.
+ */
+template <typename type>
+static vec4<type> scalarProduct(const mat4<type> &m, const vec4<type> &v)
+{
+    return vec4<type>(
+        m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3] * v.w,
+        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3] * v.w,
+        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3] * v.w,
+        m[3][0] * v.x + m[3][1] * v.y + m[3][2] * v.z + m[3][3] * v.w);
+}
+
+/**
+ * The generic mat4 inverse, used as a reference.
+ */
+template <typename type>
+static mat4<type> scalarInverse(const mat4<type> &m)
+{
+    return m.adjoint() * (1.0f / m.determinant());
+}
+
+/**
+ * Measures the mat4 products and inverse, for the given scalar type, with
+ * the generic code and with the specialized code, if any.
+ */
+template <typename type>
+static void benchMat4(const char *products, const char *vectors, const char *inverses)
+{
+    vector< mat4<type> > m(MATRICES);
+    vector< mat4<type> > r(MATRICES);
+    vector< vec4<type> > v(MATRICES);
+    srand(0);
+    for (int i = 0; i < MATRICES; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            for (int k = 0; k < 4; ++k) {
+                m[i][j][k] = type(rand()) / RAND_MAX;
+            }
+        }
+        v[i] = vec4<type>(m[i][0][1], m[i][1][2], m[i][2][3], 1);
+    }
+    const double calls = double(MATRICES) * REPEAT;
+    Timer timer;
+    double scalar;
+    double simd;
+    int differences = 0;
+
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 1; i < MATRICES; ++i) {
+            r[i] = scalarProduct(m[i - 1], m[i]);
+        }
+    }
+    scalar = timer.end();
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 1; i < MATRICES; ++i) {
+            r[i] = m[i - 1] * m[i];
+        }
+    }
+    simd = timer.end();
+    for (int i = 1; i < MATRICES; ++i) {
+        differences += r[i] != scalarProduct(m[i - 1], m[i]);
+    }
+    report(products, scalar * 1e3 / calls, "ns scalar");
+    report(products, simd * 1e3 / calls, "ns specialized");
+    report(products, differences, "differences");
+
+    vector< vec4<type> > w(MATRICES);
+    differences = 0;
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < MATRICES; ++i) {
+            w[i] = scalarProduct(m[i], v[i]);
+        }
+    }
+    scalar = timer.end();
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < MATRICES; ++i) {
+            w[i] = m[i] * v[i];
+        }
+    }
+    simd = timer.end();
+    for (int i = 0; i < MATRICES; ++i) {
+        vec4<type> s = scalarProduct(m[i], v[i]);
+        differences += w[i].x != s.x || w[i].y != s.y || w[i].z != s.z || w[i].w != s.w;
+    }
+    report(vectors, scalar * 1e3 / calls, "ns scalar");
+    report(vectors, simd * 1e3 / calls, "ns specialized");
+    report(vectors, differences, "differences");
+
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < MATRICES; ++i) {
+            r[i] = scalarInverse(m[i]);
+        }
+    }
+    scalar = timer.end();
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < MATRICES; ++i) {
+            r[i] = m[i].inverse();
+        }
+    }
+    simd = timer.end();
+    // the maximum error of the products of the matrices with their inverse,
+    // in units of the machine epsilon
+    double scalarError = 0.0;
+    double simdError = 0.0;
+    for (int i = 0; i < MATRICES; ++i) {
+        mat4<type> p = m[i] * scalarInverse(m[i]);
+        mat4<type> q = m[i] * r[i];
+        for (int j = 0; j < 16; ++j) {
+            type id = j % 5 == 0 ? type(1) : type(0);
+            scalarError = max(scalarError, double(abs(p.coefficients()[j] - id)));
+            simdError = max(simdError, double(abs(q.coefficients()[j] - id)));
+        }
+    }
+    report(inverses, scalar * 1e3 / calls, "ns scalar");
+    report(inverses, simd * 1e3 / calls, "ns specialized");
+    report(inverses, scalarError / numeric_limits<type>::epsilon(), "epsilon max residual scalar");
+    report(inverses, simdError / numeric_limits<type>::epsilon(), "epsilon max residual specialized");
+}
+
+/**
+ * Compares the specialized mat4f methods with the generic ones.
+ */
+BENCH(mat4fOperations)
+{
+    benchMat4<float>("mat4f * mat4f", "mat4f * vec4f", "mat4f::inverse");
+}
+
+/**
+ * Compares the specialized mat4d methods with the generic ones.
+ */
+BENCH(mat4dOperations)
+{
+    benchMat4<double>("mat4d * mat4d", "mat4d * vec4d", "mat4d::inverse");
+}
+
+/**
+ * The bounding box of the 8 transformed corners of a box, as computed by
+ * mat4::operator*(const box3<type>&) before its affine special case.
+ */
+template <typename type>
+static box3<type> cornersBounds(const mat4<type> &m, const box3<type> &v)
+{
+    box3<type> b;
+    b = b.enlarge(m * vec3<type>(v.xmin, v.ymin, v.zmin));
+    b = b.enlarge(m * vec3<type>(v.xmax, v.ymin, v.zmin));
+    b = b.enlarge(m * vec3<type>(v.xmin, v.ymax, v.zmin));
+    b = b.enlarge(m * vec3<type>(v.xmax, v.ymax, v.zmin));
+    b = b.enlarge(m * vec3<type>(v.xmin, v.ymin, v.zmax));
+    b = b.enlarge(m * vec3<type>(v.xmax, v.ymin, v.zmax));
+    b = b.enlarge(m * vec3<type>(v.xmin, v.ymax, v.zmax));
+    b = b.enlarge(m * vec3<type>(v.xmax, v.ymax, v.zmax));
+    return b;
+}
+
+/**
+ * Measures the transformation of arrays of points and of boxes, for the
+ * given scalar type, one at a time and with the batch functions.
+ */
+template <typename type>
+static void benchBatchTransforms(const char *points, const char *boxes)
+{
+    const int N = 4096;
+    mat4<type> m = mat4<type>::translate(vec3<type>(1, 2, 3)) * mat4<type>::rotatez(30) * mat4<type>::rotatex(60);
+    vector< vec3<type> > p(N);
+    vector< box3<type> > b(N);
+    vector<type> soa(6 * N);
+    vector<type> res(6 * N);
+    srand(0);
+    for (int i = 0; i < N; ++i) {
+        p[i] = vec3<type>(type(rand()) / RAND_MAX, type(rand()) / RAND_MAX, type(rand()) / RAND_MAX);
+        b[i] = box3<type>(p[i].x, p[i].x + 1, p[i].y, p[i].y + 1, p[i].z, p[i].z + 1);
+        soa[i] = p[i].x;
+        soa[N + i] = p[i].x + 1;
+        soa[2 * N + i] = p[i].y;
+        soa[3 * N + i] = p[i].y + 1;
+        soa[4 * N + i] = p[i].z;
+        soa[5 * N + i] = p[i].z + 1;
+    }
+    const double calls = double(N) * REPEAT;
+    vector< vec3<type> > q(N);
+    vector< box3<type> > c(N);
+    Timer timer;
+
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < N; ++i) {
+            q[i] = m * p[i];
+        }
+    }
+    report(points, timer.end() * 1e3 / calls, "ns one at a time");
+    vec3array<const type> in(&soa[0], &soa[2 * N], &soa[4 * N]);
+    vec3array<type> out(&res[0], &res[2 * N], &res[4 * N]);
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        transformPoints(m, in, out, N);
+    }
+    report(points, timer.end() * 1e3 / calls, "ns batch");
+
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < N; ++i) {
+            c[i] = cornersBounds(m, b[i]);
+        }
+    }
+    report(boxes, timer.end() * 1e3 / calls, "ns 8 corners");
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < N; ++i) {
+            c[i] = m * b[i];
+        }
+    }
+    report(boxes, timer.end() * 1e3 / calls, "ns one at a time");
+    box3array<const type> bin(&soa[0], &soa[N], &soa[2 * N], &soa[3 * N], &soa[4 * N], &soa[5 * N]);
+    box3array<type> bout(&res[0], &res[N], &res[2 * N], &res[3 * N], &res[4 * N], &res[5 * N]);
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        transformBoxes(m, bin, bout, N);
+    }
+    report(boxes, timer.end() * 1e3 / calls, "ns batch");
+
+    int differences = 0;
+    for (int i = 0; i < N; ++i) {
+        box3<type> d = cornersBounds(m, b[i]);
+        differences += d.xmin != bout.xmin[i] || d.xmax != bout.xmax[i] || d.ymin != bout.ymin[i] ||
+            d.ymax != bout.ymax[i] || d.zmin != bout.zmin[i] || d.zmax != bout.zmax[i];
+    }
+    report(boxes, differences, "differences");
+}
+
+/**
+ * Compares the batch transformations of float points and boxes with the
+ * transformation of each point or box.
+ */
+BENCH(batchTransformsFloat)
+{
+    benchBatchTransforms<float>("mat4f * points", "mat4f * boxes");
+}
+
+/**
+ * Compares the batch transformations of double points and boxes with the
+ * transformation of each point or box.
+ */
+BENCH(batchTransformsDouble)
+{
+    benchBatchTransforms<double>("mat4d * points", "mat4d * boxes");
+}
+
+/**
+ * Compares the conversion of arrays between floats and half-floats, one
+ * value at a time and with the array functions, with and without F16C.
+ */
+BENCH(halfConversions)
+{
+    const int N = 65536;
+    vector<float> f(N);
+    vector<float> g(N);
+    vector<unsigned short> h(N);
+    vector<unsigned short> k(N);
+    srand(0);
+    for (int i = 0; i < N; ++i) {
+        f[i] = (float(rand()) / RAND_MAX - 0.5f) * 1000.0f;
+    }
+    const double calls = double(N) * REPEAT;
+    Timer timer;
+
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < N; ++i) {
+            h[i] = floatToHalf(f[i]);
+        }
+    }
+    report("float to half", timer.end() * 1e3 / calls, "ns one at a time");
+    timer.start();
+    for (int n = 0; n < REPEAT; ++n) {
+        for (int i = 0; i < N; ++i) {
+            g[i] = halfToFloat(h[i]);
+        }
+    }
+    report("half to float", timer.end() * 1e3 / calls, "ns one at a time");
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool f16c = useF16C(pass == 0);
+        if (pass == 0 && !f16c) {
+            continue;
+        }
+        timer.start();
+        for (int n = 0; n < REPEAT; ++n) {
+            floatToHalf(&f[0], &k[0], N);
+        }
+        report("float to half", timer.end() * 1e3 / calls, f16c ? "ns array F16C" : "ns array SSE2");
+        timer.start();
+        for (int n = 0; n < REPEAT; ++n) {
+            halfToFloat(&k[0], &g[0], N);
+        }
+        report("half to float", timer.end() * 1e3 / calls, f16c ? "ns array F16C" : "ns array SSE2");
+    }
+
+    // the array results must be the same with and without F16C, and may
+    // differ from the scalar ones, which round ties away from zero
+    int differences = 0;
+    int ties = 0;
+    vector<unsigned short> l(N);
+    useF16C(false);
+    floatToHalf(&f[0], &l[0], N);
+    useF16C(true);
+    for (int i = 0; i < N; ++i) {
+        differences += k[i] != l[i];
+        ties += k[i] != floatToHalf(f[i]);
+    }
+    report("float to half", differences, "differences F16C / SSE2");
+    report("float to half", ties, "differences array / one at a time");
+    differences = 0;
+    halfToFloat(&k[0], &g[0], N);
+    for (int i = 0; i < N; ++i) {
+        differences += g[i] != halfToFloat(k[i]);
+    }
+    report("half to float", differences, "differences array / one at a time");
+}
@@ -0,0 +1,61 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <vector>
+
+#include "ork/core/Profiler.h"
+#include "ork/core/Timer.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * Measures the cost of a nested pair of ORK_PROFILE scopes, without and with
+ * a profiler.
+ */
+BENCH(profilerScopes)
+{
+    const int CALLS = 1000000;
+    Timer timer;
+    for (int enabled = 0; enabled < 2; ++enabled) {
+        Profiler::INSTANCE = enabled == 1 ? new Profiler() : NULL;
+        timer.start();
+        for (int i = 0; i < CALLS; ++i) {
+            ORK_PROFILE("outer");
+            ORK_PROFILE("inner");
+        }
+        double t = timer.end();
+        report(enabled == 1 ? "profiler" : "no profiler", t * 1e3 / CALLS, "ns/call");
+    }
+    Profiler::INSTANCE->endFrame();
+    vector<Profiler::ScopeStatistics> statistics;
+    Profiler::INSTANCE->getStatistics(statistics);
+    for (unsigned int i = 0; i < statistics.size(); ++i) {
+        if (statistics[i].name == "inner") {
+            report("measured inner scopes", statistics[i].calls, "calls");
+        }
+    }
+    Profiler::INSTANCE = NULL;
+}
@@ -0,0 +1,212 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ork/core/Timer.h"
+#include "ork/taskgraph/TaskGraph.h"
+
+using namespace std;
+using namespace ork;
+
+class EmptyTask : public Task
+{
+public:
+    EmptyTask() : Task("EmptyTask", false, 0)
+    {
+    }
+
+    virtual bool run()
+    {
+        return true;
+    }
+};
+
+static volatile long sink = 0;
+
+static ORK_NOINLINE void byValue(ptr<Task> t)
+{
+    sink += (long) t.get();
+}
+
+static ORK_NOINLINE void byReference(const ptr<Task> &t)
+{
+    sink += (long) t.get();
+}
+
+/**
+ * Compares the cost of passing a ptr by value, which acquires and releases
+ * a reference, and by const reference.
+ */
+BENCH(ptrPassing)
+{
+    const int CALLS = 10000000;
+    ptr<Task> t = new EmptyTask();
+    Timer timer;
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        byValue(t);
+    }
+    report("ptr by value", timer.end() * 1e3 / CALLS, "ns/call");
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        byReference(t);
+    }
+    report("ptr by const reference", timer.end() * 1e3 / CALLS, "ns/call");
+    ptr<Task> u;
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        u = t;
+    }
+    report("ptr assignment of same target", timer.end() * 1e3 / CALLS, "ns/call");
+}
+
+/**
+ * Adds a task to a task graph with one more copy of the ptr, as
+ * TaskGraph#addTask did when it took its argument by value.
+ */
+static ORK_NOINLINE void addTaskByValue(TaskGraph *g, ptr<Task> t)
+{
+    g->addTask(t);
+}
+
+/**
+ * Adds a dependency to a task graph with two more copies of ptr, as
+ * TaskGraph#addDependency did when it took its arguments by value.
+ */
+static ORK_NOINLINE void addDependencyByValue(TaskGraph *g, ptr<Task> src, ptr<Task> dst)
+{
+    g->addDependency(src, dst);
+}
+
+/**
+ * Builds a task graph per frame with the given tasks, as the scene graph
+ * methods do.
+ *
+ * @param byValue true to pass the tasks by value, false to pass them by
+ *      const reference.
+ */
+static void buildTaskGraphs(const vector< ptr<Task> > &tasks, int frames, bool byValue)
+{
+    for (int f = 0; f < frames; ++f) {
+        ptr<TaskGraph> g = new TaskGraph();
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            if (byValue) {
+                addTaskByValue(g.get(), tasks[i]);
+                if (i > 0) {
+                    addDependencyByValue(g.get(), tasks[i], tasks[i - 1]);
+                }
+                if (i > 1) {
+                    addDependencyByValue(g.get(), tasks[i], tasks[i / 2]);
+                }
+            } else {
+                g->addTask(tasks[i]);
+                if (i > 0) {
+                    g->addDependency(tasks[i], tasks[i - 1]);
+                }
+                if (i > 1) {
+                    g->addDependency(tasks[i], tasks[i / 2]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Compares the construction of task graphs with ptr passed by value and by
+ * const reference to TaskGraph#addTask and TaskGraph#addDependency. The
+ * reference counter updates are only counted if ORK_ACCOUNTING is defined
+ * (see Object#getReferenceOperations).
+ */
+BENCH(ptrTaskGraph)
+{
+    const int FRAMES = 100;
+    const int TASKS = 1000;
+    vector< ptr<Task> > tasks;
+    for (int i = 0; i < TASKS; ++i) {
+        tasks.push_back(new EmptyTask());
+    }
+    long operations[2];
+    Timer timer;
+    for (int byValue = 0; byValue < 2; ++byValue) {
+        Object::setAccounting(false);
+        timer.start();
+        buildTaskGraphs(tasks, FRAMES, byValue == 1);
+        report(byValue == 1 ? "task graph construction, by value" : "task graph construction, by const reference", timer.end() / FRAMES, "us/frame");
+        // the reference operations are counted in a separate frame, because
+        // counting them slows down the reference counting
+        Object::setAccounting(true);
+        long start = Object::getReferenceOperations();
+        buildTaskGraphs(tasks, 1, byValue == 1);
+        operations[byValue] = Object::getReferenceOperations() - start;
+    }
+#ifdef ORK_ACCOUNTING
+    report("refcount ops, by value", operations[1], "ops/frame");
+    report("refcount ops, by const reference", operations[0], "ops/frame");
+    report("refcount ops eliminated", operations[1] - operations[0], "ops/frame");
+#endif
+#ifdef NDEBUG
+    Object::setAccounting(false);
+#endif
+}
+
+/**
+ * Measures the cost of the object accounting (see Object#setAccounting) on
+ * the creation and deletion of objects. Only the cost without accounting is
+ * measured if ORK_ACCOUNTING is not defined.
+ */
+BENCH(objectAccounting)
+{
+    const int OBJECTS = 1000000;
+#ifdef ORK_ACCOUNTING
+    const int MODES = 2;
+#else
+    const int MODES = 1;
+#endif
+    Timer timer;
+    for (int enabled = 0; enabled < MODES; ++enabled) {
+        Object::setAccounting(enabled == 1);
+        timer.start();
+        for (int i = 0; i < OBJECTS; ++i) {
+            ptr<Task> t = new EmptyTask();
+        }
+        report(enabled == 1 ? "create and delete, accounting" : "create and delete, no accounting", timer.end() * 1e3 / OBJECTS, "ns/object");
+    }
+    vector<Object::Statistics> statistics;
+    long liveBytes;
+    long allocatedBytes;
+    Object::getStatistics(statistics, &liveBytes, &allocatedBytes);
+    for (unsigned int i = 0; i < statistics.size(); ++i) {
+        if (strcmp(statistics[i].type, "EmptyTask") == 0) {
+            report("created EmptyTask", statistics[i].created, "objects");
+        }
+    }
+    report("allocated", allocatedBytes / 1024.0, "kB");
+#ifdef NDEBUG
+    Object::setAccounting(false);
+#endif
+}
@@ -0,0 +1,496 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <algorithm>
+
+#include "ork/core/Atomic.h"
+#include "ork/core/Timer.h"
+#include "ork/taskgraph/MultithreadScheduler.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * A CPU task that waits actively during a given time, and records the time
+ * at which it starts and ends.
+ */
+class WorkTask : public Task
+{
+public:
+    double work;
+
+    double start;
+
+    double end;
+
+    /**
+     * The predecessors of this task, used to compute the time at which it
+     * became ready.
+     */
+    vector<WorkTask*> predecessors;
+
+    WorkTask(double work, unsigned int deadline) :
+        Task("WorkTask", false, deadline), work(work), start(0.0), end(0.0)
+    {
+    }
+
+    virtual bool run()
+    {
+        Timer t;
+        start = t.start();
+        end = start + work;
+        while (work > 0.0 && t.start() < end) {
+        }
+        end = t.start();
+        return true;
+    }
+};
+
+/**
+ * A synthetic workload: a task graph and its primitive tasks.
+ */
+struct Workload
+{
+    ptr<TaskGraph> graph;
+
+    vector< ptr<WorkTask> > tasks;
+
+    /**
+     * Adds a task to the given graph, depending on the given tasks.
+     */
+    ptr<WorkTask> add(ptr<TaskGraph> g, double work, unsigned int deadline, const vector< ptr<WorkTask> > &predecessors)
+    {
+        ptr<WorkTask> t = new WorkTask(work, deadline);
+        g->addTask(t);
+        for (unsigned int i = 0; i < predecessors.size(); ++i) {
+            g->addDependency(t, predecessors[i]);
+            t->predecessors.push_back(predecessors[i].get());
+        }
+        tasks.push_back(t);
+        return t;
+    }
+};
+
+/**
+ * A root task followed by many independent tasks.
+ */
+static Workload fanOut(unsigned int deadline)
+{
+    Workload w;
+    w.graph = new TaskGraph();
+    vector< ptr<WorkTask> > root(1, w.add(w.graph, 1.0, deadline, vector< ptr<WorkTask> >()));
+    for (int i = 0; i < 4000; ++i) {
+        w.add(w.graph, 1.0, deadline, root);
+    }
+    return w;
+}
+
+/**
+ * A long chain of tasks.
+ */
+static Workload chain(unsigned int deadline)
+{
+    Workload w;
+    w.graph = new TaskGraph();
+    vector< ptr<WorkTask> > previous;
+    for (int i = 0; i < 2000; ++i) {
+        previous.assign(1, w.add(w.graph, 1.0, deadline, previous));
+    }
+    return w;
+}
+
+/**
+ * Nested task graphs: a chain of graphs, each made of independent graphs
+ * containing small random task graphs.
+ */
+static Workload nested(unsigned int deadline)
+{
+    Workload w;
+    w.graph = new TaskGraph();
+    ptr<TaskGraph> previous = NULL;
+    for (int i = 0; i < 10; ++i) {
+        ptr<TaskGraph> g = new TaskGraph();
+        for (int j = 0; j < 10; ++j) {
+            ptr<TaskGraph> h = new TaskGraph();
+            vector< ptr<WorkTask> > tasks;
+            for (int k = 0; k < 20; ++k) {
+                vector< ptr<WorkTask> > predecessors;
+                if (k > 0) {
+                    predecessors.push_back(tasks[rand() % k]);
+                }
+                tasks.push_back(w.add(h, 1.0, deadline, predecessors));
+            }
+            g->addTask(h);
+        }
+        w.graph->addTask(g);
+        if (previous != NULL) {
+            w.graph->addDependency(g, previous);
+        }
+        previous = g;
+    }
+    return w;
+}
+
+/**
+ * Independent chains of immediate tasks, and independent prefetch tasks.
+ */
+static Workload mixed(unsigned int deadline)
+{
+    Workload w;
+    w.graph = new TaskGraph();
+    for (int i = 0; i < 20; ++i) {
+        vector< ptr<WorkTask> > previous;
+        for (int j = 0; j < 50; ++j) {
+            previous.assign(1, w.add(w.graph, 1.0, 0, previous));
+        }
+    }
+    for (int i = 0; i < 2000; ++i) {
+        w.add(w.graph, 1.0, deadline, vector< ptr<WorkTask> >());
+    }
+    return w;
+}
+
+/**
+ * The results of the execution of a workload.
+ */
+struct Result
+{
+    int tasks; ///< number of executed tasks.
+
+    double duration; ///< total duration.
+
+    double latency; ///< sum of delays between ready and start times.
+
+    double busy; ///< sum of task durations.
+
+    Result() : tasks(0), duration(0.0), latency(0.0), busy(0.0)
+    {
+    }
+
+    /**
+     * Adds the tasks of w executed after the given submission time.
+     */
+    void add(Workload &w, double submitted)
+    {
+        for (unsigned int i = 0; i < w.tasks.size(); ++i) {
+            WorkTask *t = w.tasks[i].get();
+            if (t->start < submitted) {
+                continue;
+            }
+            double ready = submitted;
+            for (unsigned int j = 0; j < t->predecessors.size(); ++j) {
+                ready = max(ready, t->predecessors[j]->end);
+            }
+            tasks += 1;
+            latency += max(t->start - ready, 0.0);
+            busy += t->end - t->start;
+        }
+    }
+
+    /**
+     * Prints the results.
+     *
+     * @param threads the number of scheduler threads.
+     * @param participants the number of threads that can execute the tasks.
+     */
+    void report(const char *name, int threads, int participants)
+    {
+        char measure[256];
+        sprintf(measure, "%s %d threads throughput", name, threads);
+        ::report(measure, tasks / duration * 1e3, "ktasks/s");
+        sprintf(measure, "%s %d threads latency", name, threads);
+        ::report(measure, latency / tasks, "us");
+        sprintf(measure, "%s %d threads idle", name, threads);
+        ::report(measure, 100.0 * max(1.0 - busy / (duration * participants), 0.0), "%");
+    }
+};
+
+static void waitUntilDone(ptr<Task> t)
+{
+    while (!t->isDone()) {
+        sched_yield();
+    }
+}
+
+/**
+ * A scheduler configuration.
+ */
+struct Config
+{
+    MultithreadScheduler::executionMode mode;
+
+    MultithreadScheduler::priorityMode priority;
+
+    float spinTime; ///< active wait time of idle threads, in micro seconds.
+
+    Config(MultithreadScheduler::executionMode mode, MultithreadScheduler::priorityMode priority, float spinTime) :
+        mode(mode), priority(priority), spinTime(spinTime)
+    {
+    }
+
+    /**
+     * Creates a scheduler with this configuration.
+     */
+    ptr<MultithreadScheduler> createScheduler(int nThreads) const
+    {
+        ptr<MultithreadScheduler> s = new MultithreadScheduler(0, 0, 0.0f, nThreads, mode, priority);
+        s->setSpinTime(spinTime);
+        return s;
+    }
+
+    /**
+     * Returns the name of a workload executed with this configuration.
+     */
+    string getName(const char *workload) const
+    {
+        char name[256];
+        sprintf(name, "%s %s %s spin%d", workload,
+            mode == MultithreadScheduler::GLOBAL_QUEUE ? "globalQueue" : "workStealing",
+            priority == MultithreadScheduler::SHORTEST_FIRST ? "shortestFirst" : "criticalPath",
+            int(spinTime));
+        return string(name);
+    }
+};
+
+/**
+ * Executes a workload of prefetch tasks, which are executed by the
+ * additional threads, or of immediate tasks, which are executed by the main
+ * thread, or both.
+ */
+static void benchWorkload(const char *name, Workload (*create)(unsigned int), unsigned int deadline, const Config &config, int nThreads)
+{
+    const int RUNS = 5;
+    ptr<MultithreadScheduler> scheduler = config.createScheduler(nThreads);
+    Result r;
+    Timer timer;
+    for (int i = 0; i < RUNS; ++i) {
+        srand(i);
+        Workload w = create(deadline);
+        double start = timer.start();
+        if (deadline > 0) {
+            scheduler->schedule(w.graph);
+        }
+        scheduler->run(w.graph);
+        waitUntilDone(w.graph);
+        r.duration += timer.end();
+        r.add(w, start);
+    }
+    // immediate tasks are executed by the main thread only
+    int participants = deadline > 0 ? nThreads : 1;
+    if (create == mixed) {
+        participants = nThreads + 1;
+    }
+    r.report(config.getName(name).c_str(), nThreads, participants);
+}
+
+/**
+ * Reexecutes a subset of the tasks of a graph at each frame, which requires
+ * to reschedule these tasks and their successors.
+ */
+static void benchRescheduleChurn(const Config &config, int nThreads)
+{
+    const int FRAMES = 200;
+    ptr<MultithreadScheduler> scheduler = config.createScheduler(nThreads);
+    srand(0);
+    Workload w = nested(0);
+    scheduler->run(w.graph);
+    Result r;
+    Timer timer;
+    for (int i = 0; i < FRAMES; ++i) {
+        double start = timer.start();
+        for (int j = 0; j < 20; ++j) {
+            ptr<WorkTask> t = w.tasks[rand() % w.tasks.size()];
+            scheduler->reschedule(t, Task::DATA_CHANGED, 0);
+        }
+        scheduler->run(w.graph);
+        r.duration += timer.end();
+        r.add(w, start);
+    }
+    r.report(config.getName("rescheduleChurn").c_str(), nThreads, 1);
+}
+
+BENCH(schedulerOverhead)
+{
+    MultithreadScheduler::executionMode modes[2] = {
+        MultithreadScheduler::GLOBAL_QUEUE, MultithreadScheduler::WORK_STEALING
+    };
+    MultithreadScheduler::priorityMode priorities[2] = {
+        MultithreadScheduler::SHORTEST_FIRST, MultithreadScheduler::CRITICAL_PATH
+    };
+    float spinTimes[2] = { 0.0f, 50.0f };
+    int threads[3] = { 1, 2, 4 };
+    for (int m = 0; m < 2; ++m) {
+        for (int p = 0; p < 2; ++p) {
+            for (int s = 0; s < 2; ++s) {
+                Config c(modes[m], priorities[p], spinTimes[s]);
+                for (int i = 0; i < 3; ++i) {
+                    benchWorkload("fanOut", fanOut, 1, c, threads[i]);
+                    benchWorkload("chain", chain, 1, c, threads[i]);
+                    benchWorkload("nested", nested, 1, c, threads[i]);
+                    benchWorkload("mixed", mixed, 1, c, threads[i]);
+                    benchWorkload("immediateNested", nested, 0, c, threads[i]);
+                    benchRescheduleChurn(c, threads[i]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Schedules a task graph at each frame, either the same graph, whose
+ * flattened form is then reused, or a new graph with the same structure, as
+ * with the scene graph methods, and measures the scheduling time per frame.
+ */
+static double benchFlattenedGraph(bool sameGraph, int nThreads)
+{
+    const int FRAMES = 100;
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, nThreads);
+    srand(0);
+    Workload w = nested(1);
+    Timer timer;
+    double duration = 0.0;
+    for (int i = 0; i < FRAMES; ++i) {
+        if (!sameGraph) {
+            srand(0);
+            w = nested(1);
+        } else if (i > 0) {
+            scheduler->reschedule(w.graph, Task::DEPENDENCY_CHANGED, 1);
+        }
+        timer.start();
+        scheduler->schedule(w.graph);
+        duration += timer.end();
+        waitUntilDone(w.graph);
+    }
+    return duration / FRAMES;
+}
+
+BENCH(flattenedGraph)
+{
+    int threads[2] = { 1, 4 };
+    for (int i = 0; i < 2; ++i) {
+        char measure[256];
+        sprintf(measure, "schedule same graph %d threads", threads[i]);
+        report(measure, benchFlattenedGraph(true, threads[i]), "us/frame");
+        sprintf(measure, "schedule new graph %d threads", threads[i]);
+        report(measure, benchFlattenedGraph(false, threads[i]), "us/frame");
+    }
+}
+
+/**
+ * Schedules many small task graphs, either one by one or in a single batch,
+ * and measures the scheduling time per graph.
+ */
+static double benchSchedule(bool batch, int nThreads)
+{
+    const int GRAPHS = 500;
+    const int FRAMES = 10;
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, nThreads);
+    Timer timer;
+    double duration = 0.0;
+    for (int i = 0; i < FRAMES; ++i) {
+        vector< ptr<Task> > graphs;
+        for (int j = 0; j < GRAPHS; ++j) {
+            Workload w;
+            w.graph = new TaskGraph();
+            vector< ptr<WorkTask> > previous;
+            for (int k = 0; k < 4; ++k) {
+                previous.assign(1, w.add(w.graph, 0.0, 1, previous));
+            }
+            graphs.push_back(w.graph);
+        }
+        timer.start();
+        if (batch) {
+            scheduler->scheduleBatch(graphs);
+        } else {
+            for (unsigned int j = 0; j < graphs.size(); ++j) {
+                scheduler->schedule(graphs[j]);
+            }
+        }
+        duration += timer.end();
+        for (unsigned int j = 0; j < graphs.size(); ++j) {
+            waitUntilDone(graphs[j]);
+        }
+    }
+    return duration / (FRAMES * GRAPHS);
+}
+
+BENCH(scheduleBatch)
+{
+    int threads[2] = { 1, 4 };
+    for (int i = 0; i < 2; ++i) {
+        char measure[256];
+        sprintf(measure, "schedule %d threads", threads[i]);
+        report(measure, benchSchedule(false, threads[i]), "us/graph");
+        sprintf(measure, "scheduleBatch %d threads", threads[i]);
+        report(measure, benchSchedule(true, threads[i]), "us/graph");
+    }
+}
+
+/**
+ * Records the execution of a workload, and simulates it offline with other
+ * scheduling policies and thread counts (see ScheduleRecord).
+ */
+BENCH(scheduleRecord)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2);
+    srand(0);
+    Workload w = mixed(1);
+    ScheduleRecord record;
+    scheduler->startRecording();
+    scheduler->schedule(w.graph);
+    scheduler->run(w.graph);
+    waitUntilDone(w.graph);
+    scheduler->stopRecording(record);
+
+    float recorded = 0.0f;
+    for (unsigned int i = 0; i < record.tasks.size(); ++i) {
+        const ScheduleRecord::TaskRecord &t = record.tasks[i];
+        if (t.thread >= 0) {
+            recorded = max(recorded, t.start + t.duration);
+        }
+    }
+    report("scheduleRecord recorded makespan", recorded, "us");
+    report("scheduleRecord replayed makespan", record.simulate(0, ScheduleRecord::RECORDED), "us");
+
+    // the record must be unchanged by a save / load round trip
+    ScheduleRecord loaded;
+    const char *fileName = "scheduleRecord.dat";
+    bool ok = record.save(fileName) && loaded.load(fileName);
+    ok = ok && loaded.tasks.size() == record.tasks.size() && loaded.dependencies == record.dependencies;
+    remove(fileName);
+    report("scheduleRecord round trip", ok ? 1.0 : 0.0, "ok");
+
+    int threads[4] = { 1, 2, 4, 8 };
+    for (int i = 0; i < 4; ++i) {
+        char measure[256];
+        sprintf(measure, "scheduleRecord shortestFirst %d threads makespan", threads[i]);
+        report(measure, loaded.simulate(threads[i], ScheduleRecord::SHORTEST_FIRST), "us");
+        sprintf(measure, "scheduleRecord criticalPath %d threads makespan", threads[i]);
+        report(measure, loaded.simulate(threads[i], ScheduleRecord::CRITICAL_PATH), "us");
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "bench/Bench.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "ork/core/Timer.h"
+
+using namespace ork;
+
+/**
+ * The number of time measures done for each time source.
+ */
+static const int CALLS = 1000000;
+
+/**
+ * A sink for the measured times, so that they are not optimized out.
+ */
+static volatile double sink;
+
+/**
+ * Measures the cost of reading the time with each available time source.
+ */
+BENCH(timeSources)
+{
+    Timer::useInvariantTsc(false);
+    Timer timer;
+    double sum = 0.0;
+
+#ifndef _WIN32
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        timeval u;
+        gettimeofday(&u, NULL);
+        sum += u.tv_usec;
+    }
+    report("gettimeofday", timer.end() * 1e3 / CALLS, "ns/call");
+
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        sum += ts.tv_nsec;
+    }
+    report("clock_gettime(CLOCK_REALTIME)", timer.end() * 1e3 / CALLS, "ns/call");
+
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        sum += ts.tv_nsec;
+    }
+    report("clock_gettime(CLOCK_MONOTONIC)", timer.end() * 1e3 / CALLS, "ns/call");
+#endif
+
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        sum += Timer::getCurrentTime();
+    }
+    report("Timer::getCurrentTime, clock", timer.end() * 1e3 / CALLS, "ns/call");
+
+    timer.start();
+    for (int i = 0; i < CALLS; ++i) {
+        sum += double(Timer::getTimestamp());
+    }
+    report(Timer::hasInvariantTsc() ? "Timer::getTimestamp, TSC" : "Timer::getTimestamp, clock", timer.end() * 1e3 / CALLS, "ns/call");
+
+    if (Timer::useInvariantTsc(true)) {
+        timer.start();
+        for (int i = 0; i < CALLS; ++i) {
+            sum += Timer::getTaskTime();
+        }
+        report("Timer::getTaskTime, TSC", timer.end() * 1e3 / CALLS, "ns/call");
+        Timer::useInvariantTsc(false);
+    }
+    sink = sum;
+}
+
+/**
+ * Compares the durations measured with the monotonic clock and with the
+ * calibrated time stamp counter, if available.
+ */
+BENCH(timestampCalibration)
+{
+    if (!Timer::hasInvariantTsc()) {
+        report("invariant TSC", 0, "available");
+        return;
+    }
+    report("TSC frequency", 1.0 / Timer::getTimestampPeriod(), "MHz");
+    double start = Timer::getCurrentTime();
+    unsigned long long startTsc = Timer::getTimestamp();
+#ifdef _WIN32
+    Sleep(100);
+#else
+    usleep(100000);
+#endif
+    double clock = Timer::getCurrentTime() - start;
+    double tsc = double(Timer::getTimestamp() - startTsc) * Timer::getTimestampPeriod();
+    report("monotonic clock", clock, "us");
+    report("TSC", tsc, "us");
+    report("relative error", (tsc - clock) / clock * 1e6, "ppm");
+}
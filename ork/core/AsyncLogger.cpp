@@ -0,0 +1,470 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/core/AsyncLogger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <time.h>
+
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <sys/types.h>
+#include <sys/timeb.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// if defined, the timed waits use the monotonic clock, so that they are not
+// affected by changes of the system time
+#if defined(__linux__)
+#define MONOTONIC_WAIT
+#endif
+
+#include "ork/core/Atomic.h"
+#include "ork/core/Timer.h"
+
+using namespace std;
+
+namespace ork
+{
+
+/**
+ * Returns the current time plus the given delay.
+ *
+ * @param delay a delay in milliseconds.
+ * @param[out] ts the returned time.
+ */
+static void getAbsoluteTime(int delay, timespec &ts)
+{
+#ifdef _WIN32
+    _timeb t;
+#ifdef _MSC_VER
+    _ftime64_s(&t);
+#else
+    _ftime(&t);
+#endif
+    ts.tv_sec = (long) t.time;
+    ts.tv_nsec = (long) (t.millitm * 1000000);
+#elif defined(MONOTONIC_WAIT)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    ts.tv_nsec += long(delay) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec = ts.tv_nsec % 1000000000;
+    }
+}
+
+/**
+ * The maximum time, in micro seconds, that #flush waits for the background
+ * thread if it is writing messages.
+ */
+static const double FLUSH_TIMEOUT = 1e6;
+
+/**
+ * A logged message, with its sequence number.
+ */
+struct AsyncLogger::Message
+{
+    long sequence;
+
+    string topic;
+
+    string msg;
+
+    bool operator<(const Message &m) const
+    {
+        return sequence < m.sequence;
+    }
+};
+
+/**
+ * A fixed size circular buffer of variable size messages, written by a
+ * single thread and read by a single other thread, without locking. If the
+ * buffer is full new messages are dropped, so that the writer thread is never
+ * blocked (see TraceBuffer).
+ */
+struct AsyncLogger::Buffer
+{
+    /**
+     * The header of a message in #data, followed by the topic and message
+     * characters, and padded to a multiple of sizeof(long).
+     */
+    struct Header
+    {
+        long sequence;
+
+        int topicSize;
+
+        int msgSize;
+    };
+
+    char *data; ///< the content of this buffer.
+
+    long mask; ///< the size of this buffer, minus one.
+
+    volatile long head; ///< the index after the last written message.
+
+    volatile long tail; ///< the index of the oldest message not read yet.
+
+    volatile long dropped; ///< the number of dropped messages.
+
+    AsyncLogger *logger; ///< the logger that owns this buffer.
+
+    bool released; ///< true if the writer thread has exited. Protected by the logger mutex.
+
+    Buffer(AsyncLogger *logger, int size) :
+        data(new char[size]), mask(size - 1), head(0), tail(0), dropped(0), logger(logger), released(false)
+    {
+    }
+
+    ~Buffer()
+    {
+        delete[] data;
+    }
+
+    /**
+     * Returns the size of the given message in this buffer.
+     */
+    static long getSize(const string &topic, const string &msg)
+    {
+        long size = long(sizeof(Header) + topic.size() + msg.size());
+        return (size + long(sizeof(long)) - 1) & ~long(sizeof(long) - 1);
+    }
+
+    /**
+     * Returns the number of bytes currently used in this buffer.
+     */
+    long getUsed()
+    {
+        return ork_atomic_load(&head) - ork_atomic_load(&tail);
+    }
+
+    /**
+     * Adds a message to this buffer. Must only be called by the writer thread.
+     *
+     * @return false if the buffer was full (the message is then dropped).
+     */
+    bool push(long sequence, const string &topic, const string &msg)
+    {
+        long h = head;
+        long size = getSize(topic, msg);
+        if (h + size - ork_atomic_load(&tail) > mask + 1) {
+            atomic_increment(&dropped);
+            return false;
+        }
+        Header header;
+        header.sequence = sequence;
+        header.topicSize = int(topic.size());
+        header.msgSize = int(msg.size());
+        copy(h, (const char*) &header, sizeof(Header));
+        copy(h + sizeof(Header), topic.data(), topic.size());
+        copy(h + sizeof(Header) + topic.size(), msg.data(), msg.size());
+        ork_atomic_store(&head, h + size);
+        return true;
+    }
+
+    /**
+     * Removes the oldest message from this buffer. Must only be called by the
+     * reader thread.
+     *
+     * @param[out] m the removed message.
+     * @return false if the buffer was empty.
+     */
+    bool pop(Message &m)
+    {
+        long t = tail;
+        if (t == ork_atomic_load(&head)) {
+            return false;
+        }
+        Header header;
+        copy((char*) &header, t, sizeof(Header));
+        m.sequence = header.sequence;
+        m.topic.resize(header.topicSize);
+        m.msg.resize(header.msgSize);
+        if (header.topicSize > 0) {
+            copy(&m.topic[0], t + sizeof(Header), header.topicSize);
+        }
+        if (header.msgSize > 0) {
+            copy(&m.msg[0], t + sizeof(Header) + header.topicSize, header.msgSize);
+        }
+        long size = sizeof(Header) + header.topicSize + header.msgSize;
+        ork_atomic_store(&tail, t + ((size + long(sizeof(long)) - 1) & ~long(sizeof(long) - 1)));
+        return true;
+    }
+
+    /**
+     * Copies the given bytes at the given position in this buffer.
+     */
+    void copy(long pos, const char *src, long n)
+    {
+        long start = pos & mask;
+        long first = min(n, mask + 1 - start);
+        memcpy(data + start, src, first);
+        memcpy(data, src + first, n - first);
+    }
+
+    /**
+     * Copies the bytes at the given position in this buffer.
+     */
+    void copy(char *dst, long pos, long n)
+    {
+        long start = pos & mask;
+        long first = min(n, mask + 1 - start);
+        memcpy(dst, data + start, first);
+        memcpy(dst + first, data, n - first);
+    }
+};
+
+AsyncLogger::AsyncLogger(const string &type, ptr<Logger> next, int bufferSize, int period) :
+    Logger(type), next(next), bufferSize(bufferSize), period(period), releasedDrops(0), sequence(0), reportedDrops(0), stop(false)
+{
+    assert(bufferSize > 0 && (bufferSize & (bufferSize - 1)) == 0);
+    key = new pthread_key_t;
+    pthread_key_create((pthread_key_t*) key, releaseBuffer);
+    wakeUp = new pthread_cond_t;
+    pthread_condattr_t condAttrs;
+    pthread_condattr_init(&condAttrs);
+#ifdef MONOTONIC_WAIT
+    pthread_condattr_setclock(&condAttrs, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init((pthread_cond_t*) wakeUp, &condAttrs);
+    pthread_condattr_destroy(&condAttrs);
+    outputMutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) outputMutex, NULL);
+    // the thread must be created last, since it uses the above fields
+    thread = new pthread_t;
+    pthread_create((pthread_t*) thread, NULL, writerThread, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    stop = true;
+    pthread_cond_signal((pthread_cond_t*) wakeUp);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    // the background thread writes the pending messages before it terminates
+    pthread_join(*((pthread_t*) thread), NULL);
+    delete (pthread_t*) thread;
+    pthread_mutex_destroy((pthread_mutex_t*) outputMutex);
+    delete (pthread_mutex_t*) outputMutex;
+    pthread_cond_destroy((pthread_cond_t*) wakeUp);
+    delete (pthread_cond_t*) wakeUp;
+    pthread_key_delete(*((pthread_key_t*) key));
+    delete (pthread_key_t*) key;
+    for (unsigned int i = 0; i < buffers.size(); ++i) {
+        delete buffers[i];
+    }
+    for (unsigned int i = 0; i < freeBuffers.size(); ++i) {
+        delete freeBuffers[i];
+    }
+}
+
+void AsyncLogger::log(const string &topic, const string &msg)
+{
+    if (!hasTopic(topic) || (next != NULL && !next->hasTopic(topic))) {
+        return;
+    }
+    Buffer *b = getBuffer();
+    long size = Buffer::getSize(topic, msg);
+    if (size > bufferSize / 2) {
+        // a large message is written synchronously, after the previous
+        // messages, to preserve the order of the messages of this thread
+        pthread_mutex_lock((pthread_mutex_t*) outputMutex);
+        writeMessages();
+        vector<Message> messages(1);
+        messages[0].sequence = atomic_exchange_and_add(&sequence, 1);
+        messages[0].topic = topic;
+        messages[0].msg = msg;
+        write(messages);
+        pthread_mutex_unlock((pthread_mutex_t*) outputMutex);
+        return;
+    }
+    b->push(atomic_exchange_and_add(&sequence, 1), topic, msg);
+    if (b->getUsed() > bufferSize / 2) {
+        // wakes up the background thread before the buffer gets full
+        pthread_cond_signal((pthread_cond_t*) wakeUp);
+    }
+}
+
+void AsyncLogger::flush()
+{
+    Timer timer;
+    double deadline = timer.start() + FLUSH_TIMEOUT;
+    while (pthread_mutex_trylock((pthread_mutex_t*) outputMutex) != 0) {
+        if (timer.start() > deadline) {
+            return;
+        }
+#ifdef _WIN32
+        Sleep(0);
+#else
+        usleep(100);
+#endif
+    }
+    writeMessages();
+    if (next == NULL) {
+        cerr.flush();
+    } else {
+        next->flush();
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) outputMutex);
+}
+
+long AsyncLogger::getDropped()
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    long dropped = releasedDrops;
+    for (unsigned int i = 0; i < buffers.size(); ++i) {
+        dropped += ork_atomic_load(&buffers[i]->dropped);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return dropped;
+}
+
+AsyncLogger::Buffer *AsyncLogger::getBuffer()
+{
+    Buffer *b = (Buffer*) pthread_getspecific(*((pthread_key_t*) key));
+    if (b == NULL) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        if (freeBuffers.empty()) {
+            b = new Buffer(this, bufferSize);
+        } else {
+            // reuses the buffer of a thread that has exited
+            b = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        buffers.push_back(b);
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        pthread_setspecific(*((pthread_key_t*) key), b);
+    }
+    return b;
+}
+
+void AsyncLogger::releaseBuffer(void *buffer)
+{
+    // the remaining messages of the buffer are written by the next call to
+    // writeMessages, which then moves this buffer to the free buffers
+    Buffer *b = (Buffer*) buffer;
+    pthread_mutex_lock((pthread_mutex_t*) b->logger->mutex);
+    b->released = true;
+    pthread_mutex_unlock((pthread_mutex_t*) b->logger->mutex);
+}
+
+void AsyncLogger::writeMessages()
+{
+    // NOTE: the outputMutex should be locked before calling this method!
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    vector<Buffer*> current(buffers);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    vector<Message> messages;
+    Message m;
+    for (unsigned int i = 0; i < current.size(); ++i) {
+        while (current[i]->pop(m)) {
+            messages.push_back(m);
+        }
+    }
+
+    // the buffers of the threads that have exited, now empty, are moved to
+    // the free buffers (a released buffer no longer receives messages)
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    long dropped = 0;
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < buffers.size(); ++i) {
+        Buffer *b = buffers[i];
+        if (b->released && b->getUsed() == 0) {
+            releasedDrops += b->dropped;
+            b->dropped = 0;
+            b->released = false;
+            freeBuffers.push_back(b);
+        } else {
+            dropped += ork_atomic_load(&b->dropped);
+            buffers[n++] = b;
+        }
+    }
+    buffers.resize(n);
+    dropped += releasedDrops;
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    // the messages of each buffer are already sorted, but the messages of
+    // different threads must be interleaved
+    sort(messages.begin(), messages.end());
+    if (dropped > reportedDrops) {
+        ostringstream oss;
+        oss << dropped - reportedDrops << " messages dropped";
+        m.sequence = messages.empty() ? 0 : messages.back().sequence;
+        m.topic = "LOGGER";
+        m.msg = oss.str();
+        messages.push_back(m);
+        reportedDrops = dropped;
+    }
+    if (!messages.empty()) {
+        write(messages);
+    }
+}
+
+void AsyncLogger::write(const vector<Message> &messages)
+{
+    if (next != NULL) {
+        for (unsigned int i = 0; i < messages.size(); ++i) {
+            next->log(messages[i].topic, messages[i].msg);
+        }
+        return;
+    }
+    string batch;
+    for (unsigned int i = 0; i < messages.size(); ++i) {
+        batch += type + " [" + messages[i].topic + "] " + messages[i].msg + "\n";
+    }
+    cerr.write(batch.data(), batch.size());
+    cerr.flush();
+}
+
+void* AsyncLogger::writerThread(void *arg)
+{
+    AsyncLogger *logger = (AsyncLogger*) arg;
+    bool stop = false;
+    while (!stop) {
+        pthread_mutex_lock((pthread_mutex_t*) logger->mutex);
+        if (!logger->stop) {
+            timespec deadline;
+            getAbsoluteTime(logger->period, deadline);
+            pthread_cond_timedwait((pthread_cond_t*) logger->wakeUp, (pthread_mutex_t*) logger->mutex, &deadline);
+        }
+        stop = logger->stop;
+        pthread_mutex_unlock((pthread_mutex_t*) logger->mutex);
+
+        pthread_mutex_lock((pthread_mutex_t*) logger->outputMutex);
+        logger->writeMessages();
+        pthread_mutex_unlock((pthread_mutex_t*) logger->outputMutex);
+    }
+    return NULL;
+}
+
+}
@@ -0,0 +1,199 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_ASYNC_LOGGER_H_
+#define _ORK_ASYNC_LOGGER_H_
+
+#include <vector>
+
+#include "ork/core/Logger.h"
+
+namespace ork
+{
+
+/**
+ * A Logger that writes its messages asynchronously, so that logging does not
+ * slow down the threads that log messages. Each thread formats its messages
+ * in its own circular buffer, without locking, and a background thread
+ * periodically writes these messages in batches, in the order in which they
+ * were logged, either to the standard error output stream cerr, or to
+ * another logger (such as a FileLogger). If the buffer of a thread is full
+ * its new messages are dropped instead of blocking the thread; the number of
+ * dropped messages is then logged with the next batch.
+ * @ingroup core
+ */
+class ORK_API AsyncLogger : public Logger
+{
+public:
+    /**
+     * Creates a new AsyncLogger and starts its background thread.
+     *
+     * @param type the type of this logger.
+     * @param next the logger to which messages must be forwarded by the
+     *      background thread, or NULL to write them directly to cerr.
+     * @param bufferSize the size in bytes of the buffer of each thread.
+     *      Must be a power of two. Messages larger than half this size are
+     *      written synchronously.
+     * @param period the maximum delay, in milliseconds, between the moment
+     *      a message is logged and the moment it is written.
+     */
+    AsyncLogger(const std::string &type, ptr<Logger> next = NULL, int bufferSize = 65536, int period = 10);
+
+    /**
+     * Writes the pending messages, stops the background thread, and destroys
+     * this logger.
+     */
+    virtual ~AsyncLogger();
+
+    /**
+     * Adds the given message to the buffer of the calling thread.
+     */
+    virtual void log(const std::string &topic, const std::string &msg);
+
+    /**
+     * Writes the messages logged before this call, and flushes the output.
+     * If the messages are being written by another thread, this method
+     * waits at most one second for it, and returns without writing anything
+     * after this delay. Hence it can be called safely
+     * before a crash, even if the background thread is blocked.
+     */
+    virtual void flush();
+
+    /**
+     * Returns the number of messages dropped so far because the buffer of
+     * their thread was full.
+     */
+    long getDropped();
+
+private:
+    struct Buffer;
+
+    struct Message;
+
+    /**
+     * The logger to which messages are forwarded, or NULL to write them to
+     * cerr.
+     */
+    ptr<Logger> next;
+
+    /**
+     * The size in bytes of each buffer.
+     */
+    int bufferSize;
+
+    /**
+     * The maximum delay in milliseconds between the moment a message is
+     * logged and the moment it is written.
+     */
+    int period;
+
+    /**
+     * The buffers of the threads that have logged messages so far, and that
+     * are still alive or whose messages are not all written yet. Protected
+     * by #mutex.
+     */
+    std::vector<Buffer*> buffers;
+
+    /**
+     * The buffers of the threads that have exited, available for new
+     * threads. Protected by #mutex. Buffers are only deleted with this
+     * logger.
+     */
+    std::vector<Buffer*> freeBuffers;
+
+    /**
+     * The number of dropped messages of the buffers moved to #freeBuffers.
+     * Protected by #mutex.
+     */
+    long releasedDrops;
+
+    /**
+     * A pthread_key_t giving the buffer of the calling thread.
+     */
+    void *key;
+
+    /**
+     * The background thread (a pthread_t).
+     */
+    void *thread;
+
+    /**
+     * A condition, associated with #mutex, used to wake up the background
+     * thread.
+     */
+    void *wakeUp;
+
+    /**
+     * A mutex held while messages are read from the buffers and written.
+     * The buffers have a single reader at a time thanks to this mutex.
+     */
+    void *outputMutex;
+
+    /**
+     * The sequence number of the next logged message, used to write the
+     * messages of all threads in the order in which they were logged.
+     */
+    volatile long sequence;
+
+    /**
+     * The number of dropped messages already reported.
+     */
+    long reportedDrops;
+
+    /**
+     * True if the background thread must stop.
+     */
+    bool stop;
+
+    /**
+     * Returns the buffer of the calling thread, creating it if necessary.
+     */
+    Buffer *getBuffer();
+
+    /**
+     * The destructor of the #key value, called when a thread exits. Marks its
+     * buffer as released, so that it can be reused once its messages are
+     * written.
+     */
+    static void releaseBuffer(void *buffer);
+
+    /**
+     * Reads and writes the messages currently in the buffers. The
+     * #outputMutex must be locked before calling this method.
+     */
+    void writeMessages();
+
+    /**
+     * Writes a batch of messages to #next or to cerr.
+     */
+    void write(const std::vector<Message> &messages);
+
+    /**
+     * The main method of the background thread.
+     */
+    static void* writerThread(void *arg);
+};
+
+}
+
+#endif
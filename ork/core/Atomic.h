@@ -46,6 +46,36 @@ namespace ork
  *
  * - atomic_decrement(*pw)
  *        adds 1 to *pw and returns its *previous* value
+ *
+ * - atomic_increment_relaxed(*pw)
+ *        adds 1 to *pw, without any memory ordering constraint (sufficient
+ *        to acquire a new reference on a reference counted object)
+ *
+ * - atomic_decrement_acq_rel(*pw)
+ *        subtracts 1 from *pw and returns its *previous* value, with acquire
+ *        and release semantics (sufficient to release a reference on a
+ *        reference counted object)
+ *
+ * The load and store operations are prefixed with ork_, so that they do not
+ * hide std::atomic_load and std::atomic_store in the files that include this
+ * one before a standard header.
+ *
+ * - ork_atomic_load(*pw)
+ *        returns the value of *pw, with acquire semantics
+ *
+ * - ork_atomic_store(*pw, v)
+ *        sets *pw to v, with release semantics
+ *
+ * - atomic_compare_and_swap(*pw, oldv, newv)
+ *        sets *pw to newv if it is equal to oldv, and returns true in this
+ *        case (false otherwise)
+ *
+ * - atomic_fence()
+ *        full memory barrier
+ *
+ * - cpu_relax()
+ *        hint for the processor that the calling thread is in a spin-wait
+ *        loop (pause instruction on x86)
  */
 
 #if defined(_MSC_VER)
@@ -56,33 +86,63 @@ namespace ork
 
 #ifdef SINGLE_THREAD
 
-static FORCE_INLINE int atomic_exchange_and_add(int volatile * pw, int dv)
+static FORCE_INLINE long atomic_exchange_and_add(long volatile * pw, long dv)
 {
-    int r = *pw;
+    long r = *pw;
     *pw += dv;
     return r;
 }
 
-static FORCE_INLINE void atomic_increment(int volatile * pw)
+static FORCE_INLINE void atomic_increment(long volatile * pw)
 {
     (*pw)++;
 }
 
-static FORCE_INLINE int atomic_decrement(int volatile * pw)
+static FORCE_INLINE long atomic_decrement(long volatile * pw)
 {
     return (*pw)--;
 }
 
+#define atomic_increment_relaxed(pw) atomic_increment(pw)
+#define atomic_decrement_acq_rel(pw) atomic_decrement(pw)
+
+#define ork_atomic_load(pw) (*(pw))
+#define ork_atomic_store(pw,v) (*(pw) = (v))
+#define atomic_compare_and_swap(pw,oldv,newv) (*(pw) == (oldv) ? (*(pw) = (newv), true) : false)
+#define atomic_fence()
+#define cpu_relax()
+
 #elif defined(_MSC_VER) // MSVC
 
 #define atomic_exchange_and_add(pw,dv) _InterlockedExchangeAdd((volatile long*)(pw),(dv))
 #define atomic_increment(pw) (_InterlockedIncrement((volatile long*)(pw)))
 #define atomic_decrement(pw) (_InterlockedDecrement((volatile long*)(pw))+1)
+// interlocked operations are full memory barriers
+#define atomic_increment_relaxed(pw) atomic_increment(pw)
+#define atomic_decrement_acq_rel(pw) atomic_decrement(pw)
+// pw must point to a volatile variable: volatile accesses have acquire and
+// release semantics with MSVC
+#define ork_atomic_load(pw) (*(pw))
+#define ork_atomic_store(pw,v) (*(pw) = (v))
+#define atomic_compare_and_swap(pw,oldv,newv) (_InterlockedCompareExchange((volatile long*)(pw),(newv),(oldv)) == (oldv))
+#define atomic_fence() _mm_mfence()
+#define cpu_relax() _mm_pause()
 #elif defined(__GNUC__) // GCC
 
 #define atomic_exchange_and_add(pw,dv) __sync_fetch_and_add((volatile long*)(pw), dv)
 #define atomic_increment(pw) __sync_fetch_and_add((volatile long*)(pw), 1)
 #define atomic_decrement(pw) __sync_fetch_and_sub((volatile long*)(pw), 1)
+#define atomic_increment_relaxed(pw) __atomic_fetch_add(pw, 1, __ATOMIC_RELAXED)
+#define atomic_decrement_acq_rel(pw) __atomic_fetch_sub(pw, 1, __ATOMIC_ACQ_REL)
+#define ork_atomic_load(pw) __atomic_load_n(pw, __ATOMIC_ACQUIRE)
+#define ork_atomic_store(pw,v) __atomic_store_n(pw, v, __ATOMIC_RELEASE)
+#define atomic_compare_and_swap(pw,oldv,newv) __sync_bool_compare_and_swap(pw, oldv, newv)
+#define atomic_fence() __sync_synchronize()
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
 
 #else
 
@@ -24,6 +24,8 @@
 #include "ork/core/Logger.h"
 
 #include <iostream>
+#include <map>
+#include <vector>
 
 #include <pthread.h>
 #include <cstdarg>
@@ -42,7 +44,30 @@ static_ptr<Logger> Logger::WARNING_LOGGER(new Logger("WARNING"));
 
 static_ptr<Logger> Logger::ERROR_LOGGER(new Logger("ERROR"));
 
-Logger::Logger(const string &type) : Object("Logger"), type(type)
+/**
+ * The topics interned by Logger#getTopicId, and their ids.
+ */
+static map<string, int> &getTopicIds()
+{
+    static map<string, int> ids;
+    return ids;
+}
+
+/**
+ * The topics interned by Logger#getTopicId, indexed by their ids.
+ */
+static vector<string> &getTopicNames()
+{
+    static vector<string> names;
+    return names;
+}
+
+/**
+ * A mutex to access the interned topics from multiple threads.
+ */
+static pthread_mutex_t topicsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+Logger::Logger(const string &type) : Object("Logger"), type(type), topicMask(~0ULL)
 {
     mutex = new pthread_mutex_t;
     pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
@@ -56,7 +81,14 @@ Logger::~Logger()
 
 void Logger::addTopic(const string &topic)
 {
+    if (topics.size() == 0) {
+        topicMask = 0;
+    }
     topics = topics + topic + ";";
+    int id = getTopicId(topic);
+    if (id < MAX_TOPIC_MASK) {
+        topicMask |= 1ULL << id;
+    }
 }
 
 bool Logger::hasTopic(const string &topic)
@@ -64,6 +96,31 @@ bool Logger::hasTopic(const string &topic)
     return topics.size() == 0 || topics.find(topic, 0) != string::npos;
 }
 
+int Logger::getTopicId(const string &topic)
+{
+    pthread_mutex_lock(&topicsMutex);
+    map<string, int> &ids = getTopicIds();
+    map<string, int>::iterator i = ids.find(topic);
+    int id;
+    if (i == ids.end()) {
+        id = int(ids.size());
+        ids.insert(make_pair(topic, id));
+        getTopicNames().push_back(topic);
+    } else {
+        id = i->second;
+    }
+    pthread_mutex_unlock(&topicsMutex);
+    return id;
+}
+
+string Logger::getTopicName(int topic)
+{
+    pthread_mutex_lock(&topicsMutex);
+    string name = getTopicNames()[topic];
+    pthread_mutex_unlock(&topicsMutex);
+    return name;
+}
+
 void Logger::log(const string &topic, const string &msg)
 {
     if (hasTopic(topic)) {
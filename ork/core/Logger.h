@@ -25,8 +25,46 @@
 #define _ORK_LOGGER_H_
 
 #include <string>
+#include <sstream>
 #include "ork/core/Object.h"
 
+/**
+ * The minimum level of the messages logged with the ORK_LOG_xxx macros. The
+ * calls for lower levels are removed at compile time. 0 is for debug, 1 for
+ * info, 2 for warning and 3 for error messages.
+ */
+#ifndef ORK_LOG_LEVEL
+#define ORK_LOG_LEVEL 0
+#endif
+
+/**
+ * Logs a message with the given logger, if its level is at least
+ * ORK_LOG_LEVEL, and if the logger is not NULL and handles the given topic.
+ * The message is given as a sequence of values separated with <<, such as
+ * "DrawMesh '" << name << "'". It is only evaluated and formatted if it is
+ * actually logged. The topic must be a string literal, interned the first
+ * time the call is executed.
+ */
+#define ORK_LOG(LOGGER, LEVEL, TOPIC, MSG) \
+    do { \
+        if ((LEVEL) >= ORK_LOG_LEVEL && ::ork::Logger::LOGGER != NULL) { \
+            static const int ork_log_topic = ::ork::Logger::getTopicId(TOPIC); \
+            if (::ork::Logger::LOGGER->hasTopic(ork_log_topic)) { \
+                std::ostringstream ork_log_msg; \
+                ork_log_msg << MSG; \
+                ::ork::Logger::LOGGER->log(TOPIC, ork_log_msg.str()); \
+            } \
+        } \
+    } while (false)
+
+#define ORK_LOG_DEBUG(TOPIC, MSG) ORK_LOG(DEBUG_LOGGER, 0, TOPIC, MSG)
+
+#define ORK_LOG_INFO(TOPIC, MSG) ORK_LOG(INFO_LOGGER, 1, TOPIC, MSG)
+
+#define ORK_LOG_WARNING(TOPIC, MSG) ORK_LOG(WARNING_LOGGER, 2, TOPIC, MSG)
+
+#define ORK_LOG_ERROR(TOPIC, MSG) ORK_LOG(ERROR_LOGGER, 3, TOPIC, MSG)
+
 namespace ork
 {
 
@@ -35,7 +73,10 @@ namespace ork
  * logged to the static #DEBUG_LOGGER, #INFO_LOGGER, #WARNING_LOGGER and
  * #ERROR_LOGGER. Each message has a topic. By default a logger logs all
  * messages, whatever their topic, but it is possible to restrict logging to
- * some topics only with #addTopic.
+ * some topics only with #addTopic. The ORK_LOG_DEBUG, ORK_LOG_INFO,
+ * ORK_LOG_WARNING and ORK_LOG_ERROR macros should be preferred to direct
+ * calls to #log in frequently executed code, since they do not format
+ * messages that are not logged.
  * @ingroup core
  */
 class ORK_API Logger : public Object
@@ -84,6 +125,32 @@ public:
      */
     bool hasTopic(const std::string &topic);
 
+    /**
+     * Returns true if messages of the given topic are logged by this logger.
+     *
+     * @param topic a topic id returned by #getTopicId.
+     */
+    inline bool hasTopic(int topic)
+    {
+        if (topic < MAX_TOPIC_MASK) {
+            return ((topicMask >> topic) & 1) != 0;
+        }
+        return hasTopic(getTopicName(topic));
+    }
+
+    /**
+     * Returns a unique id for the given topic. The same id is returned for
+     * the same topic, in all loggers.
+     */
+    static int getTopicId(const std::string &topic);
+
+    /**
+     * Returns the topic whose id is given.
+     *
+     * @param topic a topic id returned by #getTopicId.
+     */
+    static std::string getTopicName(int topic);
+
     /**
      * Logs a message given by its topic and its content. The default
      * implementation of this method sends the message to the standard error
@@ -119,6 +186,18 @@ protected:
      */
     std::string topics;
 
+    /**
+     * The topics handled by this logger, as a bit mask indexed by topic ids
+     * (see #getTopicId). Topics whose id is larger than MAX_TOPIC_MASK are
+     * checked with #topics instead.
+     */
+    unsigned long long topicMask;
+
+    /**
+     * The number of topics that can be stored in #topicMask.
+     */
+    static const int MAX_TOPIC_MASK = 64;
+
     /**
      * A mutex to access this logger from multiple threads.
      */
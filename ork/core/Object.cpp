@@ -27,7 +27,12 @@
 
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
+#include <pthread.h>
+
+#include "ork/core/Atomic.h"
 #include "ork/core/Logger.h"
 
 using namespace std;
@@ -57,6 +62,8 @@ void assertAndSegfault(const char* a, const char* f, int l)
         ostringstream msg;
         msg << "Assertion failed " << a << " (file " << f << " line " << l << ")";
         ork::Logger::ERROR_LOGGER->log("ASSERTION", msg.str());
+        // writes the pending messages of asynchronous loggers before the crash
+        ork::Logger::ERROR_LOGGER->flush();
     }
     *((int*) 0) = 0;
 }
@@ -65,14 +72,111 @@ void assertAndSegfault(const char* a, const char* f, int l)
 namespace ork
 {
 
+#ifdef ORK_ACCOUNTING
+/**
+ * The instance counters of a class (see Object#getStatistics).
+ */
+struct Object::Counter
+{
+    /**
+     * The class name passed to the Object constructor, used as key in the
+     * #counters hash table, or NULL if this entry is unused. The classes
+     * whose names are equal but at different addresses have distinct
+     * counters, merged by Object#getStatistics.
+     */
+    const char * volatile type;
+
+    volatile long created; ///< the number of instances created.
+
+    volatile long deleted; ///< the number of instances deleted.
+
+    long lastCreated; ///< the value of #created at the last snapshot.
+
+    long lastDeleted; ///< the value of #deleted at the last snapshot.
+};
+
+/**
+ * The capacity of the #counters hash table. Must be a power of two.
+ */
+static const int MAX_COUNTERS = 1024;
+
+/**
+ * The instance counters of each class, in an open addressing hash table
+ * indexed by class name addresses. Entries are never removed, so that they
+ * can be found without locking. The last entry is used for all the classes
+ * if the table is full.
+ */
+static Object::Counter counters[MAX_COUNTERS + 1];
+
+/**
+ * A mutex to add entries in #counters, and to take snapshots.
+ */
+static pthread_mutex_t countersMutex = PTHREAD_MUTEX_INITIALIZER;
+
 #ifndef NDEBUG
-unsigned int Object::count = 0;
+volatile long Object::accounting = 1;
+#else
+volatile long Object::accounting = 0;
+#endif
+
+volatile long Object::referenceOperations = 0;
+
+/**
+ * The memory currently allocated for objects. Counted even if Object#accounting is
+ * disabled, because an object can be deleted while the accounting is in a
+ * different state than when the object was created.
+ */
+static volatile long liveBytes = 0;
+
+/**
+ * The memory allocated for objects while Object#accounting is enabled.
+ */
+static volatile long allocatedBytes = 0;
 
-map<char*,int>* Object::counts = NULL;
+/**
+ * The value of #allocatedBytes at the last snapshot.
+ */
+static long lastAllocatedBytes = 0;
+
+/**
+ * Returns the instance counters of the given class, creating them if
+ * necessary.
+ */
+static Object::Counter *getCounter(const char *type)
+{
+    size_t h = (size_t(type) >> 3) * 2654435761u;
+    for (int i = 0; i < MAX_COUNTERS; ++i) {
+        Object::Counter *c = counters + ((h + i) & (MAX_COUNTERS - 1));
+        const char *t = ork_atomic_load(&c->type);
+        if (t == type) {
+            return c;
+        }
+        if (t == NULL) {
+            // the entry is not used, we take it unless another thread
+            // took it in the meantime
+            pthread_mutex_lock(&countersMutex);
+            t = c->type;
+            if (t == NULL) {
+                ork_atomic_store(&c->type, type);
+                t = type;
+            }
+            pthread_mutex_unlock(&countersMutex);
+            if (t == type) {
+                return c;
+            }
+        }
+    }
+    return counters + MAX_COUNTERS;
+}
 #endif
 
 #ifdef KEEP_OBJECT_REFERENCES
 map<char*, set<Object*>* >* Object::instances = NULL;
+
+/**
+ * A mutex to access Object#instances from multiple threads.
+ */
+static pthread_mutex_t instancesMutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 #ifdef USE_SHARED_PTR
@@ -84,24 +188,21 @@ Object::Object(const char *type) : references(0)
 #ifndef NDEBUG
     // sets the type of this object
     this->type = (char*) type;
-    // increments the global instance counter
-    ++count;
+#endif
+    counter = NULL;
+#ifdef ORK_ACCOUNTING
     // increments the instance counter of the 'type' class
-    if (counts == NULL) {
-        counts = new map<char*,int>;
-    }
-
-    map<char*,int>::iterator classCount = counts->find((char *)type);
-
-    if (classCount == counts->end()) {
-        (*counts)[(char *)type] = 1;
-    } else {
-        (*counts)[(char *)type] += 1;
+    if (ork_atomic_load(&accounting) != 0) {
+        counter = getCounter(type);
+        atomic_increment(&counter->created);
     }
+#elif defined(NDEBUG)
+    (void) type;
 #endif
 
 #ifdef KEEP_OBJECT_REFERENCES
     // insert into the instances set
+    pthread_mutex_lock(&instancesMutex);
     if (instances == NULL) {
         instances = new map<char*, set<Object*>* >();
     }
@@ -111,12 +212,11 @@ Object::Object(const char *type) : references(0)
         (*instances)[(char *)type] = s;
     }
     (*instances)[(char *)type]->insert(this);
+    pthread_mutex_unlock(&instancesMutex);
 #endif
 
 #ifndef NDEBUG
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("CORE", "'" + string(type) + "' object created");
-    }
+    ORK_LOG_DEBUG("CORE", "'" << type << "' object created");
 #endif
 }
 
@@ -124,19 +224,123 @@ Object::~Object()
 {
 #ifdef KEEP_OBJECT_REFERENCES
     // remove from references
+    pthread_mutex_lock(&instancesMutex);
     (*instances)[(char *)type]->erase(this);
+    pthread_mutex_unlock(&instancesMutex);
 #endif
 
 #ifndef NDEBUG
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("CORE", "'" + string(type) + "' object deleted");
+    ORK_LOG_DEBUG("CORE", "'" << type << "' object deleted");
+#endif
+#ifdef ORK_ACCOUNTING
+    // decrements the instance counter of the class of this object
+    if (counter != NULL) {
+        atomic_increment(&counter->deleted);
+    }
+#endif
+}
+
+void *Object::operator new(size_t size)
+{
+    countBytes(long(size));
+    return ::operator new(size);
+}
+
+void Object::operator delete(void *p, size_t size)
+{
+    countBytes(-long(size));
+    ::operator delete(p);
+}
+
+void Object::countBytes(long size)
+{
+#ifdef ORK_ACCOUNTING
+    atomic_exchange_and_add(&liveBytes, size);
+    if (size > 0 && ork_atomic_load(&accounting) != 0) {
+        atomic_exchange_and_add(&allocatedBytes, size);
     }
-    // decrements the global instance counter
-    assert(count > 0);
-    --count;
-    // decrements the instance counter of the 'type' class
-    assert((*counts)[type] > 0);
-    (*counts)[type] -= 1;
+#else
+    (void) size;
+#endif
+}
+
+void Object::setAccounting(bool enabled)
+{
+#ifdef ORK_ACCOUNTING
+    ork_atomic_store(&accounting, enabled ? 1L : 0L);
+#else
+    (void) enabled;
+#endif
+}
+
+#ifdef ORK_ACCOUNTING
+static bool compareStatistics(const Object::Statistics &a, const Object::Statistics &b)
+{
+    return strcmp(a.type, b.type) < 0;
+}
+#endif
+
+void Object::getStatistics(vector<Statistics> &statistics, long *liveBytes, long *allocatedBytes)
+{
+    statistics.clear();
+#ifndef ORK_ACCOUNTING
+    if (liveBytes != NULL) {
+        *liveBytes = 0;
+    }
+    if (allocatedBytes != NULL) {
+        *allocatedBytes = 0;
+    }
+#else
+    pthread_mutex_lock(&countersMutex);
+    for (int i = 0; i <= MAX_COUNTERS; ++i) {
+        Counter *c = counters + i;
+        if (c->type == NULL && i < MAX_COUNTERS) {
+            continue;
+        }
+        long created = ork_atomic_load(&c->created);
+        long deleted = ork_atomic_load(&c->deleted);
+        Statistics s;
+        s.type = c->type == NULL ? "other" : c->type;
+        s.live = created - deleted;
+        s.created = created - c->lastCreated;
+        s.deleted = deleted - c->lastDeleted;
+        c->lastCreated = created;
+        c->lastDeleted = deleted;
+        if (created > 0) {
+            statistics.push_back(s);
+        }
+    }
+    if (liveBytes != NULL) {
+        *liveBytes = ork_atomic_load(&::ork::liveBytes);
+    }
+    if (allocatedBytes != NULL) {
+        long allocated = ork_atomic_load(&::ork::allocatedBytes);
+        *allocatedBytes = allocated - lastAllocatedBytes;
+        lastAllocatedBytes = allocated;
+    }
+    pthread_mutex_unlock(&countersMutex);
+    // merges the counters of the classes with equal names
+    sort(statistics.begin(), statistics.end(), compareStatistics);
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < statistics.size(); ++i) {
+        if (n > 0 && strcmp(statistics[n - 1].type, statistics[i].type) == 0) {
+            statistics[n - 1].live += statistics[i].live;
+            statistics[n - 1].created += statistics[i].created;
+            statistics[n - 1].deleted += statistics[i].deleted;
+        } else {
+            statistics[n++] = statistics[i];
+        }
+    }
+    statistics.resize(n);
+#endif
+}
+
+long Object::getReferenceOperations()
+{
+#ifdef ORK_ACCOUNTING
+    return ork_atomic_load(&referenceOperations);
+#else
+    return 0;
 #endif
 }
 
@@ -163,21 +367,23 @@ void Object::exit()
     }
 #ifndef NDEBUG
     // if some objects have not been destroyed (memory leak)...
-    if (count != 0) {
-        // prints how many objects of each class have not been destroyed
-        map<char*,int>::iterator i = counts->begin();
-        while (i != counts->end()) {
-            if (i->second != 0) {
-                cerr << i->second << " remaining instance(s) of " << i->first << endl;
-            }
+    vector<Statistics> statistics;
+    getStatistics(statistics);
+    bool leaks = false;
+    for (unsigned int i = 0; i < statistics.size(); ++i) {
+        if (statistics[i].live != 0) {
+            // prints how many objects of each class have not been destroyed
+            cerr << statistics[i].live << " remaining instance(s) of " << statistics[i].type << endl;
 #ifdef KEEP_OBJECT_REFERENCES
-            set<Object*>* remainingInstances = findAllInstances(i->first);
+            set<Object*>* remainingInstances = findAllInstances(statistics[i].type);
             for (set<Object*>::iterator j = remainingInstances->begin(); j != remainingInstances->end(); ++j) {
                 cerr << "\t" << (*j)->toString() << endl;
             }
 #endif
-            i++;
+            leaks = true;
         }
+    }
+    if (leaks) {
         assert(false);
     }
 #endif
@@ -26,6 +26,7 @@
 
 #include <cstdio>
 #include <cassert>
+#include <vector>
 
 #ifdef USE_SHARED_PTR
 #ifdef _MSC_VER
@@ -48,6 +49,11 @@
 #define NULL 0
 #endif
 
+// ORK_ACCOUNTING: if defined, Object can count its instances per class and
+// the memory allocated for them (see Object#setAccounting). This flag is set
+// with the ORK_ACCOUNTING option of the build files. It does not change the
+// size of Object, so that code compiled with and without it can be mixed.
+
 // ---------------------------------------------------------------------------
 // Static and dynamic assertions
 // ---------------------------------------------------------------------------
@@ -98,6 +104,20 @@ namespace ork
 class ORK_API Object
 {
 public:
+    /**
+     * Statistics about the instances of a class (see #getStatistics).
+     */
+    struct Statistics
+    {
+        const char *type; ///< the class of these instances.
+
+        long live; ///< the number of instances currently allocated.
+
+        long created; ///< the number of instances created since the last snapshot.
+
+        long deleted; ///< the number of instances deleted since the last snapshot.
+    };
+
     /**
      * Creates a new object.
      *
@@ -125,6 +145,53 @@ public:
      */
     static void exit();
 
+    /**
+     * Enables or disables the accounting of the objects created and deleted
+     * per class, and of the memory allocated for them (see #getStatistics).
+     * The accounting uses atomic counters, and is only compiled in if
+     * ORK_ACCOUNTING is defined. In debug builds it is then enabled by
+     * default, and used by #exit to detect memory leaks. It also counts the
+     * references acquired and released (see #getReferenceOperations), which
+     * makes the reference counting slower.
+     * Only the objects created while the accounting is enabled are counted.
+     * This method has no effect if ORK_ACCOUNTING is not defined.
+     */
+    static void setAccounting(bool enabled);
+
+    /**
+     * Returns the number of live instances of each class, and the number of
+     * instances created and deleted since the previous call to this method,
+     * for instance at each frame, to find the classes that are created and
+     * deleted at each frame.
+     *
+     * @param[out] statistics the statistics of each class.
+     * @param[out] liveBytes if not NULL, the memory currently allocated
+     *      for objects, whether or not the accounting is enabled.
+     * @param[out] allocatedBytes if not NULL, the memory allocated for
+     *      objects while the accounting was enabled, since the previous
+     *      call to this method.
+     */
+    static void getStatistics(std::vector<Statistics> &statistics, long *liveBytes = NULL, long *allocatedBytes = NULL);
+
+    /**
+     * Returns the number of references acquired and released on objects,
+     * i.e., the number of atomic updates of their reference counters, while
+     * the accounting was enabled (see #setAccounting). Always 0 if
+     * ORK_ACCOUNTING is not defined.
+     */
+    static long getReferenceOperations();
+
+    /**
+     * Allocates the memory for a new object, and counts it if the accounting
+     * is enabled (see #setAccounting).
+     */
+    static void *operator new(size_t size);
+
+    /**
+     * Deletes the memory of an object allocated with operator new.
+     */
+    static void operator delete(void *p, size_t size);
+
 #ifdef KEEP_OBJECT_REFERENCES
     /**
      * Returns a set containing all instances of a class, or NULL is non was created.
@@ -142,7 +209,21 @@ protected:
         delete this;
     }
 
+    /**
+     * Counts the memory allocated or released for an object, if
+     * ORK_ACCOUNTING is defined. Must be called by the subclasses that
+     * redefine operator new and delete.
+     *
+     * @param size the allocated size, or minus the released size.
+     */
+    static void countBytes(long size);
+
 public: // in fact should be private, but then ptr could not access these members
+    /*
+     * The instance counters of a class.
+     */
+    struct Counter;
+
 #ifdef USE_SHARED_PTR
     /*
      * A weak pointer to this object.
@@ -164,7 +245,10 @@ public: // in fact should be private, but then ptr could not access these member
      */
     inline void acquire()
     {
-        atomic_increment(&references);
+#ifdef ORK_ACCOUNTING
+        countReferenceOperation();
+#endif
+        atomic_increment_relaxed(&references);
     }
 
     /*
@@ -172,7 +256,10 @@ public: // in fact should be private, but then ptr could not access these member
      */
     inline void release()
     {
-        if (atomic_decrement(&references) == 1) {
+#ifdef ORK_ACCOUNTING
+        countReferenceOperation();
+#endif
+        if (atomic_decrement_acq_rel(&references) == 1) {
             doRelease();
         }
     }
@@ -224,21 +311,43 @@ private:
 
 #ifndef USE_SHARED_PTR
     /**
-     * The number of references to this object.
+     * The number of references to this object. This must be a long, the type
+     * used by the atomic operations (see Atomic.h).
      */
-    int references;
+    volatile long references;
 #endif
 
-#ifndef NDEBUG
     /**
-     * The total number of objects currently allocated in memory.
+     * The counter of the instances of the class of this object, or NULL if
+     * this object was created while the accounting was disabled. Present
+     * even if ORK_ACCOUNTING is not defined, so that the size of Object
+     * does not depend on this flag.
+     */
+    Counter *counter;
+
+#ifdef ORK_ACCOUNTING
+    /**
+     * 1 if the accounting is enabled, 0 otherwise (see #setAccounting).
      */
-    static unsigned int count;
+    static volatile long accounting;
 
     /**
-     * The number of objects currently allocated in memory, for each class.
+     * The number of references acquired and released while the accounting
+     * was enabled (see #getReferenceOperations).
      */
-    static std::map<char*, int> *counts;
+    static volatile long referenceOperations;
+
+#ifndef USE_SHARED_PTR
+    /**
+     * Counts a reference acquired or released, if the accounting is enabled.
+     */
+    static void countReferenceOperation()
+    {
+        if (ork_atomic_load(&accounting) != 0) {
+            atomic_increment_relaxed(&referenceOperations);
+        }
+    }
+#endif
 #endif
 
 #ifdef KEEP_OBJECT_REFERENCES
@@ -374,8 +483,12 @@ public:
      */
     inline void operator=(const ptr<T> &v)
     {
+        if (v.target == target) {
+            // avoids two useless atomic operations
+            return;
+        }
         // acquire must be done before release
-        // to correctly handle self assignment cases
+        // to correctly handle cases where v is owned by the old target
         if (v.target != 0) {
             v.target->acquire();
         }
@@ -386,6 +499,18 @@ public:
         }
     }
 
+    /**
+     * Exchanges the targets of this strong pointer and of the given one.
+     * Unlike an assignment, this does not change any reference count, and
+     * can be used to transfer a reference to another pointer.
+     */
+    inline void swap(ptr<T> &v)
+    {
+        T* oldTarget = target;
+        target = v.target;
+        v.target = oldTarget;
+    }
+
     /**
      * Returns the target object of this strong pointer.
      */
@@ -0,0 +1,135 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/core/ObjectPool.h"
+
+#include <new>
+
+#include "ork/core/Atomic.h"
+
+namespace ork
+{
+
+// zero initialized, i.e. usable before any dynamic initialization
+ObjectPool::FreeList ObjectPool::freeLists[ObjectPool::CLASSES];
+
+void *ObjectPool::allocate(size_t size)
+{
+    size_t c = (size + GRANULARITY - 1) / GRANULARITY;
+    if (c == 0 || c > size_t(CLASSES)) {
+        return ::operator new(size);
+    }
+    FreeList &l = freeLists[c - 1];
+    lock(l);
+    void *p = l.head;
+    if (p != NULL) {
+        l.head = *((void**) p);
+        l.size -= 1;
+        l.reused += 1;
+    } else {
+        l.allocated += 1;
+    }
+    unlock(l);
+    if (p != NULL) {
+        return p;
+    }
+    return ::operator new(c * GRANULARITY);
+}
+
+void ObjectPool::deallocate(void *p, size_t size)
+{
+    if (p == NULL) {
+        return;
+    }
+    size_t c = (size + GRANULARITY - 1) / GRANULARITY;
+    if (c == 0 || c > size_t(CLASSES)) {
+        ::operator delete(p);
+        return;
+    }
+    FreeList &l = freeLists[c - 1];
+    lock(l);
+    bool full = l.size >= MAX_FREE_BLOCKS;
+    if (!full) {
+        *((void**) p) = l.head;
+        l.head = p;
+        l.size += 1;
+    }
+    unlock(l);
+    if (full) {
+        ::operator delete(p);
+    }
+}
+
+void ObjectPool::trim()
+{
+    for (int i = 0; i < CLASSES; ++i) {
+        FreeList &l = freeLists[i];
+        lock(l);
+        void *p = l.head;
+        l.head = NULL;
+        l.size = 0;
+        unlock(l);
+        // the blocks are deleted outside the lock
+        while (p != NULL) {
+            void *next = *((void**) p);
+            ::operator delete(p);
+            p = next;
+        }
+    }
+}
+
+unsigned int ObjectPool::getAllocatedCount()
+{
+    long allocated = 0;
+    for (int i = 0; i < CLASSES; ++i) {
+        lock(freeLists[i]);
+        allocated += freeLists[i].allocated;
+        unlock(freeLists[i]);
+    }
+    return (unsigned int) allocated;
+}
+
+unsigned int ObjectPool::getReusedCount()
+{
+    long reused = 0;
+    for (int i = 0; i < CLASSES; ++i) {
+        lock(freeLists[i]);
+        reused += freeLists[i].reused;
+        unlock(freeLists[i]);
+    }
+    return (unsigned int) reused;
+}
+
+void ObjectPool::lock(FreeList &l)
+{
+    while (!atomic_compare_and_swap(&l.lock, 0L, 1L)) {
+        cpu_relax();
+    }
+}
+
+void ObjectPool::unlock(FreeList &l)
+{
+    ork_atomic_store(&l.lock, 0L);
+}
+
+}
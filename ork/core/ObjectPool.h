@@ -0,0 +1,155 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_OBJECT_POOL_H_
+#define _ORK_OBJECT_POOL_H_
+
+#include <cstddef>
+
+namespace ork
+{
+
+/**
+ * An allocator for small objects that are frequently created and deleted,
+ * such as the tasks created at each frame. Blocks are grouped in size
+ * classes, and each size class has a free list of deleted blocks that are
+ * reused by the next allocations of the same size class, instead of being
+ * returned to the system. Blocks larger than the largest size class are
+ * allocated with the global operator new. Each free list keeps at most
+ * #MAX_FREE_BLOCKS blocks, and #trim returns all the free blocks to the
+ * system. This class is thread safe.
+ * @ingroup core
+ */
+class ORK_API ObjectPool
+{
+public:
+    /**
+     * The maximum number of free blocks kept in each size class. The blocks
+     * deleted when this limit is reached are returned to the system.
+     */
+    static const int MAX_FREE_BLOCKS = 4096;
+
+    /**
+     * Allocates a block of the given size.
+     *
+     * @param size the size of the block in bytes.
+     * @return a block of at least size bytes.
+     */
+    static void *allocate(size_t size);
+
+    /**
+     * Deletes a block allocated with #allocate.
+     *
+     * @param p a block returned by #allocate.
+     * @param size the size that was passed to #allocate for this block.
+     */
+    static void deallocate(void *p, size_t size);
+
+    /**
+     * Returns the free blocks of all the size classes to the system. This
+     * can be called after a peak of allocations, such as a scene loading.
+     */
+    static void trim();
+
+    /**
+     * Returns the number of blocks allocated from the system so far.
+     */
+    static unsigned int getAllocatedCount();
+
+    /**
+     * Returns the number of allocations that reused a deleted block so far,
+     * i.e. the number of system allocations that have been avoided.
+     */
+    static unsigned int getReusedCount();
+
+private:
+    /**
+     * The size granularity of the size classes, in bytes.
+     */
+    static const size_t GRANULARITY = 16;
+
+    /**
+     * The number of size classes. Blocks larger than GRANULARITY * CLASSES
+     * bytes are not pooled.
+     */
+    static const int CLASSES = 32;
+
+    /**
+     * A free list of deleted blocks of the same size class, with the
+     * statistics of this size class. The statistics are updated while the
+     * lock is held, so that they do not add a shared cache line.
+     */
+    struct FreeList
+    {
+        /**
+         * The first free block. The first bytes of each free block contain a
+         * pointer to the next free block.
+         */
+        void *head;
+
+        /**
+         * A spin lock used to ensure consistent access to the other fields.
+         */
+        volatile long lock;
+
+        /**
+         * The number of blocks in this free list.
+         */
+        long size;
+
+        /**
+         * The number of blocks of this size class allocated from the system.
+         */
+        long allocated;
+
+        /**
+         * The number of allocations of this size class that reused a deleted
+         * block.
+         */
+        long reused;
+
+        /**
+         * Padding to avoid false sharing between free lists.
+         */
+        char padding[64 - sizeof(void*) - 4 * sizeof(long)];
+    };
+
+    /**
+     * The free lists of each size class.
+     */
+    static FreeList freeLists[CLASSES];
+
+    /**
+     * Locks the given free list.
+     */
+    static void lock(FreeList &l);
+
+    /**
+     * Unlocks the given free list.
+     */
+    static void unlock(FreeList &l);
+};
+
+}
+
+#endif
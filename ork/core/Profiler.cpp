@@ -0,0 +1,502 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/core/Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <pthread.h>
+
+#include "GL/glew.h"
+
+using namespace std;
+
+namespace ork
+{
+
+/**
+ * The node of the "Frame" root scope.
+ */
+static const int FRAME_NODE = 0;
+
+/**
+ * The node of the "GPU" root scope.
+ */
+static const int GPU_NODE = 1;
+
+/**
+ * The number of GPU queries created at once when the pool is empty.
+ */
+static const int QUERY_BATCH = 16;
+
+static_ptr<Profiler> Profiler::INSTANCE(NULL);
+
+/**
+ * The scope names interned by Profiler#getScopeId, and their ids.
+ */
+static map<string, int> &getScopeIds()
+{
+    static map<string, int> ids;
+    return ids;
+}
+
+/**
+ * The scope names interned by Profiler#getScopeId, indexed by their ids.
+ */
+static vector<string> &getScopeNames()
+{
+    static vector<string> names;
+    return names;
+}
+
+/**
+ * A mutex to access the interned scope names from multiple threads.
+ */
+static pthread_mutex_t scopesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The data of a thread using a Profiler.
+ */
+struct Profiler::ThreadData
+{
+    /**
+     * A mutex to access #times and #counts. Only contended at the end of a
+     * frame.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * The root node of this thread.
+     */
+    int root;
+
+    /**
+     * The scopes in progress in this thread, from the outermost to the
+     * innermost, with their start time.
+     */
+    vector< pair<int, double> > stack;
+
+    /**
+     * The nodes used by this thread, indexed by parent node and name id.
+     * Avoids locking the profiler mutex to find the node of a scope.
+     */
+    map<pair<int, int>, int> nodes;
+
+    /**
+     * The scope name ids of the names used by this thread, indexed by the
+     * address of these names.
+     */
+    map<const char*, int> names;
+
+    /**
+     * The time spent in each node in the current frame.
+     */
+    vector<double> times;
+
+    /**
+     * The number of executions of each node in the current frame.
+     */
+    vector<int> counts;
+};
+
+Profiler::Profiler(int historySize, int gpuLatency) :
+    Object("Profiler"), historySize(historySize), gpuLatency(gpuLatency), frameCount(0)
+{
+    assert(historySize > 0);
+    key = new pthread_key_t;
+    pthread_key_create((pthread_key_t*) key, NULL);
+    mutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
+    newNode(-1, getScopeId("Frame"), false);
+    newNode(-1, getScopeId("GPU"), true);
+    frames.resize(historySize);
+    for (int i = 0; i < historySize; ++i) {
+        frames[i].frame = -1;
+        frames[i].gpuResolved = false;
+    }
+    gpuFrame.frame = 0;
+    lastFrameEnd = frameTimer.start();
+}
+
+Profiler::~Profiler()
+{
+    for (unsigned int i = 0; i < gpuStack.size(); ++i) {
+        queries.push_back(gpuStack[i].begin);
+    }
+    pendingGpuFrames.push_back(gpuFrame);
+    for (unsigned int i = 0; i < pendingGpuFrames.size(); ++i) {
+        vector<GpuScope> &scopes = pendingGpuFrames[i].scopes;
+        for (unsigned int j = 0; j < scopes.size(); ++j) {
+            queries.push_back(scopes[j].begin);
+            queries.push_back(scopes[j].end);
+        }
+    }
+    if (queries.size() > 0) {
+        glDeleteQueries(GLsizei(queries.size()), &(queries[0]));
+    }
+    for (unsigned int i = 0; i < threads.size(); ++i) {
+        pthread_mutex_destroy(&(threads[i]->mutex));
+        delete threads[i];
+    }
+    pthread_mutex_destroy((pthread_mutex_t*) mutex);
+    delete (pthread_mutex_t*) mutex;
+    pthread_key_delete(*((pthread_key_t*) key));
+    delete (pthread_key_t*) key;
+}
+
+int Profiler::getScopeId(const string &name)
+{
+    pthread_mutex_lock(&scopesMutex);
+    map<string, int> &ids = getScopeIds();
+    map<string, int>::iterator i = ids.find(name);
+    int id;
+    if (i == ids.end()) {
+        id = int(ids.size());
+        ids.insert(make_pair(name, id));
+        getScopeNames().push_back(name);
+    } else {
+        id = i->second;
+    }
+    pthread_mutex_unlock(&scopesMutex);
+    return id;
+}
+
+string Profiler::getScopeName(int name)
+{
+    pthread_mutex_lock(&scopesMutex);
+    string s = getScopeNames()[name];
+    pthread_mutex_unlock(&scopesMutex);
+    return s;
+}
+
+void Profiler::setThreadName(const string &name)
+{
+    ThreadData *data = getThreadData();
+    int id = getScopeId(name);
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    nodes[data->root].name = id;
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void Profiler::beginScope(int name)
+{
+    beginScope(getThreadData(), name);
+}
+
+void Profiler::beginScope(const char *name)
+{
+    ThreadData *data = getThreadData();
+    map<const char*, int>::iterator i = data->names.find(name);
+    int id;
+    if (i == data->names.end()) {
+        id = getScopeId(name);
+        data->names.insert(make_pair(name, id));
+    } else {
+        id = i->second;
+    }
+    beginScope(data, id);
+}
+
+void Profiler::endScope()
+{
+    ThreadData *data = getThreadData();
+    assert(data->stack.size() > 0);
+    double end = Timer::getTaskTime();
+    int node = data->stack.back().first;
+    double duration = end - data->stack.back().second;
+    data->stack.pop_back();
+
+    pthread_mutex_lock(&(data->mutex));
+    if (node >= int(data->times.size())) {
+        data->times.resize(node + 1, 0.0);
+        data->counts.resize(node + 1, 0);
+    }
+    data->times[node] += duration;
+    data->counts[node] += 1;
+    pthread_mutex_unlock(&(data->mutex));
+}
+
+void Profiler::beginGpuScope(int name)
+{
+    int parent = gpuStack.empty() ? GPU_NODE : gpuStack.back().node;
+    GpuScope s;
+    s.node = getNode(getThreadData(), parent, name, true);
+    s.begin = newQuery();
+    s.end = 0;
+    glQueryCounter(s.begin, GL_TIMESTAMP);
+    gpuStack.push_back(s);
+}
+
+void Profiler::endGpuScope()
+{
+    assert(gpuStack.size() > 0);
+    GpuScope s = gpuStack.back();
+    gpuStack.pop_back();
+    s.end = newQuery();
+    glQueryCounter(s.end, GL_TIMESTAMP);
+    gpuFrame.scopes.push_back(s);
+}
+
+void Profiler::endFrame()
+{
+    double now = frameTimer.start();
+
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    Frame &f = frames[frameCount % historySize];
+    f.frame = frameCount;
+    f.gpuResolved = gpuFrame.scopes.empty();
+    f.times.assign(nodes.size(), 0.0);
+    f.counts.assign(nodes.size(), 0);
+    f.times[FRAME_NODE] = now - lastFrameEnd;
+    f.counts[FRAME_NODE] = 1;
+    lastFrameEnd = now;
+
+    // collects the measures of each thread, and resets them for the next frame
+    for (unsigned int i = 0; i < threads.size(); ++i) {
+        ThreadData *data = threads[i];
+        pthread_mutex_lock(&(data->mutex));
+        for (unsigned int j = 0; j < data->times.size(); ++j) {
+            if (data->counts[j] > 0) {
+                f.times[j] += data->times[j];
+                f.counts[j] += data->counts[j];
+                data->times[j] = 0.0;
+                data->counts[j] = 0;
+            }
+        }
+        pthread_mutex_unlock(&(data->mutex));
+    }
+    // the time of a thread root is the time spent in its top level scopes
+    for (unsigned int i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].depth == 1 && !nodes[i].gpu && f.counts[i] > 0) {
+            f.times[nodes[i].parent] += f.times[i];
+            f.counts[nodes[i].parent] = 1;
+        }
+    }
+
+    if (!gpuFrame.scopes.empty()) {
+        pendingGpuFrames.push_back(gpuFrame);
+        gpuFrame.scopes.clear();
+    }
+    ++frameCount;
+    gpuFrame.frame = frameCount;
+    readGpuFrames();
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+int Profiler::getFrameCount()
+{
+    return frameCount;
+}
+
+void Profiler::getStatistics(vector<ScopeStatistics> &statistics)
+{
+    statistics.clear();
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    int n = int(nodes.size());
+    // orders the nodes in depth first order, with the frame root first,
+    // then the thread roots, and finally the GPU root
+    vector< vector<int> > children(n);
+    vector<int> order;
+    for (int i = n - 1; i >= 0; --i) {
+        if (nodes[i].parent < 0) {
+            if (i != GPU_NODE) {
+                order.push_back(i);
+            }
+        } else {
+            children[nodes[i].parent].push_back(i);
+        }
+    }
+    order.insert(order.begin(), GPU_NODE);
+    vector<int> sorted;
+    while (!order.empty()) {
+        int i = order.back();
+        order.pop_back();
+        sorted.push_back(i);
+        order.insert(order.end(), children[i].begin(), children[i].end());
+    }
+
+    for (unsigned int k = 0; k < sorted.size(); ++k) {
+        int i = sorted[k];
+        ScopeStatistics s;
+        s.depth = nodes[i].depth;
+        s.gpu = nodes[i].gpu;
+        s.frames = 0;
+        s.calls = 0.0f;
+        s.minTime = 0.0;
+        s.avgTime = 0.0;
+        s.maxTime = 0.0;
+        long calls = 0;
+        for (int j = 0; j < historySize; ++j) {
+            const Frame &f = frames[j];
+            if (f.frame < 0 || (s.gpu && !f.gpuResolved) || i >= int(f.times.size()) || f.counts[i] == 0) {
+                continue;
+            }
+            double t = f.times[i];
+            s.minTime = s.frames == 0 ? t : min(s.minTime, t);
+            s.maxTime = s.frames == 0 ? t : max(s.maxTime, t);
+            s.avgTime += t;
+            calls += f.counts[i];
+            s.frames += 1;
+        }
+        if (s.frames > 0) {
+            s.avgTime /= s.frames;
+            s.calls = float(calls) / s.frames;
+            s.name = getScopeName(nodes[i].name);
+            statistics.push_back(s);
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void Profiler::print(ostream &out)
+{
+    vector<ScopeStatistics> statistics;
+    getStatistics(statistics);
+    char line[256];
+    sprintf(line, "%-40s %10s %10s %10s %8s\n", "scope", "min ms", "avg ms", "max ms", "calls");
+    out << line;
+    for (unsigned int i = 0; i < statistics.size(); ++i) {
+        const ScopeStatistics &s = statistics[i];
+        string name = string(2 * s.depth, ' ') + s.name;
+        sprintf(line, "%-40.40s %10.3f %10.3f %10.3f %8.1f\n", name.c_str(),
+            s.minTime / 1e3, s.avgTime / 1e3, s.maxTime / 1e3, s.calls);
+        out << line;
+    }
+}
+
+Profiler::ThreadData *Profiler::getThreadData()
+{
+    ThreadData *data = (ThreadData*) pthread_getspecific(*((pthread_key_t*) key));
+    if (data == NULL) {
+        data = new ThreadData();
+        pthread_mutex_init(&(data->mutex), NULL);
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        char name[32];
+        sprintf(name, "Thread %d", int(threads.size()));
+        data->root = newNode(-1, getScopeId(name), false);
+        threads.push_back(data);
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        pthread_setspecific(*((pthread_key_t*) key), data);
+    }
+    return data;
+}
+
+int Profiler::getNode(ThreadData *data, int parent, int name, bool gpu)
+{
+    pair<int, int> k = make_pair(parent, name);
+    map<pair<int, int>, int>::iterator i = data->nodes.find(k);
+    if (i != data->nodes.end()) {
+        return i->second;
+    }
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    map<pair<int, int>, int>::iterator j = nodeIds.find(k);
+    int node = j == nodeIds.end() ? newNode(parent, name, gpu) : j->second;
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    data->nodes.insert(make_pair(k, node));
+    return node;
+}
+
+int Profiler::newNode(int parent, int name, bool gpu)
+{
+    Node n;
+    n.name = name;
+    n.parent = parent;
+    n.depth = parent < 0 ? 0 : nodes[parent].depth + 1;
+    n.gpu = gpu;
+    int node = int(nodes.size());
+    nodes.push_back(n);
+    nodeIds.insert(make_pair(make_pair(parent, name), node));
+    return node;
+}
+
+void Profiler::beginScope(ThreadData *data, int name)
+{
+    int parent = data->stack.empty() ? data->root : data->stack.back().first;
+    int node = getNode(data, parent, name, false);
+    data->stack.push_back(make_pair(node, Timer::getTaskTime()));
+}
+
+unsigned int Profiler::newQuery()
+{
+    if (queries.empty()) {
+        queries.resize(QUERY_BATCH);
+        glGenQueries(QUERY_BATCH, &(queries[0]));
+    }
+    unsigned int q = queries.back();
+    queries.pop_back();
+    return q;
+}
+
+void Profiler::readGpuFrames()
+{
+    unsigned int read = 0;
+    while (read < pendingGpuFrames.size()) {
+        GpuFrame &g = pendingGpuFrames[read];
+        int age = frameCount - g.frame;
+        if (age < gpuLatency) {
+            break;
+        }
+        // timestamps are written in order, so all the results of a frame
+        // are available if the result of its last query is available
+        GLuint available = 1;
+        if (age < historySize) {
+            glGetQueryObjectuiv(g.scopes.back().end, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available == 0) {
+                break;
+            }
+        }
+        // frames that are no longer in the history are dropped
+        Frame &f = frames[g.frame % historySize];
+        bool valid = age < historySize && f.frame == g.frame;
+        for (unsigned int i = 0; i < g.scopes.size(); ++i) {
+            const GpuScope &s = g.scopes[i];
+            if (valid) {
+                GLuint64 begin;
+                GLuint64 end;
+                glGetQueryObjectui64v(s.begin, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(s.end, GL_QUERY_RESULT, &end);
+                double duration = double(end - begin) / 1e3;
+                if (s.node >= int(f.times.size())) {
+                    f.times.resize(s.node + 1, 0.0);
+                    f.counts.resize(s.node + 1, 0);
+                }
+                f.times[s.node] += duration;
+                f.counts[s.node] += 1;
+                if (nodes[s.node].depth == 1) {
+                    f.times[GPU_NODE] += duration;
+                    f.counts[GPU_NODE] = 1;
+                }
+            }
+            queries.push_back(s.begin);
+            queries.push_back(s.end);
+        }
+        if (valid) {
+            f.gpuResolved = true;
+        }
+        ++read;
+    }
+    pendingGpuFrames.erase(pendingGpuFrames.begin(), pendingGpuFrames.begin() + read);
+}
+
+}
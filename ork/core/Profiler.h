@@ -0,0 +1,478 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_PROFILER_H_
+#define _ORK_PROFILER_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ork/core/Object.h"
+#include "ork/core/Timer.h"
+
+/**
+ * Set to 0 to remove the ORK_PROFILE and ORK_PROFILE_GPU scopes at compile
+ * time.
+ */
+#ifndef ORK_PROFILING
+#define ORK_PROFILING 1
+#endif
+
+#define ORK_PROFILE_CONCAT2(A, B) A##B
+#define ORK_PROFILE_CONCAT(A, B) ORK_PROFILE_CONCAT2(A, B)
+
+#if ORK_PROFILING
+
+/**
+ * Measures the CPU time spent until the end of the enclosing block in the
+ * Profiler#INSTANCE profiler, if any, in a scope of the given name. The name
+ * must be a string literal, interned the first time the macro is executed.
+ */
+#define ORK_PROFILE(NAME) \
+    static const int ORK_PROFILE_CONCAT(ork_profile_id, __LINE__) = ::ork::Profiler::getScopeId(NAME); \
+    ::ork::Profiler::Scope ORK_PROFILE_CONCAT(ork_profile_scope, __LINE__)(ORK_PROFILE_CONCAT(ork_profile_id, __LINE__), false)
+
+/**
+ * Measures the GPU time spent by the OpenGL commands issued until the end of
+ * the enclosing block, in the Profiler#INSTANCE profiler, if any, in a scope
+ * of the given name. Must be used in the thread that owns the OpenGL context.
+ */
+#define ORK_PROFILE_GPU(NAME) \
+    static const int ORK_PROFILE_CONCAT(ork_profile_id, __LINE__) = ::ork::Profiler::getScopeId(NAME); \
+    ::ork::Profiler::Scope ORK_PROFILE_CONCAT(ork_profile_scope, __LINE__)(ORK_PROFILE_CONCAT(ork_profile_id, __LINE__), true)
+
+#else
+
+#define ORK_PROFILE(NAME)
+
+#define ORK_PROFILE_GPU(NAME)
+
+#endif
+
+namespace ork
+{
+
+/**
+ * A hierarchical frame profiler. A profiler measures the time spent in named
+ * scopes, which can be nested, on each CPU thread and on the GPU. The CPU
+ * scopes of each thread form a tree, under a root scope for this thread, and
+ * the GPU scopes form a tree under a "GPU" root scope. Each scope accumulates
+ * its duration and number of calls in each frame, and the last frames are
+ * kept in a circular buffer, from which the minimum, average and maximum time
+ * spent per frame in each scope can be computed.
+ *
+ * CPU scopes use a Timer, and the per thread data is only locked when a
+ * scope ends, with a lock that is not contended except at the end of a
+ * frame. GPU scopes use timestamp queries, taken from a pool of queries,
+ * whose results are read several frames later, only if they are available,
+ * so that they never stall the OpenGL pipeline.
+ *
+ * Scopes are usually created with the ORK_PROFILE and ORK_PROFILE_GPU
+ * macros, which do nothing if #INSTANCE is NULL. The end of each frame must
+ * be signaled with #endFrame, in the thread that owns the OpenGL context.
+ * @ingroup core
+ */
+class ORK_API Profiler : public Object
+{
+public:
+    /**
+     * The time statistics of a profiler scope.
+     */
+    struct ScopeStatistics
+    {
+        /**
+         * The name of this scope.
+         */
+        std::string name;
+
+        /**
+         * The depth of this scope in the tree of scopes. Root scopes have a
+         * depth of 0.
+         */
+        int depth;
+
+        /**
+         * True if this scope measures GPU time.
+         */
+        bool gpu;
+
+        /**
+         * Number of frames in which this scope was executed.
+         */
+        int frames;
+
+        /**
+         * Average number of executions of this scope in these frames.
+         */
+        float calls;
+
+        /**
+         * Minimum time spent in this scope in one frame, in micro seconds.
+         */
+        double minTime;
+
+        /**
+         * Average time spent in this scope per frame, in micro seconds.
+         */
+        double avgTime;
+
+        /**
+         * Maximum time spent in this scope in one frame, in micro seconds.
+         */
+        double maxTime;
+    };
+
+    /**
+     * An object that measures the time spent in a profiler scope between
+     * its construction and its destruction.
+     */
+    class ORK_API Scope
+    {
+    public:
+        /**
+         * Begins a scope in the Profiler#INSTANCE profiler, if any.
+         *
+         * @param name a scope name id returned by Profiler#getScopeId.
+         * @param gpu true to measure GPU time, false to measure CPU time.
+         */
+        inline Scope(int name, bool gpu) : profiler(INSTANCE.get()), gpu(gpu)
+        {
+            if (profiler != NULL) {
+                if (gpu) {
+                    profiler->beginGpuScope(name);
+                } else {
+                    profiler->beginScope(name);
+                }
+            }
+        }
+
+        /**
+         * Begins a CPU scope in the Profiler#INSTANCE profiler, if any.
+         *
+         * @param name the scope name. This string must not be deleted, as
+         *      its address is used to cache its scope name id.
+         */
+        inline Scope(const char *name) : profiler(INSTANCE.get()), gpu(false)
+        {
+            if (profiler != NULL) {
+                profiler->beginScope(name);
+            }
+        }
+
+        /**
+         * Ends the scope begun by the constructor.
+         */
+        inline ~Scope()
+        {
+            if (profiler != NULL) {
+                if (gpu) {
+                    profiler->endGpuScope();
+                } else {
+                    profiler->endScope();
+                }
+            }
+        }
+
+    private:
+        /**
+         * The profiler of the scope begun by the constructor, or NULL.
+         */
+        Profiler *profiler;
+
+        /**
+         * True if the scope begun by the constructor is a GPU scope.
+         */
+        bool gpu;
+    };
+
+    /**
+     * The profiler used by the ORK_PROFILE and ORK_PROFILE_GPU macros. NULL
+     * by default. Must not be changed while scopes are in progress.
+     */
+    static static_ptr<Profiler> INSTANCE;
+
+    /**
+     * Creates a new Profiler.
+     *
+     * @param historySize the number of frames whose measures are kept.
+     * @param gpuLatency the number of frames after which the results of GPU
+     *      timestamp queries are read, if they are available.
+     */
+    Profiler(int historySize = 300, int gpuLatency = 3);
+
+    /**
+     * Deletes this profiler.
+     */
+    virtual ~Profiler();
+
+    /**
+     * Returns the id of the given scope name, interned the first time this
+     * method is called for this name.
+     */
+    static int getScopeId(const std::string &name);
+
+    /**
+     * Returns the scope name whose id is given.
+     *
+     * @param name a scope name id returned by #getScopeId.
+     */
+    static std::string getScopeName(int name);
+
+    /**
+     * Sets the name of the root scope of the calling thread. The default
+     * names are "Thread 0", "Thread 1", etc, in the order in which threads
+     * first use this profiler.
+     */
+    void setThreadName(const std::string &name);
+
+    /**
+     * Begins a CPU scope in the calling thread, as a child of the current
+     * scope of this thread.
+     *
+     * @param name a scope name id returned by #getScopeId.
+     */
+    void beginScope(int name);
+
+    /**
+     * Begins a CPU scope in the calling thread, as a child of the current
+     * scope of this thread.
+     *
+     * @param name the scope name. This string must not be deleted, as its
+     *      address is used to cache its scope name id.
+     */
+    void beginScope(const char *name);
+
+    /**
+     * Ends the current CPU scope of the calling thread.
+     */
+    void endScope();
+
+    /**
+     * Begins a GPU scope, as a child of the current GPU scope. Must be
+     * called in the thread that owns the OpenGL context.
+     *
+     * @param name a scope name id returned by #getScopeId.
+     */
+    void beginGpuScope(int name);
+
+    /**
+     * Ends the current GPU scope. Must be called in the thread that owns
+     * the OpenGL context.
+     */
+    void endGpuScope();
+
+    /**
+     * Ends the current frame. The CPU scopes that end after this call are
+     * accounted in the next frame. Also reads the available results of the
+     * GPU scopes of previous frames. Must be called once per frame, in the
+     * thread that owns the OpenGL context.
+     */
+    void endFrame();
+
+    /**
+     * Returns the number of frames ended with #endFrame.
+     */
+    int getFrameCount();
+
+    /**
+     * Returns the time statistics of each scope, over the frames kept by
+     * this profiler, in the depth first order of the scope trees. The first
+     * root scope, named "Frame", measures the duration of each frame.
+     *
+     * @param[out] statistics the statistics of each scope.
+     */
+    void getStatistics(std::vector<ScopeStatistics> &statistics);
+
+    /**
+     * Prints the time statistics of each scope, in milliseconds, as an
+     * indented tree.
+     */
+    void print(std::ostream &out);
+
+private:
+    /**
+     * A node in the tree of scopes.
+     */
+    struct Node
+    {
+        int name; ///< the scope name id of this node.
+
+        int parent; ///< the parent of this node, or -1 for a root node.
+
+        int depth; ///< the depth of this node in its tree.
+
+        bool gpu; ///< true if this node measures GPU time.
+    };
+
+    /**
+     * The measures of one frame.
+     */
+    struct Frame
+    {
+        int frame; ///< the frame number, or -1 if not yet measured.
+
+        bool gpuResolved; ///< true if #times contains the GPU times.
+
+        std::vector<double> times; ///< the time spent in each node.
+
+        std::vector<int> counts; ///< the number of executions of each node.
+    };
+
+    /**
+     * A GPU scope execution, measured with two timestamp queries.
+     */
+    struct GpuScope
+    {
+        int node; ///< the node of this scope.
+
+        unsigned int begin; ///< the query for the beginning of the scope.
+
+        unsigned int end; ///< the query for the end of the scope.
+    };
+
+    /**
+     * The GPU scopes executed during a frame.
+     */
+    struct GpuFrame
+    {
+        int frame; ///< the frame number.
+
+        std::vector<GpuScope> scopes; ///< the GPU scopes of this frame.
+    };
+
+    struct ThreadData;
+
+    /**
+     * Number of frames whose measures are kept.
+     */
+    int historySize;
+
+    /**
+     * Number of frames after which GPU queries are read.
+     */
+    int gpuLatency;
+
+    /**
+     * Number of frames ended with #endFrame.
+     */
+    int frameCount;
+
+    /**
+     * A pthread key to find the ThreadData of the current thread.
+     */
+    void *key;
+
+    /**
+     * A mutex to access #nodes, #nodeIds, #threads and #frames.
+     */
+    void *mutex;
+
+    /**
+     * The nodes of the scope trees.
+     */
+    std::vector<Node> nodes;
+
+    /**
+     * The nodes of the scope trees, indexed by parent node and name id.
+     */
+    std::map<std::pair<int, int>, int> nodeIds;
+
+    /**
+     * The per thread data of the threads that used this profiler.
+     */
+    std::vector<ThreadData*> threads;
+
+    /**
+     * The measures of the last #historySize frames.
+     */
+    std::vector<Frame> frames;
+
+    /**
+     * Timer used to measure the frame durations.
+     */
+    Timer frameTimer;
+
+    /**
+     * The time at which the last frame ended.
+     */
+    double lastFrameEnd;
+
+    /**
+     * The GPU timestamp queries that are not currently used.
+     */
+    std::vector<unsigned int> queries;
+
+    /**
+     * The GPU scopes in progress, from the outermost to the innermost.
+     */
+    std::vector<GpuScope> gpuStack;
+
+    /**
+     * The GPU scopes ended during the current frame.
+     */
+    GpuFrame gpuFrame;
+
+    /**
+     * The GPU scopes of the previous frames whose queries have not been
+     * read yet, from the oldest to the newest.
+     */
+    std::vector<GpuFrame> pendingGpuFrames;
+
+    /**
+     * Returns the data of the calling thread, creating it if necessary.
+     */
+    ThreadData *getThreadData();
+
+    /**
+     * Returns the node for the given parent and name, creating it if
+     * necessary.
+     */
+    int getNode(ThreadData *data, int parent, int name, bool gpu);
+
+    /**
+     * Creates a new node. The mutex must be locked.
+     */
+    int newNode(int parent, int name, bool gpu);
+
+    /**
+     * Begins a CPU scope in the given thread.
+     */
+    void beginScope(ThreadData *data, int name);
+
+    /**
+     * Returns an unused GPU timestamp query.
+     */
+    unsigned int newQuery();
+
+    /**
+     * Reads the results of the pending GPU frames that are old enough and
+     * whose results are available. The mutex must be locked.
+     */
+    void readGpuFrames();
+};
+
+}
+
+#endif
@@ -49,8 +49,22 @@
 #   include <unistd.h>
 #endif
 
+// Defined if the CPU may have a time stamp counter (x86 and x86-64)
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#   define ORK_TIMER_HAS_TSC
+#   if defined( _MSC_VER )
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#endif
+
 #include <time.h>
 
+#include <pthread.h>
+
+#include "ork/core/Atomic.h"
+
 using namespace std;
 
 namespace ork
@@ -60,6 +74,142 @@ namespace ork
 __int64 cpuFrequency = 0;
 #endif
 
+/**
+ * The duration over which the time stamp counter frequency is measured,
+ * in microseconds.
+ */
+static const double TSC_CALIBRATION_TIME = 5000.0;
+
+/**
+ * Ensures that the time stamp counter is calibrated only once, even if
+ * several threads need it at the same time (see calibrateTsc).
+ */
+static pthread_once_t tscCalibration = PTHREAD_ONCE_INIT;
+
+/**
+ * The duration of a time stamp counter tick in microseconds. Written once by
+ * calibrateTsc.
+ */
+static double tscPeriod = 0.0;
+
+/**
+ * The time stamp counter value at the end of the calibration.
+ */
+static unsigned long long tscOrigin = 0;
+
+/**
+ * The monotonic clock time at the end of the calibration.
+ */
+static double tscOriginTime = 0.0;
+
+/**
+ * 1 if Timer#getTaskTime uses the time stamp counter. Only set to 1 after
+ * the calibration.
+ */
+static volatile long useTsc = 0;
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+static double getClockTime()
+{
+#if defined( _WIN64 ) || defined( _WIN32 )
+#   if ORK_TIMER_USE_QPC
+        if (cpuFrequency == 0) {
+            QueryPerformanceFrequency((LARGE_INTEGER*) &cpuFrequency);
+        }
+        __int64 tv;
+        QueryPerformanceCounter((LARGE_INTEGER*) &tv);
+        return tv / double(cpuFrequency) * 1e6;
+#   else
+        // on Windows > 9x, getTickCount may be as accurate
+        // (and does not require to link to winmm.lib)
+        return timeGetTime() * 1000.0;
+#   endif
+#elif defined( CLOCK_MONOTONIC )
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return double(ts.tv_sec) * 1e6 + double(ts.tv_nsec) * 1e-3;
+#else
+    timeval u;
+    gettimeofday(&u, NULL);
+    return double(u.tv_sec) * 1e6 + double(u.tv_usec);
+#endif
+}
+
+#ifdef ORK_TIMER_HAS_TSC
+
+/**
+ * Returns the current value of the time stamp counter.
+ */
+static inline unsigned long long readTsc()
+{
+#if defined( _MSC_VER )
+    return __rdtsc();
+#else
+    unsigned int lo;
+    unsigned int hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long) hi << 32) | lo;
+#endif
+}
+
+/**
+ * Returns true if the time stamp counter is invariant.
+ */
+static bool detectInvariantTsc()
+{
+    // the invariant TSC flag is bit 8 of EDX for the CPUID leaf 0x80000007
+#if defined( _MSC_VER )
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if ((unsigned int) info[0] < 0x80000007) {
+        return false;
+    }
+    __cpuid(info, 0x80000007);
+    return (info[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (edx & (1 << 8)) != 0;
+#endif
+}
+
+/**
+ * True if the CPU has an invariant time stamp counter.
+ */
+static const bool invariantTsc = detectInvariantTsc();
+
+/**
+ * Measures the duration of a time stamp counter tick against the monotonic
+ * clock. Called once, with pthread_once.
+ */
+static void calibrateTsc()
+{
+    double start = getClockTime();
+    unsigned long long startTsc = readTsc();
+    double end;
+    unsigned long long endTsc;
+    do {
+        end = getClockTime();
+        endTsc = readTsc();
+    } while (end - start < TSC_CALIBRATION_TIME);
+    tscOrigin = endTsc;
+    tscOriginTime = end;
+    tscPeriod = (end - start) / double(endTsc - startTsc);
+}
+
+#else
+
+static const bool invariantTsc = false;
+
+#endif
+
 Timer::Timer()
 {
     numCycles = 0;
@@ -182,21 +332,57 @@ void Timer::getTimeOfTheDayString(char* buffer, int bufSize)
 
 double Timer::getCurrentTime()
 {
-#if defined( _WIN64 ) || defined( _WIN32 )
-#   if ORK_TIMER_USE_QPC
-        __int64 tv;
-        QueryPerformanceCounter((LARGE_INTEGER*) &tv);
-        return tv / double(cpuFrequency) * 1e6;
-#   else
-        // on Windows > 9x, getTickCount may be as accurate
-        // (and does not require to link to winmm.lib)
-        return timeGetTime() * 1000.0;
-#   endif
-#else
-    timeval u;
-    gettimeofday(&u, NULL);
-    return double(u.tv_sec) * 1e6 + double(u.tv_usec);
+    return getClockTime();
+}
+
+double Timer::getTaskTime()
+{
+#ifdef ORK_TIMER_HAS_TSC
+    if (ork_atomic_load(&useTsc) != 0) {
+        // the counters of different cores may be slightly out of sync, so
+        // the difference can be negative just after the calibration
+        return tscOriginTime + double((long long) (readTsc() - tscOrigin)) * tscPeriod;
+    }
+#endif
+    return getClockTime();
+}
+
+unsigned long long Timer::getTimestamp()
+{
+#ifdef ORK_TIMER_HAS_TSC
+    if (invariantTsc) {
+        return readTsc();
+    }
 #endif
+    return (unsigned long long) (getClockTime() * 1e3);
+}
+
+double Timer::getTimestampPeriod()
+{
+#ifdef ORK_TIMER_HAS_TSC
+    if (invariantTsc) {
+        pthread_once(&tscCalibration, calibrateTsc);
+        return tscPeriod;
+    }
+#endif
+    return 1e-3;
+}
+
+bool Timer::hasInvariantTsc()
+{
+    return invariantTsc;
+}
+
+bool Timer::useInvariantTsc(bool use)
+{
+    if (use && invariantTsc) {
+        // the calibration results are published by the store of useTsc
+        getTimestampPeriod();
+        ork_atomic_store(&useTsc, 1L);
+        return true;
+    }
+    ork_atomic_store(&useTsc, 0L);
+    return false;
 }
 
 }
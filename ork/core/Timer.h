@@ -106,6 +106,58 @@ public:
      */
     static void getTimeOfTheDayString(char* buffer, int bufSize);
 
+    /**
+     * Returns the current time in microseconds, from a monotonic clock
+     * that is not affected by changes of the system time. The origin of
+     * time may depend on the platform. All the timers use this method.
+     */
+    static double getCurrentTime();
+
+    /**
+     * Returns the current time in microseconds, for measuring short
+     * durations such as the execution time of a task. This is the
+     * calibrated time stamp counter if enabled with #useInvariantTsc, and
+     * #getCurrentTime otherwise. Must not be used for deadlines, which
+     * must use #getCurrentTime.
+     */
+    static double getTaskTime();
+
+    /**
+     * Returns a raw timestamp from the cheapest available monotonic time
+     * source. This is the time stamp counter of the CPU if it is invariant
+     * (i.e. if it runs at a constant rate in all power states), or the
+     * monotonic clock in nanoseconds otherwise. Use #getTimestampPeriod to
+     * convert differences of timestamps to microseconds.
+     */
+    static unsigned long long getTimestamp();
+
+    /**
+     * Returns the duration of a #getTimestamp tick in microseconds. The
+     * time stamp counter frequency is calibrated against the monotonic
+     * clock the first time this method is called, which takes a few
+     * milliseconds. This method is thread safe.
+     */
+    static double getTimestampPeriod();
+
+    /**
+     * Returns true if #getTimestamp returns the invariant time stamp
+     * counter of the CPU.
+     */
+    static bool hasInvariantTsc();
+
+    /**
+     * Sets whether #getTaskTime, used by the scheduler to measure the
+     * execution time of each task, must use the invariant time stamp
+     * counter of the CPU instead of the monotonic clock. This is cheaper,
+     * which matters when measuring hundreds of thousands of intervals per
+     * frame, but may be less accurate on some multi socket systems. The
+     * timers and the deadlines always use the monotonic clock.
+     *
+     * @param use true to use the time stamp counter, if it is available.
+     * @return true if the time stamp counter is now used.
+     */
+    static bool useInvariantTsc(bool use);
+
 protected:
     /**
      * Time of last call to #start or #reset.
@@ -141,12 +193,6 @@ protected:
      * True if the timer has a start value.
      */
     bool running;
-
-    /**
-     * Returns the current time in microseconds.
-     * The origin of time may depend on the platform.
-     */
-    double getCurrentTime();
 };
 
 }
@@ -102,6 +102,25 @@
 
 #include "half.h"
 
+// SSE2 is used for the array conversions when it is available, as well as
+// the F16C instructions if the compiler can generate them for some functions
+// only, depending on the CPU on which the code runs
+#if !defined(ORK_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define HALF_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define HALF_F16C
+#define HALF_F16C_TARGET __attribute__((target("avx,f16c")))
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1700
+#define HALF_F16C
+#define HALF_F16C_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
 namespace ork
 {
 
@@ -279,4 +298,271 @@ float halfToFloat(unsigned short h)
     return u.f32;
 }
 
+// Array conversions
+// -----------------
+//
+// Unlike the above functions, they round to the nearest even half-float,
+// like the F16C instructions. The scalar functions below are used for the
+// elements that do not fill a whole SIMD register, or when SSE2 is not
+// available. All code paths give the same results.
+
+static inline unsigned short floatToHalfRne(float x)
+{
+    union
+    {
+        float f32;
+        unsigned ui32;
+    } u;
+
+    u.f32 = x;
+    unsigned s = (u.ui32 >> 16) & 0x8000;
+    unsigned f = u.ui32 & 0x7fffffff;
+    unsigned h;
+    if (f > 0x7f800000) {
+        // NaN: quiet it and keep the high bits of its payload
+        h = 0x7e00 | ((f >> 13) & 0x3ff);
+    } else if (f >= 0x477ff000) {
+        // infinite, or rounds to a value larger than the largest half
+        h = 0x7c00;
+    } else if (f >= 0x38800000) {
+        // normal half: rebias the exponent and round the mantissa
+        h = (f - 0x38000000 + 0xfff + ((f >> 13) & 1)) >> 13;
+    } else if (f >= 0x33000000) {
+        // denormal half, or the smallest one if rounded up
+        unsigned m = (f & 0x7fffff) | 0x800000;
+        unsigned shift = 126 - (f >> 23);
+        unsigned rem = m & ((1u << shift) - 1);
+        unsigned tie = 1u << (shift - 1);
+        h = m >> shift;
+        if (rem > tie || (rem == tie && (h & 1) != 0)) {
+            ++h;
+        }
+    } else {
+        // less than or equal to half the smallest denormal half
+        h = 0;
+    }
+    return (unsigned short) (s | h);
+}
+
+static inline float halfToFloatExact(unsigned short h)
+{
+    union
+    {
+        float f32;
+        unsigned ui32;
+    } u;
+
+    unsigned em = h & 0x7fff;
+    if (em >= 0x7c00) {
+        // infinite or NaN, with the same quiet bit as the F16C instructions
+        u.ui32 = 0x7f800000 | (em << 13) | (em > 0x7c00 ? 0x400000 : 0);
+    } else if (em >= 0x400) {
+        u.ui32 = (em << 13) + 0x38000000;
+    } else {
+        // denormal or zero: exact, since em has at most 10 significant bits
+        u.f32 = float(em) * (1.0f / 16777216.0f);
+    }
+    u.ui32 |= (h & 0x8000) << 16;
+    return u.f32;
+}
+
+#ifdef HALF_SSE2
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Converts four floats with the same rules as floatToHalfRne, and returns
+// the results in the low 16 bits of each 32 bits lane
+static inline __m128i floatToHalfSse2(__m128 x)
+{
+    const __m128i f = _mm_and_si128(_mm_castps_si128(x), _mm_set1_epi32(0x7fffffff));
+    const __m128i s = _mm_and_si128(_mm_srli_epi32(_mm_castps_si128(x), 16), _mm_set1_epi32(0x8000));
+    // normal halves
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(f, 13), _mm_set1_epi32(1));
+    __m128i normal = _mm_add_epi32(f, _mm_set1_epi32(0xfff - 0x38000000));
+    normal = _mm_srli_epi32(_mm_add_epi32(normal, odd), 13);
+    // denormal halves: adding 0.5 aligns the value on the half denormal
+    // unit 2^-24, and the FPU does the round to nearest even (the inputs and
+    // the result are normal floats, except for tiny inputs that give 0)
+    __m128 d = _mm_add_ps(_mm_castsi128_ps(f), _mm_set1_ps(0.5f));
+    __m128i denormal = _mm_sub_epi32(_mm_castps_si128(d), _mm_set1_epi32(0x3f000000));
+    // NaNs
+    __m128i nan = _mm_and_si128(_mm_srli_epi32(f, 13), _mm_set1_epi32(0x3ff));
+    nan = _mm_or_si128(nan, _mm_set1_epi32(0x7e00));
+
+    __m128i h = select(_mm_cmpgt_epi32(f, _mm_set1_epi32(0x387fffff)), normal, denormal);
+    h = select(_mm_cmpgt_epi32(f, _mm_set1_epi32(0x477fefff)), _mm_set1_epi32(0x7c00), h);
+    h = select(_mm_cmpgt_epi32(f, _mm_set1_epi32(0x7f800000)), nan, h);
+    return _mm_or_si128(h, s);
+}
+
+// Converts four half-floats, given in the low 16 bits of each 32 bits lane,
+// with the same rules as halfToFloatExact
+static inline __m128 halfToFloatSse2(__m128i h)
+{
+    const __m128i em = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const __m128i s = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    const __m128i e = _mm_slli_epi32(em, 13);
+    __m128i normal = _mm_add_epi32(e, _mm_set1_epi32(0x38000000));
+    __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(em), _mm_set1_ps(1.0f / 16777216.0f));
+    __m128i quiet = _mm_and_si128(_mm_cmpgt_epi32(em, _mm_set1_epi32(0x7c00)), _mm_set1_epi32(0x400000));
+    __m128i special = _mm_or_si128(_mm_or_si128(e, _mm_set1_epi32(0x7f800000)), quiet);
+
+    __m128i f = select(_mm_cmplt_epi32(em, _mm_set1_epi32(0x400)), _mm_castps_si128(d), normal);
+    f = select(_mm_cmpgt_epi32(em, _mm_set1_epi32(0x7bff)), special, f);
+    return _mm_castsi128_ps(_mm_or_si128(f, s));
+}
+
+static void floatToHalfSse2(const float *src, unsigned short *dst, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = floatToHalfSse2(_mm_loadu_ps(src + i));
+        __m128i hi = floatToHalfSse2(_mm_loadu_ps(src + i + 4));
+        // sign extends the 16 bits results, so that the signed saturation
+        // of the packing instruction does not modify them
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packs_epi32(lo, hi));
+    }
+    for (; i < n; ++i) {
+        dst[i] = floatToHalfRne(src[i]);
+    }
+}
+
+static void halfToFloatSse2(const unsigned short *src, float *dst, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_ps(dst + i, halfToFloatSse2(_mm_unpacklo_epi16(h, zero)));
+        _mm_storeu_ps(dst + i + 4, halfToFloatSse2(_mm_unpackhi_epi16(h, zero)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = halfToFloatExact(src[i]);
+    }
+}
+
+#endif
+
+#ifdef HALF_F16C
+
+HALF_F16C_TARGET static void floatToHalfF16C(const float *src, unsigned short *dst, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0); // round to nearest even
+        _mm_storeu_si128((__m128i*) (dst + i), h);
+    }
+    for (; i < n; ++i) {
+        dst[i] = floatToHalfRne(src[i]);
+    }
+}
+
+HALF_F16C_TARGET static void halfToFloatF16C(const unsigned short *src, float *dst, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    for (; i < n; ++i) {
+        dst[i] = halfToFloatExact(src[i]);
+    }
+}
+
+/**
+ * Returns true if the CPU supports the F16C instructions, and if the
+ * operating system saves the AVX registers, needed to use them.
+ */
+static bool detectF16C()
+{
+    // F16C, AVX and OSXSAVE are bits 29, 28 and 27 of ECX for the CPUID
+    // leaf 1, and the OS saves the SSE and AVX states if bits 1 and 2 of
+    // the XCR0 register are set
+    const unsigned int bits = (1 << 29) | (1 << 28) | (1 << 27);
+#if defined( _MSC_VER )
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & bits) != bits) {
+        return false;
+    }
+    return (_xgetbv(0) & 6) == 6;
+#else
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 || (ecx & bits) != bits) {
+        return false;
+    }
+    __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return (eax & 6) == 6;
+#endif
+}
+
+/**
+ * True if the CPU and the OS support the F16C instructions.
+ */
+static const bool f16c = detectF16C();
+
+#else
+
+static const bool f16c = false;
+
+#endif
+
+/**
+ * True if the array conversions must use the F16C instructions.
+ */
+static bool useHalfF16C = f16c;
+
+void floatToHalf(const float *src, unsigned short *dst, int n)
+{
+#ifdef HALF_F16C
+    if (useHalfF16C) {
+        floatToHalfF16C(src, dst, n);
+        return;
+    }
+#endif
+#ifdef HALF_SSE2
+    floatToHalfSse2(src, dst, n);
+#else
+    for (int i = 0; i < n; ++i) {
+        dst[i] = floatToHalfRne(src[i]);
+    }
+#endif
+}
+
+void halfToFloat(const unsigned short *src, float *dst, int n)
+{
+#ifdef HALF_F16C
+    if (useHalfF16C) {
+        halfToFloatF16C(src, dst, n);
+        return;
+    }
+#endif
+#ifdef HALF_SSE2
+    halfToFloatSse2(src, dst, n);
+#else
+    for (int i = 0; i < n; ++i) {
+        dst[i] = halfToFloatExact(src[i]);
+    }
+#endif
+}
+
+bool hasF16C()
+{
+    return f16c;
+}
+
+bool useF16C(bool use)
+{
+    useHalfF16C = use && f16c;
+    return useHalfF16C;
+}
+
 }
@@ -42,6 +42,53 @@ ORK_API unsigned short floatToHalf(float x);
  */
 ORK_API float halfToFloat(unsigned short h);
 
+/**
+ * Converts an array of floats to their half-float representations. This
+ * function uses the F16C instructions if the CPU supports them, and SSE2
+ * instructions otherwise. In all cases the results are rounded to the
+ * nearest half-float, ties to even, like the GPU does, and the floats
+ * outside the range of half-floats give infinities or zeros. The results
+ * can therefore differ from those of floatToHalf(float), which rounds ties
+ * away from zero, truncates denormal half-floats, and is not reliable for
+ * these out of range floats.
+ * @ingroup math
+ *
+ * @param src the floats to be converted.
+ * @param[out] dst the half-floats, which must not overlap src.
+ * @param n the number of floats to be converted.
+ */
+ORK_API void floatToHalf(const float *src, unsigned short *dst, int n);
+
+/**
+ * Converts an array of half-floats to floats. This function uses the F16C
+ * instructions if the CPU supports them, and SSE2 instructions otherwise.
+ * The results are exact, and signaling NaNs are converted to quiet NaNs.
+ * @ingroup math
+ *
+ * @param src the half-floats to be converted.
+ * @param[out] dst the floats, which must not overlap src.
+ * @param n the number of half-floats to be converted.
+ */
+ORK_API void halfToFloat(const unsigned short *src, float *dst, int n);
+
+/**
+ * Returns true if the CPU and the operating system support the F16C
+ * half-float conversion instructions.
+ * @ingroup math
+ */
+ORK_API bool hasF16C();
+
+/**
+ * Sets whether the array conversion functions must use the F16C
+ * instructions, if they are available. This is the default. Otherwise
+ * they use SSE2 instructions, which give the same results.
+ * @ingroup math
+ *
+ * @param use true to use the F16C instructions, if they are available.
+ * @return true if the F16C instructions are now used.
+ */
+ORK_API bool useF16C(bool use);
+
 /**
  *
  * A 16-bit floating point number. Contains 1 sign bit, 5 biased exponent bit, and
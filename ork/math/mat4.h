@@ -490,6 +490,30 @@ inline vec3<type> mat4<type>::operator*(const vec3<type>& v) const
 template <typename type>
 box3<type> mat4<type>::operator*(const box3<type>& v) const
 {
+    if (m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1 &&
+        v.xmin <= v.xmax && v.ymin <= v.ymax && v.zmin <= v.zmax) {
+        // for an affine transformation, since floating point additions are
+        // monotonic, adding the minimum (resp. maximum) of the terms for
+        // each input axis gives the same result as the minimum (resp.
+        // maximum) over the 8 transformed corners, up to the sign of zeros
+        type lo[3];
+        type hi[3];
+        for (int i = 0; i < 3; ++i) {
+            type a = m[i][0] * v.xmin;
+            type b = m[i][0] * v.xmax;
+            type l = std::min(a, b);
+            type h = std::max(a, b);
+            a = m[i][1] * v.ymin;
+            b = m[i][1] * v.ymax;
+            l = l + std::min(a, b);
+            h = h + std::max(a, b);
+            a = m[i][2] * v.zmin;
+            b = m[i][2] * v.zmax;
+            lo[i] = l + std::min(a, b) + m[i][3];
+            hi[i] = h + std::max(a, b) + m[i][3];
+        }
+        return box3<type>(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
+    }
     box3<type> b;
     b = b.enlarge(operator*(vec3<type>(v.xmin, v.ymin, v.zmin)));
     b = b.enlarge(operator*(vec3<type>(v.xmax, v.ymin, v.zmin)));
@@ -685,4 +709,6 @@ inline ork::mat4<matType> operator*(const scalarType scalar, const ork::mat4<mat
   return m * static_cast<matType>(scalar);
 }
 
+#include "ork/math/mat4simd.h"
+
 #endif
@@ -0,0 +1,278 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_MAT4SIMD_H_
+#define _ORK_MAT4SIMD_H_
+
+// Explicit SSE2 and AVX specializations of some mat4f and mat4d methods.
+// This file is included at the end of mat4.h and must not be included
+// directly. The instruction sets are selected at compile time, from the
+// compiler flags (SSE2 is always available on x86-64; AVX requires -mavx or
+// /arch:AVX). Define ORK_NO_SIMD to use the generic scalar code.
+//
+// The matrix-matrix and matrix-vector products perform the same floating
+// point operations, in the same order, as the generic code, and their
+// results are thus identical, bit for bit (unless the compiler is allowed to
+// contract them into fused multiply-adds, with -ffp-contract=fast and FMA
+// instructions enabled, which may then change the last bit of the results).
+// The inverse methods use a cofactor expansion with 2x2 sub determinants
+// instead of 3x3 minors. Their results differ from the generic ones by a
+// few units in the last place, relatively to the largest coefficient of
+// the inverse matrix, times the condition number of the matrix.
+
+#if !defined(ORK_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define ORK_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define ORK_SIMD_AVX
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef ORK_SIMD_SSE2
+
+namespace ork
+{
+
+template <>
+inline mat4<float> mat4<float>::operator*(const mat4<float>& m2) const
+{
+    const __m128 b0 = _mm_loadu_ps(m2.m[0]);
+    const __m128 b1 = _mm_loadu_ps(m2.m[1]);
+    const __m128 b2 = _mm_loadu_ps(m2.m[2]);
+    const __m128 b3 = _mm_loadu_ps(m2.m[3]);
+    mat4<float> r;
+    for (int i = 0; i < 4; ++i) {
+        __m128 s = _mm_mul_ps(_mm_set1_ps(m[i][0]), b0);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(m[i][1]), b1));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(m[i][2]), b2));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(m[i][3]), b3));
+        _mm_storeu_ps(r.m[i], s);
+    }
+    return r;
+}
+
+template <>
+inline vec4<float> mat4<float>::operator*(const vec4<float>& v) const
+{
+    // transposes the matrix to get its columns, in order to compute the
+    // four dot products at once, in the same order as the generic code
+    __m128 c0 = _mm_loadu_ps(m[0]);
+    __m128 c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]);
+    __m128 c3 = _mm_loadu_ps(m[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 s = _mm_mul_ps(c0, _mm_set1_ps(v.x));
+    s = _mm_add_ps(s, _mm_mul_ps(c1, _mm_set1_ps(v.y)));
+    s = _mm_add_ps(s, _mm_mul_ps(c2, _mm_set1_ps(v.z)));
+    s = _mm_add_ps(s, _mm_mul_ps(c3, _mm_set1_ps(v.w)));
+    vec4<float> r;
+    _mm_storeu_ps(&r.x, s);
+    return r;
+}
+
+template <>
+inline mat4<float> mat4<float>::inverse() const
+{
+    // block matrix inversion, with the matrix seen as four 2x2 blocks
+    // | A B |
+    // | C D |, each block being stored in a vector as (a00, a01, a10, a11)
+    const __m128 r0 = _mm_loadu_ps(m[0]);
+    const __m128 r1 = _mm_loadu_ps(m[1]);
+    const __m128 r2 = _mm_loadu_ps(m[2]);
+    const __m128 r3 = _mm_loadu_ps(m[3]);
+    const __m128 A = _mm_movelh_ps(r0, r1);
+    const __m128 B = _mm_movehl_ps(r1, r0);
+    const __m128 C = _mm_movelh_ps(r2, r3);
+    const __m128 D = _mm_movehl_ps(r3, r2);
+
+    // the determinants of the blocks, (|A|, |B|, |C|, |D|)
+    const __m128 dets = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+    const __m128 detA = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 detB = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 detC = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 detD = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(3, 3, 3, 3));
+
+    // adj(D) * C and adj(A) * B, where adj is the adjugate matrix
+    const __m128 DC = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(0, 0, 3, 3)), C),
+        _mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(C, C, _MM_SHUFFLE(1, 0, 3, 2))));
+    const __m128 AB = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(0, 0, 3, 3)), B),
+        _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(B, B, _MM_SHUFFLE(1, 0, 3, 2))));
+
+    // adjugates of the blocks of the inverse matrix, up to the determinant
+    // X = |D| A - B (adj(D) C)
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), _mm_add_ps(
+        _mm_mul_ps(B, _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(3, 0, 3, 0))),
+        _mm_mul_ps(_mm_shuffle_ps(B, B, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(1, 2, 1, 2)))));
+    // W = |A| D - C (adj(A) B)
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), _mm_add_ps(
+        _mm_mul_ps(C, _mm_shuffle_ps(AB, AB, _MM_SHUFFLE(3, 0, 3, 0))),
+        _mm_mul_ps(_mm_shuffle_ps(C, C, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(AB, AB, _MM_SHUFFLE(1, 2, 1, 2)))));
+    // Y = |B| C - D adj(adj(A) B)
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), _mm_sub_ps(
+        _mm_mul_ps(D, _mm_shuffle_ps(AB, AB, _MM_SHUFFLE(0, 3, 0, 3))),
+        _mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(AB, AB, _MM_SHUFFLE(1, 2, 1, 2)))));
+    // Z = |C| B - A adj(adj(D) C)
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), _mm_sub_ps(
+        _mm_mul_ps(A, _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(0, 3, 0, 3))),
+        _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(1, 2, 1, 2)))));
+
+    // |M| = |A| |D| + |B| |C| - trace(adj(A) B adj(D) C)
+    __m128 tr = _mm_mul_ps(AB, _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(3, 1, 2, 0)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+    const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+    const __m128 invDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    X = _mm_mul_ps(X, invDet);
+    Y = _mm_mul_ps(Y, invDet);
+    Z = _mm_mul_ps(Z, invDet);
+    W = _mm_mul_ps(W, invDet);
+
+    // the blocks of the inverse matrix are the adjugates of X, Y, Z, W
+    mat4<float> r;
+    _mm_storeu_ps(r.m[0], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(r.m[1], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_storeu_ps(r.m[2], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(r.m[3], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+    return r;
+}
+
+template <>
+inline mat4<double> mat4<double>::operator*(const mat4<double>& m2) const
+{
+    mat4<double> r;
+#ifdef ORK_SIMD_AVX
+    const __m256d b0 = _mm256_loadu_pd(m2.m[0]);
+    const __m256d b1 = _mm256_loadu_pd(m2.m[1]);
+    const __m256d b2 = _mm256_loadu_pd(m2.m[2]);
+    const __m256d b3 = _mm256_loadu_pd(m2.m[3]);
+    for (int i = 0; i < 4; ++i) {
+        __m256d s = _mm256_mul_pd(_mm256_set1_pd(m[i][0]), b0);
+        s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(m[i][1]), b1));
+        s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(m[i][2]), b2));
+        s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(m[i][3]), b3));
+        _mm256_storeu_pd(r.m[i], s);
+    }
+#else
+    const __m128d b0l = _mm_loadu_pd(m2.m[0]);
+    const __m128d b0h = _mm_loadu_pd(m2.m[0] + 2);
+    const __m128d b1l = _mm_loadu_pd(m2.m[1]);
+    const __m128d b1h = _mm_loadu_pd(m2.m[1] + 2);
+    const __m128d b2l = _mm_loadu_pd(m2.m[2]);
+    const __m128d b2h = _mm_loadu_pd(m2.m[2] + 2);
+    const __m128d b3l = _mm_loadu_pd(m2.m[3]);
+    const __m128d b3h = _mm_loadu_pd(m2.m[3] + 2);
+    for (int i = 0; i < 4; ++i) {
+        const __m128d a0 = _mm_set1_pd(m[i][0]);
+        const __m128d a1 = _mm_set1_pd(m[i][1]);
+        const __m128d a2 = _mm_set1_pd(m[i][2]);
+        const __m128d a3 = _mm_set1_pd(m[i][3]);
+        __m128d l = _mm_mul_pd(a0, b0l);
+        __m128d h = _mm_mul_pd(a0, b0h);
+        l = _mm_add_pd(l, _mm_mul_pd(a1, b1l));
+        h = _mm_add_pd(h, _mm_mul_pd(a1, b1h));
+        l = _mm_add_pd(l, _mm_mul_pd(a2, b2l));
+        h = _mm_add_pd(h, _mm_mul_pd(a2, b2h));
+        l = _mm_add_pd(l, _mm_mul_pd(a3, b3l));
+        h = _mm_add_pd(h, _mm_mul_pd(a3, b3h));
+        _mm_storeu_pd(r.m[i], l);
+        _mm_storeu_pd(r.m[i] + 2, h);
+    }
+#endif
+    return r;
+}
+
+template <>
+inline vec4<double> mat4<double>::operator*(const vec4<double>& v) const
+{
+    // computes rows 0 and 1, then rows 2 and 3, from the columns of these
+    // rows, in the same order as the generic code
+    const __m128d x = _mm_set1_pd(v.x);
+    const __m128d y = _mm_set1_pd(v.y);
+    const __m128d z = _mm_set1_pd(v.z);
+    const __m128d w = _mm_set1_pd(v.w);
+    vec4<double> r;
+    for (int i = 0; i < 4; i += 2) {
+        const __m128d a01 = _mm_loadu_pd(m[i]);
+        const __m128d a23 = _mm_loadu_pd(m[i] + 2);
+        const __m128d b01 = _mm_loadu_pd(m[i + 1]);
+        const __m128d b23 = _mm_loadu_pd(m[i + 1] + 2);
+        __m128d s = _mm_mul_pd(_mm_unpacklo_pd(a01, b01), x);
+        s = _mm_add_pd(s, _mm_mul_pd(_mm_unpackhi_pd(a01, b01), y));
+        s = _mm_add_pd(s, _mm_mul_pd(_mm_unpacklo_pd(a23, b23), z));
+        s = _mm_add_pd(s, _mm_mul_pd(_mm_unpackhi_pd(a23, b23), w));
+        _mm_storeu_pd(&r.x + i, s);
+    }
+    return r;
+}
+
+template <>
+inline mat4<double> mat4<double>::inverse() const
+{
+    // cofactor expansion with the 2x2 sub determinants of the first two
+    // rows (s) and of the last two rows (c). With two doubles per SSE2
+    // register this is not faster in SIMD than in scalar code.
+    const double s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+    const double s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+    const double s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+    const double s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+    const double s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+    const double s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+    const double c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+    const double c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    const double c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+    const double c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    const double c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+    const double c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+    const double invDet = 1.0 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+    return mat4<double>(
+        (m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * invDet,
+        (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * invDet,
+        (m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * invDet,
+        (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * invDet,
+
+        (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * invDet,
+        (m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * invDet,
+        (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * invDet,
+        (m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * invDet,
+
+        (m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * invDet,
+        (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * invDet,
+        (m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * invDet,
+        (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * invDet,
+
+        (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * invDet,
+        (m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * invDet,
+        (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * invDet,
+        (m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * invDet);
+}
+
+}
+
+#endif
+
+#endif
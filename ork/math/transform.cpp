@@ -0,0 +1,341 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/math/transform.h"
+
+#include <algorithm>
+
+// ORK_SIMD_SSE2 and ORK_SIMD_AVX are defined in mat4simd.h
+
+namespace ork
+{
+
+/**
+ * The operations used by the transformation kernels, on one scalar value.
+ * Used for all the values if SIMD instructions are not available, and for
+ * the last values of the arrays otherwise.
+ */
+template <typename type>
+struct ScalarOps
+{
+    typedef type V;
+
+    static const int N = 1;
+
+    static inline V set1(type a) { return a; }
+
+    static inline V load(const type *p) { return *p; }
+
+    static inline void store(type *p, V a) { *p = a; }
+
+    static inline V add(V a, V b) { return a + b; }
+
+    static inline V mul(V a, V b) { return a * b; }
+
+    static inline V div(V a, V b) { return a / b; }
+
+    static inline V min(V a, V b) { return std::min(a, b); }
+
+    static inline V max(V a, V b) { return std::max(a, b); }
+};
+
+#ifdef ORK_SIMD_SSE2
+
+/**
+ * The operations used by the transformation kernels, on four floats.
+ */
+struct SseFloatOps
+{
+    typedef __m128 V;
+
+    static const int N = 4;
+
+    static inline V set1(float a) { return _mm_set1_ps(a); }
+
+    static inline V load(const float *p) { return _mm_loadu_ps(p); }
+
+    static inline void store(float *p, V a) { _mm_storeu_ps(p, a); }
+
+    static inline V add(V a, V b) { return _mm_add_ps(a, b); }
+
+    static inline V mul(V a, V b) { return _mm_mul_ps(a, b); }
+
+    static inline V div(V a, V b) { return _mm_div_ps(a, b); }
+
+    static inline V min(V a, V b) { return _mm_min_ps(a, b); }
+
+    static inline V max(V a, V b) { return _mm_max_ps(a, b); }
+};
+
+typedef SseFloatOps FloatOps;
+
+#ifdef ORK_SIMD_AVX
+
+/**
+ * The operations used by the transformation kernels, on four doubles.
+ */
+struct AvxDoubleOps
+{
+    typedef __m256d V;
+
+    static const int N = 4;
+
+    static inline V set1(double a) { return _mm256_set1_pd(a); }
+
+    static inline V load(const double *p) { return _mm256_loadu_pd(p); }
+
+    static inline void store(double *p, V a) { _mm256_storeu_pd(p, a); }
+
+    static inline V add(V a, V b) { return _mm256_add_pd(a, b); }
+
+    static inline V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+
+    static inline V div(V a, V b) { return _mm256_div_pd(a, b); }
+
+    static inline V min(V a, V b) { return _mm256_min_pd(a, b); }
+
+    static inline V max(V a, V b) { return _mm256_max_pd(a, b); }
+};
+
+typedef AvxDoubleOps DoubleOps;
+
+#else
+
+/**
+ * The operations used by the transformation kernels, on two doubles.
+ */
+struct SseDoubleOps
+{
+    typedef __m128d V;
+
+    static const int N = 2;
+
+    static inline V set1(double a) { return _mm_set1_pd(a); }
+
+    static inline V load(const double *p) { return _mm_loadu_pd(p); }
+
+    static inline void store(double *p, V a) { _mm_storeu_pd(p, a); }
+
+    static inline V add(V a, V b) { return _mm_add_pd(a, b); }
+
+    static inline V mul(V a, V b) { return _mm_mul_pd(a, b); }
+
+    static inline V div(V a, V b) { return _mm_div_pd(a, b); }
+
+    static inline V min(V a, V b) { return _mm_min_pd(a, b); }
+
+    static inline V max(V a, V b) { return _mm_max_pd(a, b); }
+};
+
+typedef SseDoubleOps DoubleOps;
+
+#endif
+
+#else
+
+typedef ScalarOps<float> FloatOps;
+
+typedef ScalarOps<double> DoubleOps;
+
+#endif
+
+/**
+ * Transforms the points from i to n, Ops::N points at a time, and returns
+ * the index of the first point that has not been transformed.
+ */
+template <typename type, typename Ops>
+static int transformPoints(const mat4<type> &m, const vec3array<const type> &p, const vec3array<type> &r, int i, int n)
+{
+    typedef typename Ops::V V;
+    const V m00 = Ops::set1(m[0][0]), m01 = Ops::set1(m[0][1]), m02 = Ops::set1(m[0][2]), m03 = Ops::set1(m[0][3]);
+    const V m10 = Ops::set1(m[1][0]), m11 = Ops::set1(m[1][1]), m12 = Ops::set1(m[1][2]), m13 = Ops::set1(m[1][3]);
+    const V m20 = Ops::set1(m[2][0]), m21 = Ops::set1(m[2][1]), m22 = Ops::set1(m[2][2]), m23 = Ops::set1(m[2][3]);
+    const V m30 = Ops::set1(m[3][0]), m31 = Ops::set1(m[3][1]), m32 = Ops::set1(m[3][2]), m33 = Ops::set1(m[3][3]);
+    const V one = Ops::set1(type(1.0));
+    for (; i + Ops::N <= n; i += Ops::N) {
+        const V x = Ops::load(p.x + i);
+        const V y = Ops::load(p.y + i);
+        const V z = Ops::load(p.z + i);
+        // same operations, in the same order, as mat4::operator*(vec3)
+        const V invW = Ops::div(one, Ops::add(Ops::add(Ops::add(Ops::mul(m30, x), Ops::mul(m31, y)), Ops::mul(m32, z)), m33));
+        Ops::store(r.x + i, Ops::mul(Ops::add(Ops::add(Ops::add(Ops::mul(m00, x), Ops::mul(m01, y)), Ops::mul(m02, z)), m03), invW));
+        Ops::store(r.y + i, Ops::mul(Ops::add(Ops::add(Ops::add(Ops::mul(m10, x), Ops::mul(m11, y)), Ops::mul(m12, z)), m13), invW));
+        Ops::store(r.z + i, Ops::mul(Ops::add(Ops::add(Ops::add(Ops::mul(m20, x), Ops::mul(m21, y)), Ops::mul(m22, z)), m23), invW));
+    }
+    return i;
+}
+
+/**
+ * Transforms the directions from i to n, Ops::N directions at a time, and
+ * returns the index of the first direction that has not been transformed.
+ */
+template <typename type, typename Ops>
+static int transformDirections(const mat4<type> &m, const vec3array<const type> &d, const vec3array<type> &r, int i, int n)
+{
+    typedef typename Ops::V V;
+    const V m00 = Ops::set1(m[0][0]), m01 = Ops::set1(m[0][1]), m02 = Ops::set1(m[0][2]);
+    const V m10 = Ops::set1(m[1][0]), m11 = Ops::set1(m[1][1]), m12 = Ops::set1(m[1][2]);
+    const V m20 = Ops::set1(m[2][0]), m21 = Ops::set1(m[2][1]), m22 = Ops::set1(m[2][2]);
+    for (; i + Ops::N <= n; i += Ops::N) {
+        const V x = Ops::load(d.x + i);
+        const V y = Ops::load(d.y + i);
+        const V z = Ops::load(d.z + i);
+        Ops::store(r.x + i, Ops::add(Ops::add(Ops::mul(m00, x), Ops::mul(m01, y)), Ops::mul(m02, z)));
+        Ops::store(r.y + i, Ops::add(Ops::add(Ops::mul(m10, x), Ops::mul(m11, y)), Ops::mul(m12, z)));
+        Ops::store(r.z + i, Ops::add(Ops::add(Ops::mul(m20, x), Ops::mul(m21, y)), Ops::mul(m22, z)));
+    }
+    return i;
+}
+
+/**
+ * Computes the bounds of one coordinate of the transformed boxes, for an
+ * affine transformation. Since floating point additions are monotonic,
+ * adding the minimum (resp. maximum) of the terms for each input axis, in
+ * the same order as mat4::operator*(vec3), gives the same result as the
+ * minimum (resp. maximum) over the 8 transformed corners.
+ */
+template <typename Ops>
+static inline void transformBounds(typename Ops::V c0, typename Ops::V c1, typename Ops::V c2, typename Ops::V c3,
+    typename Ops::V xmin, typename Ops::V xmax, typename Ops::V ymin, typename Ops::V ymax,
+    typename Ops::V zmin, typename Ops::V zmax, typename Ops::V &rmin, typename Ops::V &rmax)
+{
+    typedef typename Ops::V V;
+    V a = Ops::mul(c0, xmin);
+    V b = Ops::mul(c0, xmax);
+    rmin = Ops::min(a, b);
+    rmax = Ops::max(a, b);
+    a = Ops::mul(c1, ymin);
+    b = Ops::mul(c1, ymax);
+    rmin = Ops::add(rmin, Ops::min(a, b));
+    rmax = Ops::add(rmax, Ops::max(a, b));
+    a = Ops::mul(c2, zmin);
+    b = Ops::mul(c2, zmax);
+    rmin = Ops::add(Ops::add(rmin, Ops::min(a, b)), c3);
+    rmax = Ops::add(Ops::add(rmax, Ops::max(a, b)), c3);
+}
+
+/**
+ * Transforms the boxes from i to n with an affine transformation, Ops::N
+ * boxes at a time, and returns the index of the first box that has not
+ * been transformed.
+ */
+template <typename type, typename Ops>
+static int transformBoxes(const mat4<type> &m, const box3array<const type> &b, const box3array<type> &r, int i, int n)
+{
+    typedef typename Ops::V V;
+    const V m00 = Ops::set1(m[0][0]), m01 = Ops::set1(m[0][1]), m02 = Ops::set1(m[0][2]), m03 = Ops::set1(m[0][3]);
+    const V m10 = Ops::set1(m[1][0]), m11 = Ops::set1(m[1][1]), m12 = Ops::set1(m[1][2]), m13 = Ops::set1(m[1][3]);
+    const V m20 = Ops::set1(m[2][0]), m21 = Ops::set1(m[2][1]), m22 = Ops::set1(m[2][2]), m23 = Ops::set1(m[2][3]);
+    for (; i + Ops::N <= n; i += Ops::N) {
+        const V xmin = Ops::load(b.xmin + i);
+        const V xmax = Ops::load(b.xmax + i);
+        const V ymin = Ops::load(b.ymin + i);
+        const V ymax = Ops::load(b.ymax + i);
+        const V zmin = Ops::load(b.zmin + i);
+        const V zmax = Ops::load(b.zmax + i);
+        V rmin;
+        V rmax;
+        transformBounds<Ops>(m00, m01, m02, m03, xmin, xmax, ymin, ymax, zmin, zmax, rmin, rmax);
+        Ops::store(r.xmin + i, rmin);
+        Ops::store(r.xmax + i, rmax);
+        transformBounds<Ops>(m10, m11, m12, m13, xmin, xmax, ymin, ymax, zmin, zmax, rmin, rmax);
+        Ops::store(r.ymin + i, rmin);
+        Ops::store(r.ymax + i, rmax);
+        transformBounds<Ops>(m20, m21, m22, m23, xmin, xmax, ymin, ymax, zmin, zmax, rmin, rmax);
+        Ops::store(r.zmin + i, rmin);
+        Ops::store(r.zmax + i, rmax);
+    }
+    return i;
+}
+
+/**
+ * Transforms the boxes with a projective transformation, one box at a time.
+ */
+template <typename type>
+static void transformProjectiveBoxes(const mat4<type> &m, const box3array<const type> &b, const box3array<type> &r, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        box3<type> t = m * box3<type>(b.xmin[i], b.xmax[i], b.ymin[i], b.ymax[i], b.zmin[i], b.zmax[i]);
+        r.xmin[i] = t.xmin;
+        r.xmax[i] = t.xmax;
+        r.ymin[i] = t.ymin;
+        r.ymax[i] = t.ymax;
+        r.zmin[i] = t.zmin;
+        r.zmax[i] = t.zmax;
+    }
+}
+
+/**
+ * Returns true if the given matrix is an affine transformation.
+ */
+template <typename type>
+static bool isAffine(const mat4<type> &m)
+{
+    return m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1;
+}
+
+void transformPoints(const mat4f &m, const vec3array<const float> &points, const vec3array<float> &result, int n)
+{
+    int i = transformPoints<float, FloatOps>(m, points, result, 0, n);
+    transformPoints<float, ScalarOps<float> >(m, points, result, i, n);
+}
+
+void transformPoints(const mat4d &m, const vec3array<const double> &points, const vec3array<double> &result, int n)
+{
+    int i = transformPoints<double, DoubleOps>(m, points, result, 0, n);
+    transformPoints<double, ScalarOps<double> >(m, points, result, i, n);
+}
+
+void transformDirections(const mat4f &m, const vec3array<const float> &directions, const vec3array<float> &result, int n)
+{
+    int i = transformDirections<float, FloatOps>(m, directions, result, 0, n);
+    transformDirections<float, ScalarOps<float> >(m, directions, result, i, n);
+}
+
+void transformDirections(const mat4d &m, const vec3array<const double> &directions, const vec3array<double> &result, int n)
+{
+    int i = transformDirections<double, DoubleOps>(m, directions, result, 0, n);
+    transformDirections<double, ScalarOps<double> >(m, directions, result, i, n);
+}
+
+void transformBoxes(const mat4f &m, const box3array<const float> &boxes, const box3array<float> &result, int n)
+{
+    if (isAffine(m)) {
+        int i = transformBoxes<float, FloatOps>(m, boxes, result, 0, n);
+        transformBoxes<float, ScalarOps<float> >(m, boxes, result, i, n);
+    } else {
+        transformProjectiveBoxes(m, boxes, result, n);
+    }
+}
+
+void transformBoxes(const mat4d &m, const box3array<const double> &boxes, const box3array<double> &result, int n)
+{
+    if (isAffine(m)) {
+        int i = transformBoxes<double, DoubleOps>(m, boxes, result, 0, n);
+        transformBoxes<double, ScalarOps<double> >(m, boxes, result, i, n);
+    } else {
+        transformProjectiveBoxes(m, boxes, result, n);
+    }
+}
+
+}
@@ -0,0 +1,205 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_TRANSFORM_H_
+#define _ORK_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "ork/math/mat4.h"
+
+namespace ork
+{
+
+/**
+ * An array of 3D vectors, stored as a structure of arrays, i.e. with one
+ * array per coordinate. This layout allows the batch functions below to
+ * process several vectors at once with SIMD instructions.
+ * @ingroup math
+ */
+template <typename type>
+struct vec3array
+{
+    type *x; ///< the x coordinates of the vectors.
+
+    type *y; ///< the y coordinates of the vectors.
+
+    type *z; ///< the z coordinates of the vectors.
+
+    /**
+     * Creates an uninitialized array of vectors.
+     */
+    vec3array() : x(NULL), y(NULL), z(NULL)
+    {
+    }
+
+    /**
+     * Creates an array of vectors from the given coordinate arrays.
+     */
+    vec3array(type *x, type *y, type *z) : x(x), y(y), z(z)
+    {
+    }
+
+    /**
+     * Creates an array of vectors from another one. Used to convert an
+     * array of vectors to an array of constant vectors.
+     */
+    template <typename t>
+    vec3array(const vec3array<t> &v) : x(v.x), y(v.y), z(v.z)
+    {
+    }
+};
+
+/**
+ * An array of 3D bounding boxes, stored as a structure of arrays, i.e. with
+ * one array per box3 field.
+ * @ingroup math
+ */
+template <typename type>
+struct box3array
+{
+    type *xmin; ///< the minimum x coordinates of the boxes.
+
+    type *xmax; ///< the maximum x coordinates of the boxes.
+
+    type *ymin; ///< the minimum y coordinates of the boxes.
+
+    type *ymax; ///< the maximum y coordinates of the boxes.
+
+    type *zmin; ///< the minimum z coordinates of the boxes.
+
+    type *zmax; ///< the maximum z coordinates of the boxes.
+
+    /**
+     * Creates an uninitialized array of boxes.
+     */
+    box3array() : xmin(NULL), xmax(NULL), ymin(NULL), ymax(NULL), zmin(NULL), zmax(NULL)
+    {
+    }
+
+    /**
+     * Creates an array of boxes from the given coordinate arrays.
+     */
+    box3array(type *xmin, type *xmax, type *ymin, type *ymax, type *zmin, type *zmax) :
+        xmin(xmin), xmax(xmax), ymin(ymin), ymax(ymax), zmin(zmin), zmax(zmax)
+    {
+    }
+
+    /**
+     * Creates an array of boxes from another one. Used to convert an
+     * array of boxes to an array of constant boxes.
+     */
+    template <typename t>
+    box3array(const box3array<t> &b) :
+        xmin(b.xmin), xmax(b.xmax), ymin(b.ymin), ymax(b.ymax), zmin(b.zmin), zmax(b.zmax)
+    {
+    }
+};
+
+/**
+ * Transforms an array of points with the given matrix. Gives the same
+ * results as mat4#operator*(const vec3<type>&) for each point, including
+ * the division by the homogeneous coordinate.
+ *
+ * @param m the transformation matrix.
+ * @param points the points to be transformed.
+ * @param[out] result the transformed points. May be the same as points.
+ * @param n the number of points.
+ * @ingroup math
+ */
+ORK_API void transformPoints(const mat4f &m, const vec3array<const float> &points, const vec3array<float> &result, int n);
+
+/**
+ * Transforms an array of points with the given matrix. Gives the same
+ * results as mat4#operator*(const vec3<type>&) for each point, including
+ * the division by the homogeneous coordinate.
+ *
+ * @param m the transformation matrix.
+ * @param points the points to be transformed.
+ * @param[out] result the transformed points. May be the same as points.
+ * @param n the number of points.
+ * @ingroup math
+ */
+ORK_API void transformPoints(const mat4d &m, const vec3array<const double> &points, const vec3array<double> &result, int n);
+
+/**
+ * Transforms an array of directions with the upper left 3x3 part of the
+ * given matrix. Gives the same results as mat4#mat3x3() * v for each
+ * direction v.
+ *
+ * @param m the transformation matrix.
+ * @param directions the directions to be transformed.
+ * @param[out] result the transformed directions. May be the same as
+ *      directions.
+ * @param n the number of directions.
+ * @ingroup math
+ */
+ORK_API void transformDirections(const mat4f &m, const vec3array<const float> &directions, const vec3array<float> &result, int n);
+
+/**
+ * Transforms an array of directions with the upper left 3x3 part of the
+ * given matrix. Gives the same results as mat4#mat3x3() * v for each
+ * direction v.
+ *
+ * @param m the transformation matrix.
+ * @param directions the directions to be transformed.
+ * @param[out] result the transformed directions. May be the same as
+ *      directions.
+ * @param n the number of directions.
+ * @ingroup math
+ */
+ORK_API void transformDirections(const mat4d &m, const vec3array<const double> &directions, const vec3array<double> &result, int n);
+
+/**
+ * Computes the bounding boxes of an array of transformed boxes. Gives the
+ * same results as mat4#operator*(const box3<type>&) for each box, up to
+ * the sign of zero coordinates. The computation is vectorized if the
+ * matrix is an affine transformation (i.e. if its last row is 0,0,0,1).
+ *
+ * @param m the transformation matrix.
+ * @param boxes the boxes to be transformed. They must not be empty.
+ * @param[out] result the bounding boxes of the transformed boxes. May be
+ *      the same as boxes.
+ * @param n the number of boxes.
+ * @ingroup math
+ */
+ORK_API void transformBoxes(const mat4f &m, const box3array<const float> &boxes, const box3array<float> &result, int n);
+
+/**
+ * Computes the bounding boxes of an array of transformed boxes. Gives the
+ * same results as mat4#operator*(const box3<type>&) for each box, up to
+ * the sign of zero coordinates. The computation is vectorized if the
+ * matrix is an affine transformation (i.e. if its last row is 0,0,0,1).
+ *
+ * @param m the transformation matrix.
+ * @param boxes the boxes to be transformed. They must not be empty.
+ * @param[out] result the bounding boxes of the transformed boxes. May be
+ *      the same as boxes.
+ * @param n the number of boxes.
+ * @ingroup math
+ */
+ORK_API void transformBoxes(const mat4d &m, const box3array<const double> &boxes, const box3array<double> &result, int n);
+
+}
+
+#endif
@@ -33,6 +33,7 @@
 #endif
 
 #include "ork/core/Logger.h"
+#include "ork/core/Profiler.h"
 #include "ork/render/Module.h"
 #include "ork/render/Texture.h"
 
@@ -1326,9 +1327,7 @@ void FrameBuffer::setStencilMask(GLuint frontMask, GLuint backMask)
 
 void FrameBuffer::clear(bool color, bool stencil, bool depth)
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("RENDER", "Clear FrameBuffer");
-    }
+    ORK_LOG_DEBUG("RENDER", "Clear FrameBuffer");
     set();
     int buffers = 0;
     if (color) {
@@ -1346,59 +1345,55 @@ void FrameBuffer::clear(bool color, bool stencil, bool depth)
     assert(getError() == 0);
 }
 
-void FrameBuffer::draw(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, GLint first, GLsizei count, GLsizei primCount, GLint base)
+void FrameBuffer::draw(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, GLint first, GLsizei count, GLsizei primCount, GLint base)
 {
+    ORK_PROFILE("FrameBuffer::draw");
     assert(TransformFeedback::TRANSFORM == NULL);
     set();
     p->set();
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->logf("RENDER", "Draw Mesh (%d vertices)", count);
-    }
+    ORK_LOG_DEBUG("RENDER", "Draw Mesh (" << count << " vertices)");
     beginConditionalRender();
     mesh.draw(m, first, count, primCount, base);
     endConditionalRender();
 }
 
-void FrameBuffer::multiDraw(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, GLint *firsts, GLsizei *counts, GLsizei primCount, GLint* bases)
+void FrameBuffer::multiDraw(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, GLint *firsts, GLsizei *counts, GLsizei primCount, GLint* bases)
 {
+    ORK_PROFILE("FrameBuffer::multiDraw");
     assert(TransformFeedback::TRANSFORM == NULL);
     set();
     p->set();
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->logf("RENDER", "MultiDraw (%d instances)", primCount);
-    }
+    ORK_LOG_DEBUG("RENDER", "MultiDraw (" << primCount << " instances)");
     beginConditionalRender();
     mesh.multiDraw(m, firsts, counts, primCount, bases);
     endConditionalRender();
 }
 
-void FrameBuffer::drawIndirect(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, const Buffer &buf)
+void FrameBuffer::drawIndirect(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, const Buffer &buf)
 {
+    ORK_PROFILE("FrameBuffer::drawIndirect");
     assert(TransformFeedback::TRANSFORM == NULL);
     set();
     p->set();
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("RENDER", "DrawIndirect");
-    }
+    ORK_LOG_DEBUG("RENDER", "DrawIndirect");
     beginConditionalRender();
     mesh.drawIndirect(m, buf);
     endConditionalRender();
 }
 
-void FrameBuffer::drawFeedback(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, const TransformFeedback &tfb, int stream)
+void FrameBuffer::drawFeedback(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, const TransformFeedback &tfb, int stream)
 {
+    ORK_PROFILE("FrameBuffer::drawFeedback");
     assert(TransformFeedback::TRANSFORM == NULL && tfb.id != 0);
     set();
     p->set();
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("RENDER", "DrawFeedBack");
-    }
+    ORK_LOG_DEBUG("RENDER", "DrawFeedBack");
     beginConditionalRender();
     mesh.drawFeedback(m, tfb.id, stream);
     endConditionalRender();
 }
 
-void FrameBuffer::drawQuad(ptr<Program> p)
+void FrameBuffer::drawQuad(const ptr<Program> &p)
 {
     if (QUAD == NULL) {
         Mesh<vec4f, unsigned int> *quad = new Mesh<vec4f, unsigned int>(TRIANGLE_STRIP, GPU_STATIC);
@@ -1414,9 +1409,7 @@ void FrameBuffer::drawQuad(ptr<Program> p)
 
 void FrameBuffer::readPixels(int x, int y, int w, int h, TextureFormat f, PixelType t, const Buffer::Parameters &s, const Buffer &dstBuf, bool clamp)
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->logf("RENDER", "read %d pixels", w * h);
-    }
+    ORK_LOG_DEBUG("RENDER", "read " << w * h << " pixels");
     set();
     dstBuf.bind(GL_PIXEL_PACK_BUFFER);
     s.set();
@@ -1523,9 +1516,7 @@ GLenum FrameBuffer::getError()
 
 void FrameBuffer::resetAllStates()
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("RENDER", "Reset GL STATES");
-    }
+    ORK_LOG_DEBUG("RENDER", "Reset GL STATES");
     if (MeshBuffers::CURRENT != NULL) {
         MeshBuffers::CURRENT->reset();
     }
@@ -1542,9 +1533,7 @@ void FrameBuffer::set()
 {
     bool framebufferChanged = false;
     if (CURRENT != this) {
-        if (Logger::DEBUG_LOGGER != NULL) {
-            Logger::DEBUG_LOGGER->log("RENDER", "Changing Current Framebuffer");
-        }
+        ORK_LOG_DEBUG("RENDER", "Changing Current Framebuffer");
         glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
         CURRENT = this;
         framebufferChanged = true;
@@ -1576,9 +1565,7 @@ void FrameBuffer::set()
 
 void FrameBuffer::setAttachments()
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("RENDER", "Setting Framebuffer attachments");
-    }
+    ORK_LOG_DEBUG("RENDER", "Setting Framebuffer attachments");
     const int ATTACHMENTS[] = {
         GL_COLOR_ATTACHMENT0,
         GL_COLOR_ATTACHMENT1,
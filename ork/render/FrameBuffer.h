@@ -1306,7 +1306,7 @@ public:
      * @param primCount the number of times this mesh must be instanced.
      */
     template<class vertex, class index>
-    void draw(ptr<Program> p, const Mesh<vertex, index> &mesh, int primCount = 1);
+    void draw(const ptr<Program> &p, const Mesh<vertex, index> &mesh, int primCount = 1);
 
     /**
      * Draws a part of a mesh one or more times.
@@ -1322,7 +1322,7 @@ public:
      *      geometry instancing).
      * @param base the base vertex to use. Only used for meshes with indices.
      */
-    void draw(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, GLint first, GLsizei count, GLsizei primCount = 1, GLint base = 0);
+    void draw(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, GLint first, GLsizei count, GLsizei primCount = 1, GLint base = 0);
 
     /**
      * Draws several parts of a mesh. Each part is specified with a first
@@ -1339,7 +1339,7 @@ public:
      * @param primCount the number of parts of this mesh to draw.
      * @param bases the base vertices to use. Only used for meshes with indices.
      */
-    void multiDraw(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, GLint *firsts, GLsizei *counts, GLsizei primCount, GLint* bases = 0);
+    void multiDraw(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, GLint *firsts, GLsizei *counts, GLsizei primCount, GLint* bases = 0);
 
     /**
      * Draws a part of a mesh one or more times.
@@ -1351,7 +1351,7 @@ public:
      *      'first' and 'base' parameters, in this order, followed by '0',
      *      as 32 bit integers.
      */
-    void drawIndirect(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, const Buffer &buf);
+    void drawIndirect(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, const Buffer &buf);
 
     /**
      * Draws a mesh with a vertex count resulting from a transform feedback session.
@@ -1363,14 +1363,14 @@ public:
      * @param tfb a TransformFeedback containing the results of a transform feedback session.
      * @param stream the stream to draw.
      */
-    void drawFeedback(ptr<Program> p, const MeshBuffers &mesh, MeshMode m, const TransformFeedback &tfb, int stream = 0);
+    void drawFeedback(const ptr<Program> &p, const MeshBuffers &mesh, MeshMode m, const TransformFeedback &tfb, int stream = 0);
 
     /**
      * Draws a quad mesh. This mesh has a position attribute made of four
      * floats. xy coordinates vary between -1 and 1, while zw coordinates
      * vary between 0 and 1.
      */
-    void drawQuad(ptr<Program> p);
+    void drawQuad(const ptr<Program> &p);
 
     /**
      * Reads pixels from the attached color buffers into the given buffer.
@@ -1654,7 +1654,7 @@ private:
 };
 
 template<class vertex, class index>
-inline void FrameBuffer::draw(ptr<Program> p, const Mesh<vertex, index> &mesh, int primCount)
+inline void FrameBuffer::draw(const ptr<Program> &p, const Mesh<vertex, index> &mesh, int primCount)
 {
     assert(TransformFeedback::TRANSFORM == NULL);
     set();
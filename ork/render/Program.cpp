@@ -898,9 +898,7 @@ void Program::set()
             glBindProgramPipeline(pipelineId);
             glUseProgram(0);
         }
-		if (Logger::DEBUG_LOGGER != NULL) {
-			Logger::DEBUG_LOGGER->log("RENDER", "Set Program");
-		}
+        ORK_LOG_DEBUG("RENDER", "Set Program");
 
         if (pipelineId == 0) {
             bindTexturesAndUniformBlocks();
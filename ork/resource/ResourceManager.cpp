@@ -23,6 +23,8 @@
 
 #include "ork/resource/ResourceManager.h"
 
+#include "ork/core/Profiler.h"
+
 using namespace std;
 
 namespace ork
@@ -71,6 +73,7 @@ ptr<Object> ResourceManager::loadResource(const string &name)
         // and we return the resource
         return dynamic_cast<Object*>(r);
     }
+    ORK_PROFILE("ResourceManager::loadResource");
     if (Logger::INFO_LOGGER != NULL) {
         Logger::INFO_LOGGER->log("RESOURCE", "Loading resource '" + name + "'");
     }
@@ -133,6 +136,7 @@ ptr<Object> ResourceManager::loadResource(ptr<ResourceDescriptor> desc, const Ti
 
 bool ResourceManager::updateResources()
 {
+    ORK_PROFILE("ResourceManager::updateResources");
     if (Logger::INFO_LOGGER != NULL) {
         Logger::INFO_LOGGER->log("RESOURCE", "Updating resources");
     }
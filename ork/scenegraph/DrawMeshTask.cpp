@@ -32,6 +32,15 @@ using namespace std;
 namespace ork
 {
 
+/**
+ * Returns the name of the given object, if it is a Resource, for logging.
+ */
+static string getResourceName(Object *o)
+{
+    Resource *r = dynamic_cast<Resource*>(o);
+    return r == NULL ? "" : " '" + r->getName() + "'";
+}
+
 DrawMeshTask::DrawMeshTask() : AbstractTask("DrawMeshTask")
 {
 }
@@ -89,10 +98,7 @@ DrawMeshTask::Impl::~Impl()
 bool DrawMeshTask::Impl::run()
 {
     if (m != NULL) {
-        if (Logger::DEBUG_LOGGER != NULL) {
-            Resource *r = dynamic_cast<Resource*>(m.get());
-            Logger::DEBUG_LOGGER->log("SCENEGRAPH", r == NULL ? "DrawMesk" : "DrawMesh '" + r->getName() + "'");
-        }
+        ORK_LOG_DEBUG("SCENEGRAPH", "DrawMesh" << getResourceName(m.get()));
         ptr<Program> prog = SceneManager::getCurrentProgram();
         if (m->nindices == 0) {
             SceneManager::getCurrentFrameBuffer()->draw(prog, *m, m->mode, 0, m->nvertices);
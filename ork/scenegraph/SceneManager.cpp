@@ -23,6 +23,7 @@
 
 #include "ork/scenegraph/SceneManager.h"
 
+#include "ork/core/Profiler.h"
 #include "ork/render/FrameBuffer.h"
 
 using namespace std;
@@ -259,6 +260,7 @@ void SceneManager::getFrustumPlanes(const mat4d &toScreen, vec4d *frustumPlanes)
 
 void SceneManager::update(double t, double dt)
 {
+    ORK_PROFILE("SceneManager::update");
     this->t = t;
     this->dt = dt;
 
@@ -274,6 +276,8 @@ void SceneManager::update(double t, double dt)
 
 void SceneManager::draw()
 {
+    ORK_PROFILE("SceneManager::draw");
+    ORK_PROFILE_GPU("SceneManager::draw");
     if (camera != NULL) {
         ptr<Method> m = camera->getMethod(cameraMethod);
         if (m != NULL) {
@@ -257,7 +257,7 @@ unsigned int SceneNode::getChildrenCount()
     return (unsigned int) children.size();
 }
 
-ptr<SceneNode> SceneNode::getChild(unsigned int index)
+const ptr<SceneNode> &SceneNode::getChild(unsigned int index)
 {
     return children[index];
 }
@@ -337,8 +337,10 @@ public:
      * Returns the child node of this node whose index is given.
      *
      * @param index a child node index between 0 and #getChildrenCount - 1.
+     * @return the child node. The returned reference is only valid until the
+     *      children of this node are modified.
      */
-    ptr<SceneNode> getChild(unsigned int index);
+    const ptr<SceneNode> &getChild(unsigned int index);
 
     /**
      * Adds a child node to this node.
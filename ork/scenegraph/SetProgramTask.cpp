@@ -31,6 +31,15 @@ using namespace std;
 namespace ork
 {
 
+/**
+ * Returns the name of the given object, if it is a Resource, for logging.
+ */
+static string getResourceName(Object *o)
+{
+    Resource *r = dynamic_cast<Resource*>(o);
+    return r == NULL ? "" : " '" + r->getName() + "'";
+}
+
 SetProgramTask::SetProgramTask() : AbstractTask("SetProgramTask")
 {
 }
@@ -95,10 +104,7 @@ SetProgramTask::Impl::~Impl()
 bool SetProgramTask::Impl::run()
 {
     if (p != NULL) {
-        if (Logger::DEBUG_LOGGER != NULL) {
-            Resource *r = dynamic_cast<Resource*>(p.get());
-            Logger::DEBUG_LOGGER->log("SCENEGRAPH", r == NULL ? "SetProgram" : "SetProgram '" + r->getName() + "'");
-        }
+        ORK_LOG_DEBUG("SCENEGRAPH", "SetProgram" << getResourceName(p.get()));
         if (n != NULL) {
             SceneNode::ValueIterator i = n->getValues();
             while (i.hasNext()) {
@@ -1038,9 +1038,7 @@ SetStateTask::Impl::~Impl()
 
 bool SetStateTask::Impl::run()
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("SCENEGRAPH", "SetState");
-    }
+    ORK_LOG_DEBUG("SCENEGRAPH", "SetState");
     source->run();
     return true;
 }
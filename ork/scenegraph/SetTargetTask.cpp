@@ -126,55 +126,61 @@ SetTargetTask::Impl::~Impl()
 {
 }
 
-bool SetTargetTask::Impl::run()
+/**
+ * Returns a description of the given attachments, for logging.
+ */
+static string getTargetNames(const vector<SetTargetTask::Target> &targets, const vector< ptr<Texture> > &textures)
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        ostringstream os;
-        os << "SetTarget";
-        for (unsigned int i = 0; i < textures.size(); ++i) {
-            BufferId b = source->targets[i].buffer;
-            switch (b) {
-                case COLOR0:
-                    os << " COLOR0";
-                    break;
-                case COLOR1:
-                    os << " COLOR1";
-                    break;
-                case COLOR2:
-                    os << " COLOR2";
-                    break;
-                case COLOR3:
-                    os << " COLOR3";
-                    break;
-                case COLOR4:
-                    os << " COLOR4";
-                    break;
-                case COLOR5:
-                    os << " COLOR5";
-                    break;
-                case COLOR6:
-                    os << " COLOR6";
-                    break;
-                case COLOR7:
-                    os << " COLOR7";
-                    break;
-                case STENCIL:
-                    os << " STENCIL";
-                    break;
-                case DEPTH:
-                    os << " DEPTH";
-                    break;
-            }
-            Resource* r = dynamic_cast<Resource*>(textures[i].get());
-            if (r != NULL) {
-                os << " '" << r->getName() << "'";
-            }
+    ostringstream os;
+    os << "SetTarget";
+    for (unsigned int i = 0; i < textures.size(); ++i) {
+        BufferId b = targets[i].buffer;
+        switch (b) {
+            case COLOR0:
+                os << " COLOR0";
+                break;
+            case COLOR1:
+                os << " COLOR1";
+                break;
+            case COLOR2:
+                os << " COLOR2";
+                break;
+            case COLOR3:
+                os << " COLOR3";
+                break;
+            case COLOR4:
+                os << " COLOR4";
+                break;
+            case COLOR5:
+                os << " COLOR5";
+                break;
+            case COLOR6:
+                os << " COLOR6";
+                break;
+            case COLOR7:
+                os << " COLOR7";
+                break;
+            case STENCIL:
+                os << " STENCIL";
+                break;
+            case DEPTH:
+                os << " DEPTH";
+                break;
         }
-        if (textures.size() == 0) {
-            os << " default framebuffer";
+        Resource* r = dynamic_cast<Resource*>(textures[i].get());
+        if (r != NULL) {
+            os << " '" << r->getName() << "'";
         }
-        Logger::DEBUG_LOGGER->log("SCENEGRAPH", os.str());
     }
+    if (textures.size() == 0) {
+        os << " default framebuffer";
+    }
+    return os.str();
+}
+
+bool SetTargetTask::Impl::run()
+{
+    ORK_LOG_DEBUG("SCENEGRAPH", getTargetNames(source->targets, textures));
 
     ptr<FrameBuffer> fb = getTargetBuffer();
     if (textures.size() == 0) {
@@ -151,9 +151,7 @@ SetTransformsTask::Impl::~Impl()
 
 bool SetTransformsTask::Impl::run()
 {
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->log("SCENEGRAPH", "SetTransforms");
-    }
+    ORK_LOG_DEBUG("SCENEGRAPH", "SetTransforms");
 
     ptr<Program> prog = NULL;
     if (source->module != NULL && !source->module->getUsers().empty()) {
@@ -165,9 +163,7 @@ bool SetTransformsTask::Impl::run()
     if (prog == NULL) {
         return true;
     }
-    if (Logger::DEBUG_LOGGER != NULL) {
-        Logger::DEBUG_LOGGER->logf("SCENEGRAPH", "SetTransforms %d", prog.get());
-    }
+    ORK_LOG_DEBUG("SCENEGRAPH", "SetTransforms " << prog.get());
 
     if (prog != source->lastProg) {
         source->time = source->t == NULL ? NULL : prog->getUniform2f(source->t);
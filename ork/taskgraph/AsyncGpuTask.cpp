@@ -0,0 +1,73 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/taskgraph/AsyncGpuTask.h"
+
+#include "GL/glew.h"
+
+namespace ork
+{
+
+AsyncGpuTask::AsyncGpuTask(const char *type, unsigned int deadline) :
+    Task(type, true, deadline), fence(NULL)
+{
+}
+
+AsyncGpuTask::~AsyncGpuTask()
+{
+    if (fence != NULL) {
+        glDeleteSync((GLsync) fence);
+    }
+}
+
+bool AsyncGpuTask::run()
+{
+    bool changes = runCommands();
+    if (fence != NULL) {
+        glDeleteSync((GLsync) fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return changes;
+}
+
+bool AsyncGpuTask::checkCompletion(bool wait)
+{
+    if (fence == NULL) {
+        return true;
+    }
+    // the first check flushes the commands, otherwise the fence might never
+    // be signaled; the wait is split in 1 ms steps
+    GLenum status = glClientWaitSync((GLsync) fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000 : 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync((GLsync) fence, 0, 1000000);
+    }
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    // GL_WAIT_FAILED is considered as a completion, to avoid waiting forever
+    glDeleteSync((GLsync) fence);
+    fence = NULL;
+    return true;
+}
+
+}
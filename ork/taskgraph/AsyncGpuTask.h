@@ -0,0 +1,88 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_ASYNC_GPU_TASK_H_
+#define _ORK_ASYNC_GPU_TASK_H_
+
+#include "ork/taskgraph/Task.h"
+
+namespace ork
+{
+
+/**
+ * An abstract GPU task whose execution completes asynchronously, when the
+ * GPU has executed its commands. The #run method of this task issues these
+ * commands with #runCommands, followed by a fence. The scheduler then marks
+ * the task as completed, and executes its successors, only when this fence
+ * is signaled. Meanwhile it can execute other tasks, so that the work of the
+ * CPU and of the GPU overlap. This is useful for GPU tasks whose results are
+ * read by CPU tasks, such as buffer readbacks or transform feedback outputs.
+ *
+ * @ingroup taskgraph
+ */
+class ORK_API AsyncGpuTask : public Task
+{
+public:
+    /**
+     * Creates a new asynchronous GPU task.
+     *
+     * @param type the type of the task.
+     * @param deadline the frame number before which the task must be executed.
+     *      0 means that the task must be executed immediately.
+     */
+    AsyncGpuTask(const char *type, unsigned int deadline);
+
+    /**
+     * Deletes this task.
+     */
+    virtual ~AsyncGpuTask();
+
+    /**
+     * Issues the GPU commands of this task with #runCommands, followed by a
+     * fence.
+     */
+    virtual bool run();
+
+    /**
+     * Returns true if the fence issued by the last execution of this task is
+     * signaled.
+     */
+    virtual bool checkCompletion(bool wait);
+
+protected:
+    /**
+     * Issues the GPU commands of this task. See Task#run.
+     */
+    virtual bool runCommands() = 0;
+
+private:
+    /**
+     * The fence issued after the commands of this task, or NULL if it is
+     * signaled.
+     */
+    void *fence;
+};
+
+}
+
+#endif
@@ -26,9 +26,11 @@
 #include "pmath.h"
 #include <time.h>
 #include <fstream>
+#include <algorithm>
 
 #include "ork/core/Timer.h"
 #include "ork/core/Logger.h"
+#include "ork/core/Profiler.h"
 #include "ork/resource/ResourceTemplate.h"
 #include "ork/taskgraph/TaskGraph.h"
 
@@ -54,6 +56,12 @@ using namespace std;
 // in any case, on Linux, clock_gettime is used
 #define USE_FTIME
 
+// if defined, the timed waits use the monotonic clock, like Timer, so that
+// the frame deadlines are not affected by changes of the system time
+#if defined(__linux__)
+#define MONOTONIC_WAIT
+#endif
+
 // if defined, use busy waiting to get the desired framerate frameRate
 // (more precise than using Sleep and pthread_cond_timedwait)
 //#define BUSY_WAITING
@@ -84,11 +92,165 @@ static void getAbsoluteTime(timespec &ts)
     ts.tv_sec = (int) ((*(LONGLONG *) (&ft) - OFFSET) / 10000000);
     ts.tv_nsec = (int) ((*(LONGLONG *) (&ft) - OFFSET - ((LONGLONG) ts.tv_sec * (LONGLONG) 10000000)) * 100);
 #endif
+#elif defined(MONOTONIC_WAIT)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 #else
     clock_gettime(CLOCK_REALTIME, &ts);
 #endif
 }
 
+/**
+ * Returns the current time plus the given delay.
+ *
+ * @param delay a delay in micro seconds.
+ * @param[out] ts the returned time.
+ */
+static void getAbsoluteTime(double delay, timespec &ts)
+{
+    getAbsoluteTime(ts);
+    ts.tv_nsec += long(delay * 1000);
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec = ts.tv_nsec % 1000000000;
+    }
+}
+
+/**
+ * The maximum number of tasks that a thread takes at once from the injected
+ * tasks, in work stealing mode.
+ */
+static const int INJECTED_BATCH_SIZE = 16;
+
+/**
+ * The number of nodes per chunk in the flattened task graph of a
+ * MultithreadScheduler.
+ */
+static const int NODE_CHUNK_SIZE = 1024;
+
+/**
+ * The maximum number of chunks in the flattened task graph of a
+ * MultithreadScheduler.
+ */
+static const int MAX_NODE_CHUNKS = 1024;
+
+/**
+ * Parses a list of processors, in the format used by Linux in sysfs, such as
+ * "0-3,8,10-11".
+ *
+ * @param list a list of processors.
+ * @param[out] cpus the processors of this list.
+ * @return false if the list is malformed.
+ */
+static bool parseCpuList(const string &list, vector<int> &cpus)
+{
+    const char *p = list.c_str();
+    while (*p != '\0' && *p != '\n') {
+        char *q;
+        long first = strtol(p, &q, 10);
+        if (q == p || first < 0) {
+            return false;
+        }
+        long last = first;
+        if (*q == '-') {
+            p = q + 1;
+            last = strtol(p, &q, 10);
+            if (q == p || last < first) {
+                return false;
+            }
+        }
+        for (long i = first; i <= last; ++i) {
+            cpus.push_back(int(i));
+        }
+        p = q;
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0' && *p != '\n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the number of processors.
+ */
+static int getCpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return int(info.dwNumberOfProcessors);
+#else
+    return max(int(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+#endif
+}
+
+/**
+ * Returns an identifier of the processors that share their L3 cache with the
+ * given processor, or of its processor package if the cache topology is not
+ * available, or -1 if the topology is unknown.
+ */
+static int getCpuGroup(int cpu)
+{
+#ifdef __linux__
+    char path[256];
+    for (int index = 0; index < 8; ++index) {
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        ifstream level(path);
+        int l;
+        if (!(level >> l)) {
+            break;
+        }
+        if (l == 3) {
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+            ifstream shared(path);
+            string list;
+            vector<int> cpus;
+            if (getline(shared, list) && parseCpuList(list, cpus) && !cpus.empty()) {
+                // the first processor sharing this cache identifies it
+                return cpus[0];
+            }
+        }
+    }
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    ifstream package(path);
+    int id;
+    if (package >> id) {
+        return id;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * Pins a thread to the given processors.
+ *
+ * @return true if the affinity of the thread could be set.
+ */
+static bool setAffinity(pthread_t thread, const vector<int> &cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (unsigned int i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < int(8 * sizeof(DWORD_PTR))) {
+            mask |= DWORD_PTR(1) << cpus[i];
+        }
+    }
+    return SetThreadAffinityMask(pthread_getw32threadhandle_np(thread), mask) != 0;
+#else
+    return false;
+#endif
+}
+
 namespace ork
 {
 
@@ -107,6 +269,9 @@ bool MultithreadScheduler::taskKeySort::operator()(const taskKey &x, const taskK
 
 bool MultithreadScheduler::taskSort::operator()(const ptr<Task> x, const ptr<Task> y) const
 {
+    if (x->rank != y->rank) {
+        return x->rank > y->rank;
+    }
     int xDuration = int(x->getExpectedDuration());
     int yDuration = int(y->getExpectedDuration());
     if (xDuration == yDuration) {
@@ -116,26 +281,210 @@ bool MultithreadScheduler::taskSort::operator()(const ptr<Task> x, const ptr<Tas
     }
 }
 
-MultithreadScheduler::MultithreadScheduler(int prefetchRate, int prefetchQueue, float frameRate, int nThreads) :
+bool MultithreadScheduler::readyTaskSort::operator()(const ptr<Task> x, const ptr<Task> y) const
+{
+    taskKey xKey = make_pair(x->getDeadline(), x->getContext());
+    taskKey yKey = make_pair(y->getDeadline(), y->getContext());
+    if (xKey == yKey) {
+        return taskSort()(x, y);
+    } else {
+        return taskKeySort()(xKey, yKey);
+    }
+}
+
+/**
+ * Returns true if the given ready task can only be executed by the main thread.
+ */
+static bool isMainThreadTask(ptr<Task> t)
+{
+#ifdef STRICT_PREFETCH
+    return t->isGpuTask() || t->getDeadline() == 0;
+#else
+    return t->isGpuTask();
+#endif
+}
+
+/**
+ * The argument of the additional threads of a MultithreadScheduler.
+ */
+struct SchedulerThreadArg
+{
+    MultithreadScheduler *scheduler;
+
+    int thread;
+};
+
+/**
+ * A primitive task that remains to be executed, with its dependencies.
+ */
+struct MultithreadScheduler::TaskNode
+{
+    /**
+     * The task of this node, or NULL if this node is unused.
+     */
+    ptr<Task> task;
+
+    /**
+     * Flag of #pending set while the task is in a set or queue of ready
+     * tasks.
+     */
+    static const long QUEUED = 1L << 28;
+
+    /**
+     * Flag of #pending set when the task has been selected for execution.
+     * The task cannot get new predecessors after this flag is set.
+     */
+    static const long RUNNING = 1L << 29;
+
+    /**
+     * The number of predecessors of this task that are not completed yet,
+     * plus one while this node is held by MultithreadScheduler#schedule,
+     * plus the #QUEUED and #RUNNING flags. The task is ready to be executed
+     * when this count becomes 0.
+     */
+    volatile long pending;
+
+    /**
+     * A spin lock protecting #done and #successors.
+     */
+    volatile long lock;
+
+    /**
+     * True if the task of this node has been executed. No successors can be
+     * added to a node after this flag is set.
+     */
+    bool done;
+
+    /**
+     * The number of times this node has been deleted and reused. This is used
+     * to detect obsolete references in #predecessors.
+     */
+    int generation;
+
+    /**
+     * The indices of the nodes of the successors of this task.
+     */
+    vector<int> successors;
+
+    /**
+     * The indices and generations of the nodes of the predecessors of this
+     * task. Only used to propagate deadlines, with the scheduler mutex locked.
+     */
+    vector< pair<int, int> > predecessors;
+
+    /**
+     * The index of this task in ScheduleRecord#tasks, or -1 if it is not
+     * recorded (see MultithreadScheduler#startRecording).
+     */
+    int record;
+
+    TaskNode() : pending(0), lock(0), done(false), generation(0), record(-1)
+    {
+    }
+
+    /**
+     * Adds a pending predecessor to this node, unless its task is being
+     * executed. If the task is already ready, in work stealing mode, its
+     * entry in the ready tasks becomes obsolete (see #claim).
+     *
+     * @return false if the task is being executed.
+     */
+    bool hold()
+    {
+        long s = ork_atomic_load(&pending);
+        while ((s & RUNNING) == 0) {
+            if (atomic_compare_and_swap(&pending, s, s + 1)) {
+                return true;
+            }
+            s = ork_atomic_load(&pending);
+        }
+        return false;
+    }
+
+    /**
+     * Removes a pending predecessor from this node.
+     *
+     * @return true if the task is now ready to be executed, and is not
+     *      already in the ready tasks. The #QUEUED flag is then set, and the
+     *      caller must add the task to the ready tasks.
+     */
+    bool release()
+    {
+        // if the count was 1 without any flag, the task became ready; but it
+        // can get a new predecessor before we set the flag, it is then
+        // published by the #release that removes this predecessor
+        if (atomic_decrement(&pending) == 1) {
+            return atomic_compare_and_swap(&pending, 0L, QUEUED);
+        }
+        return false;
+    }
+
+    /**
+     * Selects the task of this node for execution, after it has been removed
+     * from the ready tasks.
+     *
+     * @return false if the task got new predecessors since it was added to
+     *      the ready tasks. The task must then be skipped: it will be added
+     *      again to the ready tasks when its predecessors are completed.
+     */
+    bool claim()
+    {
+        while (true) {
+            long s = ork_atomic_load(&pending);
+            assert((s & QUEUED) != 0);
+            if (s == QUEUED) {
+                if (atomic_compare_and_swap(&pending, s, RUNNING)) {
+                    return true;
+                }
+            } else if (atomic_compare_and_swap(&pending, s, s & ~QUEUED)) {
+                return false;
+            }
+        }
+    }
+
+    void lockNode()
+    {
+        while (!atomic_compare_and_swap(&lock, 0L, 1L)) {
+            cpu_relax();
+        }
+    }
+
+    void unlockNode()
+    {
+        ork_atomic_store(&lock, 0L);
+    }
+};
+
+MultithreadScheduler::MultithreadScheduler(int prefetchRate, int prefetchQueue, float frameRate, int nThreads, executionMode mode, priorityMode priority) :
         Scheduler("MultithreadScheduler")
 {
-    init(prefetchRate, prefetchQueue, frameRate, nThreads);
+    init(prefetchRate, prefetchQueue, frameRate, nThreads, mode, priority);
 }
 
-void MultithreadScheduler::init(int prefetchRate, int prefetchQueue, float frameRate, int nThreads)
+void MultithreadScheduler::init(int prefetchRate, int prefetchQueue, float frameRate, int nThreads, executionMode mode, priorityMode priority)
 {
     mutex = new pthread_mutex_t;
     allTasksCond = new pthread_cond_t;
     cpuTasksCond = new pthread_cond_t;
+    parallelDoneCond = new pthread_cond_t;
     pthread_mutexattr_t attrs;
     pthread_mutexattr_init(&attrs);
     pthread_mutexattr_settype(&attrs, PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init((pthread_mutex_t*) mutex, &attrs);
     pthread_mutexattr_destroy(&attrs);
-    pthread_cond_init((pthread_cond_t*) allTasksCond, NULL);
-    pthread_cond_init((pthread_cond_t*) cpuTasksCond, NULL);
+    pthread_condattr_t condAttrs;
+    pthread_condattr_init(&condAttrs);
+#ifdef MONOTONIC_WAIT
+    pthread_condattr_setclock(&condAttrs, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init((pthread_cond_t*) allTasksCond, &condAttrs);
+    pthread_cond_init((pthread_cond_t*) cpuTasksCond, &condAttrs);
+    pthread_cond_init((pthread_cond_t*) parallelDoneCond, &condAttrs);
+    pthread_condattr_destroy(&condAttrs);
     this->prefetchRate = prefetchRate;
     this->prefetchQueueSize = prefetchQueue;
+    prefetchBudget = 0;
+    prefetchCost = 0;
     framePeriod = frameRate == 0.0f ? 0.0f : 1e6f / frameRate;
     if (prefetchRate > 0 || frameRate > 0.0f) {
         assert(prefetchQueueSize > 0);
@@ -143,14 +492,63 @@ void MultithreadScheduler::init(int prefetchRate, int prefetchQueue, float frame
     lastFrame = 0;
     time = 2;
     stop = false;
-    for (int i = 0; i < nThreads; ++i) {
-        pthread_t *thread = new pthread_t;
-        pthread_create(thread, NULL, schedulerThread, this);
-        threads.push_back(thread);
+    // work stealing is useless without additional threads
+    this->mode = nThreads > 0 ? mode : GLOBAL_QUEUE;
+    this->priority = priority;
+    laneMutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) laneMutex, NULL);
+    sleepingThreads = 0;
+    mainThreadSleeping = 0;
+    immediateCount = 0;
+    nodes = new TaskNode*[MAX_NODE_CHUNKS];
+    for (int i = 0; i < MAX_NODE_CHUNKS; ++i) {
+        nodes[i] = NULL;
+    }
+    nodeCount = 0;
+    if (this->mode == WORK_STEALING) {
+        for (int i = 0; i <= nThreads; ++i) {
+            queues.push_back(new WorkStealingQueue<Task*>());
+            prefetchQueues.push_back(new WorkStealingQueue<Task*>());
+        }
     }
     bufferedStatistics = NULL;
     bufferedFrames = 0;
     statisticsFile = NULL;
+    tracing = 0;
+    traceFile = NULL;
+    parallelCount = 0;
+    traceStart = 0.0;
+    recording = 0;
+    recordStart = 0.0;
+    cpuTasksVersion = 0;
+    spinTime = 0.0f;
+    durationPercentile = 0.0f;
+    spinTimes.assign(nThreads + 1, 0.0f);
+    // by default each thread steals from the next ones, in round robin order
+    victims.resize((nThreads + 1) * nThreads);
+    for (int i = 0; i <= nThreads; ++i) {
+        for (int j = 0; j < nThreads; ++j) {
+            victims[i * nThreads + j] = (i + j + 1) % (nThreads + 1);
+        }
+    }
+    measureUtilization = 0;
+    busyTimes = new BusyTime[nThreads + 1];
+    for (int i = 0; i <= nThreads; ++i) {
+        busyTimes[i].time = 0.0;
+        busyTimes[i].lock = 0;
+    }
+    lastBusyTimes.assign(nThreads + 1, 0.0);
+    Timer timer;
+    lastUtilization = timer.start();
+    // the threads must be created last, since they use the above fields
+    for (int i = 0; i < nThreads; ++i) {
+        SchedulerThreadArg *arg = new SchedulerThreadArg();
+        arg->scheduler = this;
+        arg->thread = i + 1;
+        pthread_t *thread = new pthread_t;
+        pthread_create(thread, NULL, schedulerThread, arg);
+        threads.push_back(thread);
+    }
 }
 
 MultithreadScheduler::~MultithreadScheduler()
@@ -172,20 +570,56 @@ MultithreadScheduler::~MultithreadScheduler()
     delete (pthread_mutex_t*) mutex;
     pthread_cond_destroy((pthread_cond_t*) cpuTasksCond);
     delete (pthread_cond_t*) cpuTasksCond;
+    pthread_cond_destroy((pthread_cond_t*) parallelDoneCond);
+    delete (pthread_cond_t*) parallelDoneCond;
     pthread_cond_destroy((pthread_cond_t*) allTasksCond);
     delete (pthread_cond_t*) allTasksCond;
+    pthread_mutex_destroy((pthread_mutex_t*) laneMutex);
+    delete (pthread_mutex_t*) laneMutex;
     threads.clear();
+    for (unsigned int i = 0; i < queues.size(); ++i) {
+        delete queues[i];
+        delete prefetchQueues[i];
+    }
+    queues.clear();
+    prefetchQueues.clear();
+    delete[] busyTimes;
+    for (int i = 0; i < MAX_NODE_CHUNKS && nodes[i] != NULL; ++i) {
+        for (int j = 0; j < NODE_CHUNK_SIZE; ++j) {
+            if (nodes[i][j].task != NULL) {
+                ParallelForTask *p = dynamic_cast<ParallelForTask*>(nodes[i][j].task.get());
+                if (p != NULL) {
+                    p->scheduler = NULL;
+                }
+                nodes[i][j].task->schedulerIndex = -1;
+            }
+        }
+        delete[] nodes[i];
+    }
+    delete[] nodes;
     if (bufferedFrames > 0) {
         clearBufferedFrames();
     }
     if (statisticsFile != NULL) {
         fclose(statisticsFile);
     }
+    if (traceFile != NULL) {
+        stopTrace();
+    }
+    for (unsigned int i = 0; i < traceBuffers.size(); ++i) {
+        delete traceBuffers[i];
+    }
 }
 
 bool MultithreadScheduler::supportsPrefetch(bool gpuTasks)
 {
     if (prefetchRate > 0 || framePeriod > 0.0f || (threads.size() > 0 && !gpuTasks)) {
+        if (ork_atomic_load(&prefetchBudget) > 0) {
+            pthread_mutex_lock((pthread_mutex_t*) mutex);
+            bool result = prefetchCost < prefetchBudget && deferredTasks.empty();
+            pthread_mutex_unlock((pthread_mutex_t*) mutex);
+            return result;
+        }
         if (gpuTasks || threads.empty()) {
             return prefetchQueue.size() < prefetchQueueSize;
         }
@@ -195,21 +629,117 @@ bool MultithreadScheduler::supportsPrefetch(bool gpuTasks)
 }
 
 void MultithreadScheduler::schedule(ptr<Task> task)
+{
+    if (ork_atomic_load(&prefetchBudget) == 0 || admitTask(task)) {
+        scheduleTask(task);
+    }
+}
+
+void MultithreadScheduler::scheduleBatch(const vector< ptr<Task> > &tasks)
+{
+    vector< ptr<Task> > admitted;
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+        if (ork_atomic_load(&prefetchBudget) == 0 || admitTask(tasks[i])) {
+            admitted.push_back(tasks[i]);
+        }
+    }
+    if (!admitted.empty()) {
+        scheduleTasks(admitted);
+    }
+}
+
+void MultithreadScheduler::scheduleTasks(const vector< ptr<Task> > &tasks)
+{
+    // the tasks shared by several graphs are initialized and added only once
+    set<Task*> initialized;
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+        tasks[i]->init(initialized);
+    }
+    set<Task*> added;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+        addTask(tasks[i], &added);
+    }
+    releaseHeldNodes();
+}
+
+void MultithreadScheduler::scheduleTask(ptr<Task> task)
 {
     set<Task*> initialized;
     task->init(initialized);
     pthread_mutex_lock((pthread_mutex_t*) mutex);
-    bool noCpuTasks = readyCpuTasks.empty();
-    set< ptr<Task> > addedTasks;
-    addFlattenedTask(task, addedTasks);
-    pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
-    if (noCpuTasks && !readyCpuTasks.empty()) {
-        // if there was no ready CPU tasks before this method was called,
-        // and there are now some ready CPU tasks, signals this to the execution
-        // threads that may be waiting for tasks to execute.
-        pthread_cond_broadcast((pthread_cond_t*) cpuTasksCond);
+    addTask(task, NULL);
+    releaseHeldNodes();
+}
+
+void MultithreadScheduler::addTask(ptr<Task> task, set<Task*> *added)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    ptr<TaskGraph> tg = task.cast<TaskGraph>();
+    if (tg == NULL) {
+        if (!task->isDone() && (added == NULL || added->insert(task.get()).second)) {
+            addFlattenedTask(task);
+        }
+    } else if (!tg->isDone()) {
+        // the flattened form of a task graph is only recomputed when its
+        // structure has changed; otherwise scheduling the graph only requires
+        // to create or update the nodes of its primitive tasks
+        TaskGraph::FlattenedGraph *g = getFlattenedGraph(tg);
+        vector<bool> newTasks(priority == CRITICAL_PATH ? g->tasks.size() : 0, false);
+        for (unsigned int i = 0; i < g->tasks.size(); ++i) {
+            ptr<Task> t = g->tasks[i];
+            if (!t->isDone() && (added == NULL || added->insert(t.get()).second)) {
+                bool created = addFlattenedTask(t);
+                if (priority == CRITICAL_PATH) {
+                    newTasks[i] = created;
+                }
+            }
+        }
+        if (priority == CRITICAL_PATH) {
+            // the new tasks cannot be ready before their nodes are released
+            // below, so they are not in any sorted set yet
+            computeRanks(*g, newTasks);
+        }
+        for (unsigned int i = 0; i < g->dependencies.size(); ++i) {
+            ptr<Task> src = g->tasks[g->dependencies[i].first];
+            ptr<Task> dst = g->tasks[g->dependencies[i].second];
+            if (!dst->isDone()) {
+                addFlattenedDependency(src, dst);
+            }
+        }
     }
-    assert(allReadyTasks.size() > 0);
+}
+
+void MultithreadScheduler::releaseHeldNodes()
+{
+    // the nodes of the new tasks, and of the pending tasks that got new
+    // predecessors, are held (see #addFlattenedTask), so that they cannot
+    // become ready before all their dependencies have been added; we can
+    // now release them, and find which ones are ready to be executed
+    vector< ptr<Task> > readyTasks;
+    int cpuTasks = 0;
+    for (unsigned int i = 0; i < heldNodes.size(); ++i) {
+        TaskNode *n = getNode(heldNodes[i]);
+        if (n->release()) {
+            if (mode == WORK_STEALING) {
+                readyTasks.push_back(n->task);
+            } else if (insertReadyTask(n->task)) {
+                ++cpuTasks;
+            }
+        }
+    }
+    heldNodes.clear();
+    if (mode == WORK_STEALING) {
+        // the ready tasks are added to the main thread tasks and to the
+        // injected tasks, where all threads can find them
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        pushReadyTasks(readyTasks, -1);
+        return;
+    }
+    pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
+    // if there are new ready CPU tasks, signals this to the execution
+    // threads that may be waiting for tasks to execute.
+    signalCpuThreads(cpuTasks);
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
 
@@ -224,29 +754,186 @@ void MultithreadScheduler::reschedule(ptr<Task> task, Task::reason r, unsigned i
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
 
+bool MultithreadScheduler::admitTask(ptr<Task> task)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    bool immediate = false;
+    int cost = getMemoryCost(task, immediate);
+    // the tasks for the current frame are always admitted; the other tasks
+    // are admitted in the order in which they were scheduled, while the
+    // budget is not exhausted (a task whose cost exceeds the whole budget is
+    // admitted alone in a frame, so that it is not deferred forever)
+    bool admitted = immediate || cost == 0 || prefetchBudget == 0;
+    if (!admitted && deferredTasks.empty()) {
+        admitted = prefetchCost == 0 || prefetchCost + cost <= prefetchBudget;
+    }
+    if (admitted) {
+        prefetchCost += cost;
+    } else {
+        deferredTasks.push_back(task);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return admitted;
+}
+
+int MultithreadScheduler::getMemoryCost(ptr<Task> task, bool &immediate)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    int cost = 0;
+    ptr<TaskGraph> tg = task.cast<TaskGraph>();
+    if (tg == NULL) {
+        if (!task->isDone()) {
+            immediate = task->getDeadline() == 0;
+            cost = task->getMemoryCost();
+        }
+    } else if (!tg->isDone()) {
+        TaskGraph::FlattenedGraph *g = getFlattenedGraph(tg);
+        for (unsigned int i = 0; i < g->tasks.size(); ++i) {
+            Task *t = g->tasks[i].get();
+            if (!t->isDone()) {
+                immediate = immediate || t->getDeadline() == 0;
+                cost += t->getMemoryCost();
+            }
+        }
+    }
+    return cost;
+}
+
+void MultithreadScheduler::setPrefetchBudget(int budget)
+{
+    vector< ptr<Task> > admitted;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    ork_atomic_store(&prefetchBudget, budget);
+    if (budget == 0) {
+        // without budget the deferred tasks would never be admitted
+        admitted.swap(deferredTasks);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    if (!admitted.empty()) {
+        scheduleTasks(admitted);
+    }
+}
+
+bool MultithreadScheduler::setThreadAffinity(const vector<int> &cpus, int mainCpu)
+{
+    bool pinned = true;
+    int n = int(threads.size());
+    vector<int> groups(n + 1, -1);
+    if (mainCpu >= 0) {
+        pinned = setAffinity(pthread_self(), vector<int>(1, mainCpu));
+        groups[0] = getCpuGroup(mainCpu);
+    }
+    vector<int> otherCpus;
+    if (cpus.empty()) {
+        for (int i = 0; i < getCpuCount(); ++i) {
+            if (i != mainCpu) {
+                otherCpus.push_back(i);
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        pthread_t thread = *((pthread_t*) threads[i]);
+        if (!cpus.empty()) {
+            int cpu = cpus[i % cpus.size()];
+            pinned = setAffinity(thread, vector<int>(1, cpu)) && pinned;
+            groups[i + 1] = getCpuGroup(cpu);
+        } else if (!otherCpus.empty()) {
+            pinned = setAffinity(thread, otherCpus) && pinned;
+        }
+    }
+    // each thread steals from the threads of its group first, and then from
+    // the others, in round robin order in both cases
+    for (int i = 0; i <= n; ++i) {
+        int k = i * n;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int j = 1; j <= n; ++j) {
+                int v = (i + j) % (n + 1);
+                bool close = groups[i] >= 0 && groups[v] == groups[i];
+                if (close == (pass == 0)) {
+                    victims[k++] = v;
+                }
+            }
+        }
+    }
+    if (!pinned && Logger::WARNING_LOGGER != NULL) {
+        Logger::WARNING_LOGGER->log("SCHEDULER", "Cannot set the affinity of the scheduler threads");
+    }
+    return pinned;
+}
+
+void MultithreadScheduler::getThreadUtilization(vector<float> &utilization)
+{
+    Timer timer;
+    double now = timer.start();
+    ork_atomic_store(&measureUtilization, 1L);
+    utilization.resize(lastBusyTimes.size());
+    for (unsigned int i = 0; i < lastBusyTimes.size(); ++i) {
+        BusyTime &b = busyTimes[i];
+        while (!atomic_compare_and_swap(&b.lock, 0L, 1L)) {
+            cpu_relax();
+        }
+        double busy = b.time;
+        ork_atomic_store(&b.lock, 0L);
+        double u = now > lastUtilization ? (busy - lastBusyTimes[i]) / (now - lastUtilization) : 0.0;
+        utilization[i] = float(max(0.0, min(u, 1.0)));
+        lastBusyTimes[i] = busy;
+    }
+    lastUtilization = now;
+}
+
 void MultithreadScheduler::run(ptr<Task> task)
 {
     Timer timer;
-    timer.start();
+    double scheduleStart = timer.start();
+    if (ork_atomic_load(&recording) != 0) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        record.frames.push_back((float) (scheduleStart - recordStart));
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    }
+    // the expected durations of the new tasks use the execution times of
+    // the tasks of the previous frames
+    Task::updateExpectedDurations();
+    // a new frame starts, with a new budget for the prefetching tasks,
+    // which we first use for the tasks deferred at the previous frames
+    // (all of them if there is no budget anymore)
+    vector< ptr<Task> > admitted;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    prefetchCost = 0;
+    unsigned int n = 0;
+    while (n < deferredTasks.size()) {
+        bool immediate = false;
+        ptr<Task> t = deferredTasks[n];
+        int cost = getMemoryCost(t, immediate);
+        if (prefetchBudget > 0 && prefetchCost > 0 && prefetchCost + cost > prefetchBudget) {
+            break;
+        }
+        prefetchCost += cost;
+        admitted.push_back(t);
+        ++n;
+    }
+    deferredTasks.erase(deferredTasks.begin(), deferredTasks.begin() + n);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    if (!admitted.empty()) {
+        scheduleTasks(admitted);
+    }
     schedule(task);
     double schedule = timer.end();
-
-    if (Logger::DEBUG_LOGGER != NULL) {
-        ostringstream oss;
-        oss << "START tasks: " << immediateTasks.size() << " immediate, ";
-        oss << allReadyTasks.size() << " ready, ";
-        oss << readyCpuTasks.size() << " ready cpu; ";
-        oss << dependencies.size() << " + " << inverseDependencies.size() << " dependencies";
-        Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
+    bool tracing = ork_atomic_load(&this->tracing) != 0;
+    if (tracing) {
+        trace(0, TraceEvent::SCHEDULE, NULL, scheduleStart, scheduleStart + schedule);
     }
 
+    ORK_LOG_DEBUG("SCHEDULER", "START tasks: " << immediateTasks.size() << " immediate, "
+        << allReadyTasks.size() << " ready, "
+        << readyCpuTasks.size() << " ready cpu; "
+        << nodeCount - freeNodes.size() << " pending");
+
     int run = 0; // number of executed tasks
     int prefetched = 0; // number of prefetching tasks executed
     int contextSwitches = 0; // number of context switches performed
     ptr<Task> previousGpuTask = NULL; // last GPU task executed
 
     double deadline = 0.0; // deadline for the end of this method
-    timespec deadlinespec; // same, in timespec format
 
     if (monitoredTasks.size() > 0) {
         frameStatistics.clear();
@@ -263,105 +950,47 @@ void MultithreadScheduler::run(ptr<Task> task)
         // of this method; this is the time at the end of the last call to this
         // method, plus the delay for one frame (minus a small margin)
         deadline = lastFrame + framePeriod - 1000.0;
-        // subtrating the current time gives the time interval for this methd
-        double delay = deadline - timer.start();
-        // we use it to compute the deadline in timespec format
-        getAbsoluteTime(deadlinespec);
-        deadlinespec.tv_nsec += int(delay * 1000);
-        if (deadlinespec.tv_nsec > 1000000000) {
-            deadlinespec.tv_sec += deadlinespec.tv_nsec / 1000000000;
-            deadlinespec.tv_nsec = deadlinespec.tv_nsec % 1000000000;
-        }
     }
 
     // we loop to execute all required tasks
     while (true) {
+        // the GPU tasks whose work is completed can now release their
+        // successors
+        if (!asyncTasks.empty()) {
+            completeAsyncTasks(false);
+        }
+
         // first step: find or wait for a task ready to be executed
-        ptr<Task> t = NULL;
-        pthread_mutex_lock((pthread_mutex_t*) mutex);
-        if (immediateTasks.empty() && framePeriod > 0.0) {
-            // if the tasks for the current frame are completed, and if we have
-            // a fixed framerate, we can use the time until the deadline to
-            // execute some tasks for next few frames
-#ifdef BUSY_WAITING
-            while (allReadyTasks.empty() && timer.start() < deadline) {
-                // so we wait for a ready CPU or GPU task,
-                // and stop when the deadline is passed
-                pthread_mutex_unlock((pthread_mutex_t*) mutex);
-                double timeout = min(deadline, timer.start() + 500.0);
-                while (timer.start() < timeout) {
-                }
-                pthread_mutex_lock((pthread_mutex_t*) mutex);
-            }
-#else
-            while (allReadyTasks.empty() && timer.start() < deadline) {
-                // so we wait for a ready CPU or GPU task,
-                // and stop when the deadline is passed
-                pthread_cond_timedwait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex, &deadlinespec);
-            }
-#endif
+        void *previousContext = previousGpuTask == NULL ? NULL : previousGpuTask->getContext();
+        ptr<Task> t;
+        if (mode == WORK_STEALING) {
+            t = nextTaskWorkStealing(timer, deadline, prefetched, previousContext);
         } else {
-            // here either some tasks for the current frame are not completed
-            // or they are all completed but we do not have a fixed framerate
-            while (!immediateTasks.empty() && (allReadyTasks.empty() || allReadyTasks.begin()->first.first > 0)) {
-                // while some tasks for the current frame remain to be executed,
-                // and while the set of tasks ready to be executed is empty or
-                // contains only tasks for the next frames (deadline > 0), wait
-                pthread_cond_wait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex);
-            }
+            t = nextTask(timer, deadline, prefetched, previousContext);
         }
-        // if the deadline is passed or if all the tasks for the current frame
-        // are completed, there may not be any task ready to be executed
-        if (!allReadyTasks.empty()) {
-            // but if there is at least one we pick one, if possible with the
-            // same execution context as the last executed GPU task
-            t = getTask(allReadyTasks, previousGpuTask == NULL ? NULL : previousGpuTask->getContext());
-            if (t->getDeadline() != 0) {
-                // if this task is for the next frames, then all tasks for the
-                // current frame should now be completed (tasks are sorted in
-                // such a way that tasks for the current frame are executed first)
-                assert(immediateTasks.empty());
-                // if we do not have executed the required minimum number of
-                // prefetching tasks per frame, we execute this available
-                // prefetching task
-                if (prefetched >= prefetchRate) {
-                    // if we do not have a fixed framerate, or if the time remaining
-                    // until the deadline is less than the expected duration for this
-                    // task, we should stop here; setting t to NULL will force this
-                    if (framePeriod == 0.0 || timer.start() + t->getExpectedDuration() > deadline) {
-                        t = NULL;
-                    }
-                }
-            }
-            if (t != NULL) {
-                // if we finally have a task to execute, we remove it from the
-                // sets that may contain it (but we do not update the
-                // dependencies yet, this will be done after the task execution
-                // in #taskDone
-                immediateTasks.erase(t);
-                removeTask(allReadyTasks, t);
-                removeTask(readyCpuTasks, t);
-            }
-        }
-        // we can now release the mutex since we will not read or modify the
-        // shared data structures until #taskDone is called; also the selected
-        // task t cannot be seleted by another thread, since it has been removed
-        // from the task sets.
-        pthread_mutex_unlock((pthread_mutex_t*) mutex);
 
         if (t == NULL) {
+            if (!asyncTasks.empty()) {
+                // there is no task to execute until some GPU work completes
+                // (the above methods do not wait if GPU tasks are pending)
+                completeAsyncTasks(true);
+                continue;
+            }
             // stops the infinite execution loop
             break;
         }
 
+        if (mode == WORK_STEALING && !getNode(t->schedulerIndex)->claim()) {
+            // t got new predecessors after it was added to the ready tasks
+            continue;
+        }
+
         bool changes = false;
+        bool async = false;
 
-        if (!t->isDone()) {
-            if (Logger::DEBUG_LOGGER != NULL) {
-                ostringstream oss;
-                oss << (t->getDeadline() > 0 ? "PREFETCH " : "RUN ") << t->getClass();
-                Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
-            }
+        // cancelled tasks are dropped without being executed (see #taskDone)
+        if (!t->isDone() && !t->isCancelled()) {
+            ORK_LOG_DEBUG("SCHEDULER", (t->getDeadline() > 0 ? "PREFETCH " : "RUN ") << t->getClass());
             if (t->isGpuTask()) {
                 // if t is a GPU task, sets the execution context ...
                 if (previousGpuTask == NULL) {
@@ -370,6 +999,10 @@ void MultithreadScheduler::run(ptr<Task> task)
                 } else if (previousGpuTask->getContext() != t->getContext()) {
                     // ... or if it is not the same as the one of the last GPU task
                     ++contextSwitches;
+                    if (tracing) {
+                        double now = timer.start();
+                        trace(0, TraceEvent::CONTEXT_SWITCH, NULL, now, now);
+                    }
                     previousGpuTask->end();
                     t->begin();
                 }
@@ -379,14 +1012,21 @@ void MultithreadScheduler::run(ptr<Task> task)
 
             if (t->getCompletionDate() >= t->getPredecessorsCompletionDate()) {
                 // t is up to date, it is not necessary to run it
-            } else if (framePeriod > 0.0 || monitoredTasks.size() > 0) {
+            } else if (framePeriod > 0.0 || monitoredTasks.size() > 0 || tracing || ork_atomic_load(&measureUtilization) != 0 || ork_atomic_load(&recording) != 0) {
                 // if we have a fixed framerate we measure the execution time
                 // of each task in order to get statistics about tasks, used to
                 // get estimated durations for future tasks
-                timer.start();
-                changes = t->run();
-                double duration = timer.end();
+                double start = Timer::getTaskTime();
+                changes = runTask(t);
+                double duration = Timer::getTaskTime() - start;
                 t->setActualDuration((float) duration);
+                addBusyTime(0, duration);
+                if (tracing) {
+                    trace(0, TraceEvent::TASK, t, start, start + duration);
+                }
+                if (ork_atomic_load(&recording) != 0) {
+                    recordTask(t, 0, start, duration);
+                }
                 if (monitoredTasks.size() > 0) {
                     map< string, pair<int, float> >::iterator i = frameStatistics.find(t->getClass());
                     if (i != frameStatistics.end()) {
@@ -398,17 +1038,29 @@ void MultithreadScheduler::run(ptr<Task> task)
                 }
             } else {
                 // otherwise we execute tasks without computing statistics
-                changes = t->run();
+                changes = runTask(t);
             }
 
             ++run;
             if (t->getDeadline() > 0) {
                 ++prefetched;
             }
+            async = t->isGpuTask() && !t->checkCompletion(false);
+        }
+        ptr<ResumableTask> r = t.cast<ResumableTask>();
+        if (r != NULL && r->awaited != NULL) {
+            // t is not completed, it will be executed again when the task
+            // it awaits is completed
+            suspendTask(r, 0);
+        } else if (async) {
+            // the GPU has not completed the work of t yet, t will be
+            // completed later, in #completeAsyncTasks
+            asyncTasks.push_back(make_pair(t, changes));
+        } else {
+            // this updates the task dependencies, and signals other threads
+            // when new tasks become ready to be executed
+            taskDone(t, changes, 0);
         }
-        // this updates the task dependencies, and signals other threads when
-        // new tasks become ready to be executed
-        taskDone(t, changes);
     }
 
     if (previousGpuTask != NULL) {
@@ -417,11 +1069,7 @@ void MultithreadScheduler::run(ptr<Task> task)
         previousGpuTask = NULL;
     }
 
-    if (Logger::DEBUG_LOGGER != NULL) {
-        ostringstream oss;
-        oss << "END " << run << " run tasks " << contextSwitches << " context switches";
-        Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
-    }
+    ORK_LOG_DEBUG("SCHEDULER", "END " << run << " run tasks " << contextSwitches << " context switches");
 
     if (Logger::DEBUG_LOGGER != NULL && framePeriod > 0.0) {
         Task::logStatistics();
@@ -443,6 +1091,9 @@ void MultithreadScheduler::run(ptr<Task> task)
 #else
             usleep(deadline - t);
 #endif
+            if (tracing) {
+                trace(0, TraceEvent::WAIT, NULL, t, timer.start());
+            }
         }
 #endif
     }
@@ -463,6 +1114,10 @@ void MultithreadScheduler::run(ptr<Task> task)
         bufferedFrames += 1;
     }
 
+    if (traceFile != NULL) {
+        flushTrace();
+    }
+
     // measures the current time at the end of this method, to compute a
     // deadline for the next call to this method
     lastFrame = timer.start();
@@ -473,37 +1128,41 @@ void MultithreadScheduler::monitorTask(const string &taskType)
     monitoredTasks.push_back(taskType);
 }
 
-void MultithreadScheduler::addFlattenedTask(ptr<Task> t, set< ptr<Task> > &addedTasks)
+TaskGraph::FlattenedGraph *MultithreadScheduler::getFlattenedGraph(ptr<TaskGraph> tg)
 {
-    // NOTE: the mutex should be locked before calling this method!
-    if (addedTasks.find(t) != addedTasks.end()) {
-        return;
+    if (tg->flattened == NULL || !tg->flattened->isValid()) {
+        if (tg->flattened != NULL) {
+            delete tg->flattened;
+        }
+        tg->flattened = new TaskGraph::FlattenedGraph();
+        map<Task*, int> indices;
+        flattenTask(tg, *tg->flattened, indices);
+        // the same dependency can be found several times, via different
+        // nested graphs
+        vector< pair<int, int> > &d = tg->flattened->dependencies;
+        sort(d.begin(), d.end());
+        d.erase(unique(d.begin(), d.end()), d.end());
     }
-    addedTasks.insert(t);
-    if (t->isDone()) {
+    return tg->flattened;
+}
+
+void MultithreadScheduler::flattenTask(ptr<Task> t, TaskGraph::FlattenedGraph &g, map<Task*, int> &indices)
+{
+    if (indices.find(t.get()) != indices.end()) {
         return;
     }
     ptr<TaskGraph> tg = t.cast<TaskGraph>();
     if (tg == NULL) {
-        if (t->getDeadline() == 0) {
-            immediateTasks.insert(t);
-        } else {
-            prefetchQueue.insert(t);
-        }
-        insertTask(allReadyTasks, t);
-#ifdef STRICT_PREFETCH
-        if (!t->isGpuTask() && t->getDeadline() > 0) {
-#else
-        if (!t->isGpuTask()) {
-#endif
-            insertTask(readyCpuTasks, t);
-        }
+        indices[t.get()] = int(g.tasks.size());
+        g.tasks.push_back(t);
     } else {
+        indices[t.get()] = -1;
+        g.graphs.push_back(make_pair(tg.get(), tg->version));
         tg->flattenedFirstTasks.clear();
         tg->flattenedLastTasks.clear();
         TaskGraph::TaskIterator i = tg->getAllTasks();
         while (i.hasNext()) {
-            addFlattenedTask(i.next(), addedTasks);
+            flattenTask(i.next(), g, indices);
         }
         i = tg->getFirstTasks();
         while (i.hasNext()) {
@@ -529,27 +1188,22 @@ void MultithreadScheduler::addFlattenedTask(ptr<Task> t, set< ptr<Task> > &added
         i = tg->getAllTasks();
         while (i.hasNext()) {
             ptr<Task> dst = i.next();
-            if (dst->isDone()) {
-                continue;
-            }
             TaskGraph::TaskIterator j = tg->getInverseDependencies(dst);
             while (j.hasNext()) {
                 ptr<Task> src = j.next();
-                addFlattenedDependency(src, dst);
+                flattenDependency(src, dst, g, indices);
             }
         }
     }
 }
 
-void MultithreadScheduler::addFlattenedDependency(ptr<Task> src, ptr<Task> dst)
+void MultithreadScheduler::flattenDependency(ptr<Task> src, ptr<Task> dst, TaskGraph::FlattenedGraph &g, map<Task*, int> &indices)
 {
-    // NOTE: the mutex should be locked before calling this method!
     ptr<TaskGraph> srcTg = src.cast<TaskGraph>();
     if (srcTg != NULL) {
         set< ptr<Task> >::iterator i = srcTg->flattenedFirstTasks.begin();
         while (i != srcTg->flattenedFirstTasks.end()) {
-            ptr<Task> srcT = *i;
-            addFlattenedDependency(srcT, dst);
+            flattenDependency(*i, dst, g, indices);
             ++i;
         }
     } else {
@@ -557,19 +1211,156 @@ void MultithreadScheduler::addFlattenedDependency(ptr<Task> src, ptr<Task> dst)
         if (dstTg != NULL) {
             set< ptr<Task> >::iterator i = dstTg->flattenedLastTasks.begin();
             while (i != dstTg->flattenedLastTasks.end()) {
-                ptr<Task> dstT = *i;
-                addFlattenedDependency(src, dstT);
+                flattenDependency(src, *i, g, indices);
                 ++i;
             }
         } else {
+            g.dependencies.push_back(make_pair(indices[src.get()], indices[dst.get()]));
+        }
+    }
+}
+
+void MultithreadScheduler::computeOrder(TaskGraph::FlattenedGraph &g)
+{
+    if (!g.order.empty() || g.tasks.empty()) {
+        return;
+    }
+    int n = int(g.tasks.size());
+    // we first compute the successors of each task, and its number of
+    // successors whose order is not yet computed
+    vector<int> count(n, 0);
+    for (unsigned int i = 0; i < g.dependencies.size(); ++i) {
+        count[g.dependencies[i].second] += 1;
+    }
+    g.firstSuccessor.resize(n + 1);
+    g.firstSuccessor[0] = 0;
+    for (int i = 0; i < n; ++i) {
+        g.firstSuccessor[i + 1] = g.firstSuccessor[i] + count[i];
+    }
+    g.successors.resize(g.dependencies.size());
+    vector<int> next(g.firstSuccessor.begin(), g.firstSuccessor.end() - 1);
+    vector< vector<int> > predecessors(n);
+    for (unsigned int i = 0; i < g.dependencies.size(); ++i) {
+        int src = g.dependencies[i].first;
+        int dst = g.dependencies[i].second;
+        g.successors[next[dst]++] = src;
+        predecessors[src].push_back(dst);
+    }
+    // we then add the tasks to the order, starting from the tasks without
+    // successors, and adding a task when all its successors have been added
+    for (int i = 0; i < n; ++i) {
+        if (count[i] == 0) {
+            g.order.push_back(i);
+        }
+    }
+    for (unsigned int i = 0; i < g.order.size(); ++i) {
+        vector<int> &p = predecessors[g.order[i]];
+        for (unsigned int j = 0; j < p.size(); ++j) {
+            if (--count[p[j]] == 0) {
+                g.order.push_back(p[j]);
+            }
+        }
+    }
+    // tasks in dependency cycles, if any, are not added to the order
+}
+
+void MultithreadScheduler::computeRanks(TaskGraph::FlattenedGraph &g, const vector<bool> &newTasks)
+{
+    computeOrder(g);
+    vector<float> ranks(g.tasks.size(), 0.0f);
+    for (unsigned int i = 0; i < g.order.size(); ++i) {
+        int t = g.order[i];
+        float rank = 0.0f;
+        for (int j = g.firstSuccessor[t]; j < g.firstSuccessor[t + 1]; ++j) {
+            rank = max(rank, ranks[g.successors[j]]);
+        }
+        // tasks without statistics yet count as very short tasks
+        float duration = g.tasks[t]->getExpectedDuration(durationPercentile);
+        ranks[t] = rank + (duration > 1.0f ? duration : 1.0f);
+        if (newTasks[t]) {
+            g.tasks[t]->rank = ranks[t];
+        }
+    }
+}
+
+bool MultithreadScheduler::addFlattenedTask(ptr<Task> t)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    if (t->schedulerIndex >= 0) {
+        // t has already been scheduled, and is not completed yet; we hold its
+        // node so that it can get new predecessors, unless it is already
+        // being executed
+        TaskNode *n = getNode(t->schedulerIndex);
+        if (n->hold()) {
+            if (mode == GLOBAL_QUEUE && ork_atomic_load(&n->pending) == (TaskNode::QUEUED | 1)) {
+                // in global queue mode a ready task that has not been selected
+                // for execution yet is put back in the graph (the ready tasks
+                // are found and added to the sorted sets with the mutex
+                // locked, so it must be in these sets)
+                removeTask(allReadyTasks, t);
+                removeTask(readyCpuTasks, t);
+                ork_atomic_store(&n->pending, 1L);
+            }
+            // in work stealing mode a ready task cannot be removed from the
+            // thread queues; its entry is skipped instead (see TaskNode#claim)
+            heldNodes.push_back(t->schedulerIndex);
+        }
+        return false;
+    }
+    // computes the expected duration with the percentile of this scheduler
+    // before it is cached and used to sort the tasks (see #taskSort)
+    t->getExpectedDuration(durationPercentile);
+    if (t->getDeadline() == 0) {
+        immediateTasks.insert(t);
+        ork_atomic_store(&immediateCount, (long) immediateTasks.size());
+    } else {
+        prefetchQueue.insert(t);
+    }
+    if (!threads.empty()) {
+        // the idle threads of this scheduler can help executing this task
+        ptr<ParallelForTask> p = t.cast<ParallelForTask>();
+        if (p != NULL) {
+            p->scheduler = this;
+            p->threads = int(threads.size()) + 1;
+        }
+    }
+    newNode(t);
+    heldNodes.push_back(t->schedulerIndex);
+    return true;
+}
+
+void MultithreadScheduler::addFlattenedDependency(ptr<Task> src, ptr<Task> dst)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    if (src->schedulerIndex < 0 || dst->schedulerIndex < 0) {
+        return;
+    }
+    TaskNode *srcNode = getNode(src->schedulerIndex);
+    TaskNode *dstNode = getNode(dst->schedulerIndex);
+    if ((ork_atomic_load(&srcNode->pending) & TaskNode::RUNNING) != 0) {
+        // src is already being executed (see #addFlattenedTask); otherwise
+        // it is held, and cannot become ready while we add the dependency
+        return;
+    }
+    // the done flag of dst can be set concurrently by #taskDone, so the
+    // successor must be added with the node locked
+    dstNode->lockNode();
+    bool added = !dstNode->done;
+    if (added) {
+        dstNode->successors.push_back(src->schedulerIndex);
+        atomic_increment(&srcNode->pending);
+    }
+    dstNode->unlockNode();
+    if (added) {
+        srcNode->predecessors.push_back(make_pair(dst->schedulerIndex, dstNode->generation));
+        if (srcNode->record >= 0 && dstNode->record >= 0) {
+            record.dependencies.push_back(make_pair(srcNode->record, dstNode->record));
+        }
+        if (dst->getDeadline() > src->getDeadline()) {
             set< ptr<Task> > visited;
-            removeTask(allReadyTasks, src);
-            removeTask(readyCpuTasks, src);
-            dependencies[src].insert(dst);
-            inverseDependencies[dst].insert(src);
             setDeadline(dst, src->getDeadline(), visited);
-            assert(src->getDeadline() >= dst->getDeadline());
         }
+        assert(src->getDeadline() >= dst->getDeadline());
     }
 }
 
@@ -591,7 +1382,22 @@ void MultithreadScheduler::setDeadline(ptr<Task> t, unsigned int deadline, set<
     if (t->getDeadline() > deadline) {
         bool b1 = removeTask(allReadyTasks, t);
         bool b2 = removeTask(readyCpuTasks, t);
+        bool b3 = false;
+        if (mode == WORK_STEALING) {
+            // tasks in the thread queues are not sorted, they are checked
+            // when they are removed from these queues (see #nextCpuTaskWorkStealing);
+            // a prefetching task that becomes a task for the current frame
+            // stays in its prefetching queue
+            pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+            b3 = removeTask(mainTasks, t) || removeTask(injectedTasks, t);
+        }
         t->setDeadline(deadline);
+        if (b3) {
+            insertTask(isMainThreadTask(t) ? mainTasks : injectedTasks, t);
+        }
+        if (mode == WORK_STEALING) {
+            pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+        }
         if (b1) {
             insertTask(allReadyTasks, t);
         }
@@ -605,130 +1411,776 @@ void MultithreadScheduler::setDeadline(ptr<Task> t, unsigned int deadline, set<
             insertTask(readyCpuTasks, t);
 #endif
         }
-        map< ptr<Task>, set< ptr<Task> > >::iterator i = dependencies.find(t);
-        if (i != dependencies.end()) {
-            set< ptr<Task> >::iterator j = i->second.begin();
-            while (j != i->second.end()) {
-                setDeadline(*j, deadline, visited);
-                j++;
+        if (tg == NULL && t->schedulerIndex >= 0) {
+            // we need a copy since the recursive calls can modify the nodes
+            vector< pair<int, int> > predecessors = getNode(t->schedulerIndex)->predecessors;
+            for (unsigned int i = 0; i < predecessors.size(); ++i) {
+                TaskNode *n = getNode(predecessors[i].first);
+                // predecessors that are completed can be deleted, and their
+                // nodes reused by other tasks
+                if (n->generation == predecessors[i].second) {
+                    setDeadline(n->task, deadline, visited);
+                }
             }
         }
     }
 }
 
-void MultithreadScheduler::taskDone(ptr<Task> t, bool changes)
+void MultithreadScheduler::taskDone(ptr<Task> t, bool changes, int thread)
 {
-    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    TaskNode *n = getNode(t->schedulerIndex);
+    // a task cancelled before or during its execution is dropped: it is not
+    // marked as completed, and its successors, which cannot use its result,
+    // are cancelled too
+    bool cancelled = t->isCancelled();
+    // we first mark the task as executed, so that it cannot get new
+    // successors; its list of successors is then constant
+    n->lockNode();
+    n->done = true;
+    n->unlockNode();
+    // we decrement the number of pending predecessors of each successor r
+    // of t; if t was the last pending predecessor of r, r is now ready to
+    // be executed. In global queue mode this must be done with the mutex
+    // locked, so that a ready task is always in #allReadyTasks when
+    // #addFlattenedTask looks for it. In work stealing mode the new ready
+    // tasks can get new predecessors before they are added to the queues,
+    // their entries are then skipped (see TaskNode#claim)
+    vector< ptr<Task> > readyTasks;
+    if (mode == GLOBAL_QUEUE) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+    }
+    for (unsigned int i = 0; i < n->successors.size(); ++i) {
+        TaskNode *r = getNode(n->successors[i]);
+        if (cancelled) {
+            // must be done before r can be selected for execution
+            ork_atomic_store(&r->task->cancelled, 1L);
+        }
+        if (r->release()) {
+            readyTasks.push_back(r->task);
+        }
+    }
+
+    bool immediate = false;
+    if (mode == WORK_STEALING) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+    }
     unsigned int completionDate = changes ? time : t->getCompletionDate();
-    map< ptr<Task>, set< ptr<Task> > >::iterator i = inverseDependencies.find(t);
-    if (i != inverseDependencies.end()) {
-        set< ptr<Task> >::iterator j = i->second.begin();
-        set< ptr<Task> >::iterator end = i->second.end();
-        while (j != end) { // iterates over the successors of t
-            ptr<Task> r = *j; // r is a successor of t
-            // the predecessors of r should not be empty, and should contain t
-            map< ptr<Task>, set< ptr<Task> > >::iterator k = dependencies.find(r);
-            assert(k != dependencies.end());
-            set< ptr<Task> >::iterator l = k->second.find(t);
-            assert(l != k->second.end());
-            // we then remove t from the predecessors of r
-            k->second.erase(l);
-            // if t was the only remaining predecessor of r,
-            // r is now ready to be executed
-            if (k->second.empty()) {
-                dependencies.erase(k);
-                // we add it to the set of ready tasks, and signals this to the
-                // execution threads; we do the same for the set of ready CPU
-                // tasks, if r is a CPU tas
-                insertTask(allReadyTasks, r);
-                pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
-#ifdef STRICT_PREFETCH
-                if (!r->isGpuTask() && r->getDeadline() > 0) {
-#else
-                if (!r->isGpuTask()) {
-#endif
-                    insertTask(readyCpuTasks, r);
-                    pthread_cond_broadcast((pthread_cond_t*) cpuTasksCond);
-                }
+    if (!suspendedTasks.empty()) {
+        // the tasks waiting for t can now be resumed
+        map< Task*, vector< ptr<Task> > >::iterator i = suspendedTasks.find(t.get());
+        if (i != suspendedTasks.end()) {
+            for (unsigned int j = 0; j < i->second.size(); ++j) {
+                // a suspended task was selected for execution, it becomes
+                // ready again
+                ork_atomic_store(&getNode(i->second[j]->schedulerIndex)->pending, TaskNode::QUEUED);
+                readyTasks.push_back(i->second[j]);
             }
-            j++;
+            suspendedTasks.erase(i);
         }
-        inverseDependencies.erase(i);
+    }
+    if (mode == GLOBAL_QUEUE && !readyTasks.empty()) {
+        // we add the new ready tasks to the set of ready tasks, and signals
+        // this to the execution threads; we do the same for the set of ready
+        // CPU tasks, if some of these tasks are CPU tasks
+        int cpuTasks = 0;
+        for (unsigned int i = 0; i < readyTasks.size(); ++i) {
+            if (insertReadyTask(readyTasks[i])) {
+                ++cpuTasks;
+            }
+        }
+        pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
+        signalCpuThreads(cpuTasks);
+        readyTasks.clear();
     }
     prefetchQueue.erase(t);
-    // finally we mark the task as completed
-    t->setIsDone(true, completionDate);
+    if (mode == WORK_STEALING && immediateTasks.erase(t) > 0) {
+        ork_atomic_store(&immediateCount, (long) immediateTasks.size());
+        immediate = true;
+    }
+    deleteNode(t);
+    if (cancelled) {
+        ptr<ResumableTask> r = t.cast<ResumableTask>();
+        if (r != NULL) {
+            // a resumable task must restart from its first step
+            r->step = 0;
+            r->changed = false;
+        }
+        ork_atomic_store(&t->cancelled, 0L);
+    } else {
+        // finally we mark the task as completed
+        t->setIsDone(true, completionDate);
+    }
     // and we increment the logical time counter
     ++time;
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    if (!readyTasks.empty()) {
+        // in work stealing mode the new ready tasks are added to the queue
+        // of the current thread
+        pushReadyTasks(readyTasks, thread);
+    } else if (immediate) {
+        // the main thread may be waiting for the completion of this task
+        wakeUpThreads(0);
+    }
 }
 
-void MultithreadScheduler::schedulerThread()
+void MultithreadScheduler::suspendTask(ptr<ResumableTask> t, int thread)
 {
-    Timer timer;
+    ptr<Task> u = t->awaited;
+    t->awaited = NULL;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    if (mode == GLOBAL_QUEUE && t->getDeadline() == 0) {
+        // t was removed from this set when it was selected for execution,
+        // but the current frame is not completed before t is completed
+        immediateTasks.insert(t);
+        ork_atomic_store(&immediateCount, (long) immediateTasks.size());
+    }
+    bool ready = u->isDone();
+    if (!ready) {
+        if (u->schedulerIndex < 0 && u->getDeadline() > t->getDeadline()) {
+            u->setDeadline(t->getDeadline());
+        }
+        // the mutex is recursive, and scheduleTask does not wait for the
+        // execution of u
+        scheduleTask(u);
+        if (u->getDeadline() > t->getDeadline()) {
+            set< ptr<Task> > visited;
+            setDeadline(u, t->getDeadline(), visited);
+        }
+        ready = u->isDone();
+        if (!ready) {
+            suspendedTasks[u.get()].push_back(t);
+        }
+    }
+    if (ready) {
+        ork_atomic_store(&getNode(t->schedulerIndex)->pending, TaskNode::QUEUED);
+    }
+    if (ready && mode == GLOBAL_QUEUE) {
+        int cpuTasks = insertReadyTask(t) ? 1 : 0;
+        pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
+        signalCpuThreads(cpuTasks);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    if (ready && mode == WORK_STEALING) {
+        vector< ptr<Task> > readyTasks(1, ptr<Task>(t));
+        pushReadyTasks(readyTasks, thread);
+    }
+}
 
-    // loop to execute tasks, until the scheduler must be deleted
-    while (!stop) {
-        ptr<Task> t;
+void MultithreadScheduler::completeAsyncTasks(bool wait)
+{
+    unsigned int i = 0;
+    while (i < asyncTasks.size()) {
+        ptr<Task> t = asyncTasks[i].first;
+        if (t->checkCompletion(wait && i == 0)) {
+            bool changes = asyncTasks[i].second;
+            asyncTasks.erase(asyncTasks.begin() + i);
+            taskDone(t, changes, 0);
+        } else {
+            ++i;
+        }
+    }
+}
+
+bool MultithreadScheduler::canPrefetch(ptr<Task> t, int prefetched, double deadline, Timer &timer)
+{
+    // if we do not have executed the required minimum number of
+    // prefetching tasks per frame, we execute this available
+    // prefetching task
+    if (prefetched >= prefetchRate) {
+        // if we do not have a fixed framerate, or if the time remaining
+        // until the deadline is less than the expected duration for this
+        // task, we should stop here
+        if (framePeriod == 0.0 || timer.start() + t->getExpectedDuration(durationPercentile) > deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ptr<Task> MultithreadScheduler::nextTask(Timer &timer, double deadline, int prefetched, void *previousContext)
+{
+    ptr<Task> t = NULL;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    if (immediateTasks.empty() && framePeriod > 0.0) {
+        // if the tasks for the current frame are completed, and if we have
+        // a fixed framerate, we can use the time until the deadline to
+        // execute some tasks for next few frames
+#ifdef BUSY_WAITING
+        while (allReadyTasks.empty() && asyncTasks.empty() && timer.start() < deadline) {
+            // so we wait for a ready CPU or GPU task,
+            // and stop when the deadline is passed
+            pthread_mutex_unlock((pthread_mutex_t*) mutex);
+            double timeout = min(deadline, timer.start() + 500.0);
+            while (timer.start() < timeout) {
+            }
+            pthread_mutex_lock((pthread_mutex_t*) mutex);
+        }
+#else
+        timespec deadlinespec;
+        getAbsoluteTime(deadline - timer.start(), deadlinespec);
+        while (allReadyTasks.empty() && asyncTasks.empty() && timer.start() < deadline) {
+            // so we wait for a ready CPU or GPU task,
+            // and stop when the deadline is passed
+            pthread_cond_timedwait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex, &deadlinespec);
+        }
+#endif
+    } else {
+        // here either some tasks for the current frame are not completed
+        // or they are all completed but we do not have a fixed framerate
+        while (!immediateTasks.empty() && (allReadyTasks.empty() || allReadyTasks.begin()->first.first > 0)) {
+            // while some tasks for the current frame remain to be executed,
+            // and while the set of tasks ready to be executed is empty or
+            // contains only tasks for the next frames (deadline > 0), wait
+            // (unless some GPU tasks are pending, see #run)
+            if (!asyncTasks.empty()) {
+                pthread_mutex_unlock((pthread_mutex_t*) mutex);
+                return NULL;
+            }
+            pthread_cond_wait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex);
+        }
+    }
+    // if the deadline is passed or if all the tasks for the current frame
+    // are completed, there may not be any task ready to be executed
+    if (!allReadyTasks.empty()) {
+        // but if there is at least one we pick one, if possible with the
+        // same execution context as the last executed GPU task
+        t = getTask(allReadyTasks, previousContext);
+        if (t->getDeadline() != 0) {
+            // if this task is for the next frames, then all tasks for the
+            // current frame should now be completed (tasks are sorted in
+            // such a way that tasks for the current frame are executed first)
+            assert(immediateTasks.empty());
+            if (!canPrefetch(t, prefetched, deadline, timer)) {
+                t = NULL;
+            }
+        }
+        if (t != NULL) {
+            // if we finally have a task to execute, we remove it from the
+            // sets that may contain it (but we do not update the
+            // dependencies yet, this will be done after the task execution
+            // in #taskDone
+            immediateTasks.erase(t);
+            ork_atomic_store(&immediateCount, (long) immediateTasks.size());
+            removeTask(allReadyTasks, t);
+            removeTask(readyCpuTasks, t);
+            // always succeeds, since tasks with new predecessors are removed
+            // from the ready tasks in global queue mode
+            getNode(t->schedulerIndex)->claim();
+        }
+    }
+    // we can now release the mutex since we will not read or modify the
+    // shared data structures until #taskDone is called; also the selected
+    // task t cannot be seleted by another thread, since it has been removed
+    // from the task sets.
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return t;
+}
+
+ptr<Task> MultithreadScheduler::nextTaskWorkStealing(Timer &timer, double deadline, int prefetched, void *previousContext)
+{
+    while (true) {
+        bool immediate = ork_atomic_load(&immediateCount) > 0;
+        ptr<Task> t = NULL;
+        bool found = false;
+        // the main thread tasks are sorted as in the global queue mode, so
+        // we pick one with the same deadline and execution context as the
+        // last GPU task if possible
+        pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+        if (!mainTasks.empty()) {
+            found = true;
+            t = getTask(mainTasks, previousContext);
+            if (t->getDeadline() == 0 || (!immediate && canPrefetch(t, prefetched, deadline, timer))) {
+                removeTask(mainTasks, t);
+            } else {
+                t = NULL;
+            }
+        }
+        pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+        if (t != NULL) {
+            return t;
+        }
+        if (immediate) {
+            // while the tasks for the current frame are not completed, we
+            // help the other threads to execute the CPU tasks for the current
+            // frame, as in global queue mode (but not the prefetching tasks)
+            t = getCpuTask(0, true);
+            if (t != NULL) {
+                return t;
+            }
+        } else {
+            if (found) {
+                // the best prefetching task cannot be executed at this frame
+                return NULL;
+            }
+            // the tasks for the current frame are completed, we can now
+            // help the other threads to execute the prefetching CPU tasks
+            t = getCpuTask(0, false);
+            if (t != NULL) {
+                if (t->getDeadline() == 0 || canPrefetch(t, prefetched, deadline, timer)) {
+                    return t;
+                }
+                // we put the task back in our queue, where the other
+                // threads can steal it
+                getQueue(0, t)->push(t.get());
+                wakeUpThreads(1);
+                return NULL;
+            }
+            if (framePeriod == 0.0 || timer.start() >= deadline) {
+                return NULL;
+            }
+        }
+        // here either some tasks for the current frame are not ready yet,
+        // or all are completed and we can wait for prefetching tasks until
+        // the deadline; in both cases we wait until another thread signals
+        // new ready tasks or completed tasks
         pthread_mutex_lock((pthread_mutex_t*) mutex);
-        // wait until we have a CPU task ready to be executed (the additional
-        // threads cannot execute GPU tasks, because OpenGL supports only one
-        // thread at a time), or the scheduler is being deleted
-        while (readyCpuTasks.empty() && !stop) {
-            pthread_cond_wait((pthread_cond_t*) cpuTasksCond, (pthread_mutex_t*) mutex);
+        ork_atomic_store(&mainThreadSleeping, 1L);
+        atomic_fence();
+        bool wait;
+        pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+        if (immediate) {
+            wait = ork_atomic_load(&immediateCount) > 0 && (mainTasks.empty() || mainTasks.begin()->first.first > 0);
+        } else {
+            wait = mainTasks.empty();
+        }
+        pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+        if (wait) {
+            wait = !hasCpuTasks(immediate);
+        }
+        if (wait && !asyncTasks.empty()) {
+            // the main thread must not sleep while GPU tasks are pending
+            // (see #run)
+            ork_atomic_store(&mainThreadSleeping, 0L);
+            pthread_mutex_unlock((pthread_mutex_t*) mutex);
+            return NULL;
+        }
+        if (wait) {
+            if (immediate) {
+                pthread_cond_wait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex);
+            } else {
+#ifdef BUSY_WAITING
+                pthread_mutex_unlock((pthread_mutex_t*) mutex);
+                double timeout = min(deadline, timer.start() + 500.0);
+                while (timer.start() < timeout) {
+                }
+                pthread_mutex_lock((pthread_mutex_t*) mutex);
+#else
+                timespec deadlinespec;
+                getAbsoluteTime(deadline - timer.start(), deadlinespec);
+                pthread_cond_timedwait((pthread_cond_t*) allTasksCond, (pthread_mutex_t*) mutex, &deadlinespec);
+#endif
+            }
+        }
+        ork_atomic_store(&mainThreadSleeping, 0L);
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    }
+}
+
+ptr<Task> MultithreadScheduler::nextCpuTask(int thread)
+{
+    ptr<Task> t;
+    bool spun = false;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    // wait until we have a CPU task ready to be executed (the additional
+    // threads cannot execute GPU tasks, because OpenGL supports only one
+    // thread at a time), a parallel for task to help, or the scheduler is
+    // being deleted
+    while (readyCpuTasks.empty() && !hasParallelChunks() && !stop) {
+        if (!spun && spinTime > 0.0f) {
+            // we first wait actively, without holding the mutex
+            long version = ork_atomic_load(&cpuTasksVersion);
+            pthread_mutex_unlock((pthread_mutex_t*) mutex);
+            spinWait(thread, version);
+            spun = true;
+            pthread_mutex_lock((pthread_mutex_t*) mutex);
+            continue;
         }
-        if (!stop) {
-            SortedTaskSet::iterator i = readyCpuTasks.begin();
-            assert(i != readyCpuTasks.end());
-            assert(i->second.begin() != i->second.end());
-            // selects the first ready task
-            t = *(i->second.begin());
+        atomic_increment(&sleepingThreads);
+        pthread_cond_wait((pthread_cond_t*) cpuTasksCond, (pthread_mutex_t*) mutex);
+        atomic_decrement(&sleepingThreads);
+    }
+    if (!stop && !readyCpuTasks.empty()) {
+        SortedTaskSet::iterator i = readyCpuTasks.begin();
+        assert(i != readyCpuTasks.end());
+        assert(i->second.begin() != i->second.end());
+        // selects the first ready task
+        t = *(i->second.begin());
 #ifdef STRICT_PREFETCH
-            assert(t->getDeadline() > 0);
+        assert(t->getDeadline() > 0);
 #endif
-            // and removes it from the task sets,
-            // so that other threads will not select it again
+        // and removes it from the task sets,
+        // so that other threads will not select it again
+        if (t->getDeadline() == 0) {
+            immediateTasks.erase(t);
+            ork_atomic_store(&immediateCount, (long) immediateTasks.size());
+        }
+        removeTask(allReadyTasks, t);
+        removeTask(readyCpuTasks, t);
+        getNode(t->schedulerIndex)->claim();
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return t;
+}
+
+ptr<Task> MultithreadScheduler::nextCpuTaskWorkStealing(int thread)
+{
+    while (!stop) {
+        long version = ork_atomic_load(&cpuTasksVersion);
+        ptr<Task> t = getCpuTask(thread, false);
+        if (t != NULL) {
+#ifdef STRICT_PREFETCH
             if (t->getDeadline() == 0) {
-                immediateTasks.erase(t);
+                // the deadline of this task has been changed after it was
+                // added to a queue: only the main thread can now execute it
+                vector< ptr<Task> > tasks(1, t);
+                pushReadyTasks(tasks, thread);
+                continue;
             }
-            removeTask(allReadyTasks, t);
-            removeTask(readyCpuTasks, t);
+#endif
+            return t;
+        }
+        // no task found, we first wait actively for new ready tasks
+        if (spinTime > 0.0f && spinWait(thread, version)) {
+            continue;
+        }
+        // and then we wait until a thread signals new ready tasks
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        atomic_increment(&sleepingThreads);
+        atomic_fence();
+        while (!stop && !hasCpuTasks(false) && !hasParallelChunks()) {
+            pthread_cond_wait((pthread_cond_t*) cpuTasksCond, (pthread_mutex_t*) mutex);
         }
+        atomic_decrement(&sleepingThreads);
+        bool help = hasParallelChunks();
         pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        if (help) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
 
-        if (!stop) {
+ptr<Task> MultithreadScheduler::getCpuTask(int thread, bool immediateOnly)
+{
+    int n = int(threads.size());
+    // we first look for a task for the current frame, and then for a
+    // prefetching task, in the same way
+    for (int prefetch = 0; prefetch < (immediateOnly ? 1 : 2); ++prefetch) {
+        vector<WorkStealingQueue<Task*>*> &q = prefetch == 0 ? queues : prefetchQueues;
+        // we first look in our own queue
+        Task *t = q[thread]->pop();
+        if (t != NULL) {
+            return t;
+        }
+        // then in the tasks added by #schedule, which are sorted; we take a
+        // batch of the first tasks, we keep the first one and we put the
+        // others in our queues, in reverse order so that they are executed
+        // in the sorted order
+        vector<Task*> batch;
+        pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+        while (!injectedTasks.empty() && batch.size() < (unsigned int) INJECTED_BATCH_SIZE) {
+            if (prefetch == 0 && injectedTasks.begin()->first.first > 0) {
+                break;
+            }
+            ptr<Task> u = *(injectedTasks.begin()->second.begin());
+            batch.push_back(u.get());
+            removeTask(injectedTasks, u);
+        }
+        pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+        if (!batch.empty()) {
+            for (int i = int(batch.size()) - 1; i > 0; --i) {
+                getQueue(thread, batch[i])->push(batch[i]);
+            }
+            if (batch.size() > 1) {
+                wakeUpThreads(int(batch.size()) - 1);
+            }
+            return batch[0];
+        }
+        // finally we try to steal a task from the other threads, starting
+        // with the closest ones (see #setThreadAffinity)
+        for (int i = 0; i < n; ++i) {
+            t = q[victims[thread * n + i]]->steal();
+            if (t != NULL) {
+                return t;
+            }
+        }
+    }
+    return NULL;
+}
+
+bool MultithreadScheduler::hasCpuTasks(bool immediateOnly)
+{
+    for (unsigned int i = 0; i < queues.size(); ++i) {
+        if (queues[i]->size() > 0 || (!immediateOnly && prefetchQueues[i]->size() > 0)) {
+            return true;
+        }
+    }
+    pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+    bool result = !injectedTasks.empty() && (!immediateOnly || injectedTasks.begin()->first.first == 0);
+    pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+    return result;
+}
+
+WorkStealingQueue<Task*> *MultithreadScheduler::getQueue(int thread, const ptr<Task> &t)
+{
+    return t->getDeadline() == 0 ? queues[thread] : prefetchQueues[thread];
+}
+
+void MultithreadScheduler::pushReadyTasks(vector< ptr<Task> > &tasks, int thread)
+{
+    // we sort the tasks in the same order as in the global sorted sets
+    sort(tasks.begin(), tasks.end(), readyTaskSort());
+    int cpuTasks = 0;
+    bool locked = false;
+    // we push the tasks in reverse order so that the owner of a queue,
+    // which pops the last pushed task first, executes them in sorted order
+    for (int i = int(tasks.size()) - 1; i >= 0; --i) {
+        ptr<Task> t = tasks[i];
+        if (!isMainThreadTask(t) && thread >= 0) {
+            getQueue(thread, t)->push(t.get());
+            ++cpuTasks;
+        } else {
+            if (!locked) {
+                pthread_mutex_lock((pthread_mutex_t*) laneMutex);
+                locked = true;
+            }
+            if (isMainThreadTask(t)) {
+                insertTask(mainTasks, t);
+            } else {
+                insertTask(injectedTasks, t);
+                ++cpuTasks;
+            }
+        }
+    }
+    if (locked) {
+        pthread_mutex_unlock((pthread_mutex_t*) laneMutex);
+    }
+    wakeUpThreads(cpuTasks);
+}
+
+void MultithreadScheduler::wakeUpThreads(int cpuTasks)
+{
+    if (cpuTasks > 0) {
+        // signals the new tasks to the threads that wait actively
+        atomic_increment(&cpuTasksVersion);
+    }
+    // this fence, and the one executed by the waiting threads after they set
+    // #mainThreadSleeping or #sleepingThreads, ensure that either we see
+    // the waiting threads, or they see the new tasks
+    atomic_fence();
+    bool main = ork_atomic_load(&mainThreadSleeping) != 0;
+    bool others = cpuTasks > 0 && ork_atomic_load(&sleepingThreads) > 0;
+    if (main || others) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        if (main) {
+            pthread_cond_broadcast((pthread_cond_t*) allTasksCond);
+        }
+        if (others) {
+            int n = min(cpuTasks, (int) ork_atomic_load(&sleepingThreads));
+            for (int i = 0; i < n; ++i) {
+                pthread_cond_signal((pthread_cond_t*) cpuTasksCond);
+            }
+        }
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    }
+}
+
+void MultithreadScheduler::signalCpuThreads(int cpuTasks)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    if (cpuTasks > 0) {
+        atomic_increment(&cpuTasksVersion);
+        // the threads that are not sleeping will find the new tasks by
+        // themselves; waking up more threads would be useless
+        int n = min(cpuTasks, (int) ork_atomic_load(&sleepingThreads));
+        for (int i = 0; i < n; ++i) {
+            pthread_cond_signal((pthread_cond_t*) cpuTasksCond);
+        }
+    }
+}
+
+bool MultithreadScheduler::spinWait(int thread, long version)
+{
+    float &limit = spinTimes[thread];
+    limit = max(spinTime / 16.0f, min(limit, spinTime));
+    Timer timer;
+    double end = timer.start() + limit;
+    for (int i = 1; ; ++i) {
+        if (ork_atomic_load(&cpuTasksVersion) != version || ork_atomic_load(&parallelCount) > 0) {
+            limit = min(2.0f * limit, spinTime);
+            return true;
+        }
+        cpu_relax();
+        // reading the time is much more costly than a pause instruction
+        if ((i & 63) == 0 && timer.start() >= end) {
+            break;
+        }
+    }
+    limit = limit / 2.0f;
+    return false;
+}
+
+void MultithreadScheduler::setSpinTime(float spinTime)
+{
+    this->spinTime = spinTime;
+}
+
+void MultithreadScheduler::setDurationPercentile(float percentile)
+{
+    durationPercentile = percentile;
+}
+
+void MultithreadScheduler::schedulerThread(int thread)
+{
+    Timer timer;
+
+    // loop to execute tasks, until the scheduler must be deleted
+    while (!stop) {
+        // we first help the threads executing parallel for tasks, if any
+        if (ork_atomic_load(&parallelCount) > 0 && helpParallelFor(thread)) {
+            continue;
+        }
+        ptr<Task> t = mode == WORK_STEALING ? nextCpuTaskWorkStealing(thread) : nextCpuTask(thread);
+
+        if (t != NULL && mode == WORK_STEALING && !getNode(t->schedulerIndex)->claim()) {
+            // same thing as in the #run method
+            continue;
+        }
+
+        if (t != NULL) {
             assert(!t->isGpuTask());
             bool changes = false;
-            if (!t->isDone()) {
-                if (Logger::DEBUG_LOGGER != NULL) {
-                    ostringstream oss;
-                    oss << "PREFETCH " << t->getClass();
-                    Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
-                }
+            if (!t->isDone() && !t->isCancelled()) {
+                ORK_LOG_DEBUG("SCHEDULER", "PREFETCH " << t->getClass());
 
                 // same thing as in the #run method
+                bool tracing = ork_atomic_load(&this->tracing) != 0;
                 if (t->getCompletionDate() >= t->getPredecessorsCompletionDate()) {
                     // t is up to date, it is not necessary to run it
-                } else if (framePeriod > 0.0) {
-                    timer.start();
-                    changes = t->run();
-                    double duration = timer.end();
+                } else if (framePeriod > 0.0 || tracing || ork_atomic_load(&measureUtilization) != 0 || ork_atomic_load(&recording) != 0) {
+                    double start = Timer::getTaskTime();
+                    changes = runTask(t);
+                    double duration = Timer::getTaskTime() - start;
                     t->setActualDuration((float) duration);
+                    addBusyTime(thread, duration);
+                    if (tracing) {
+                        trace(thread, TraceEvent::TASK, t, start, start + duration);
+                    }
+                    if (ork_atomic_load(&recording) != 0) {
+                        recordTask(t, thread, start, duration);
+                    }
                 } else {
-                    changes = t->run();
+                    changes = runTask(t);
                 }
             }
-            taskDone(t, changes);
+            ptr<ResumableTask> r = t.cast<ResumableTask>();
+            if (r != NULL && r->awaited != NULL) {
+                suspendTask(r, thread);
+            } else {
+                taskDone(t, changes, thread);
+            }
         }
     }
 }
 
 void* MultithreadScheduler::schedulerThread(void* arg)
 {
-    ((MultithreadScheduler*) arg)->schedulerThread();
+    SchedulerThreadArg *a = (SchedulerThreadArg*) arg;
+    MultithreadScheduler *scheduler = a->scheduler;
+    int thread = a->thread;
+    delete a;
+    scheduler->schedulerThread(thread);
     return NULL;
 }
 
+void MultithreadScheduler::startParallelFor(ParallelForTask *t)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    parallelTasks.push_back(t);
+    ork_atomic_store(&parallelCount, (long) parallelTasks.size());
+    atomic_increment(&cpuTasksVersion);
+    pthread_cond_broadcast((pthread_cond_t*) cpuTasksCond);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void MultithreadScheduler::stopParallelFor(ParallelForTask *t)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    parallelTasks.erase(find(parallelTasks.begin(), parallelTasks.end(), t));
+    ork_atomic_store(&parallelCount, (long) parallelTasks.size());
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void MultithreadScheduler::waitParallelFor(ParallelForTask *t)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    while (ork_atomic_load(&t->pending) > 0) {
+        pthread_cond_wait((pthread_cond_t*) parallelDoneCond, (pthread_mutex_t*) mutex);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+bool MultithreadScheduler::hasParallelChunks()
+{
+    // NOTE: the mutex should be locked before calling this method!
+    for (unsigned int i = 0; i < parallelTasks.size(); ++i) {
+        ParallelForTask *t = parallelTasks[i];
+        if (ork_atomic_load(&t->next) < t->end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MultithreadScheduler::helpParallelFor(int thread)
+{
+    // the task cannot be deleted while it is in #parallelTasks, i.e. while it
+    // is executed; we get a reference to it so that it can be deleted only
+    // after we have completed our chunks
+    ptr<ParallelForTask> t;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    for (unsigned int i = 0; i < parallelTasks.size() && t == NULL; ++i) {
+        ParallelForTask *u = parallelTasks[i];
+        if (ork_atomic_load(&u->next) < u->end) {
+            t = u;
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    if (t == NULL) {
+        return false;
+    }
+    double start = Timer::getTaskTime();
+    bool executed = t->runChunks();
+    if (executed && ork_atomic_load(&t->pending) == 0) {
+        // we may have completed the last chunk, while the thread executing
+        // the task waits for it (see #waitParallelFor); the mutex ensures
+        // that this signal cannot be lost
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        pthread_cond_broadcast((pthread_cond_t*) parallelDoneCond);
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    }
+    if (executed) {
+        double end = Timer::getTaskTime();
+        addBusyTime(thread, end - start);
+        if (ork_atomic_load(&tracing) != 0) {
+            trace(thread, TraceEvent::TASK, t, start, end);
+        }
+    }
+    return executed;
+}
+
+void MultithreadScheduler::addBusyTime(int thread, double time)
+{
+    // the lock is only contended while #getThreadUtilization reads #time
+    BusyTime &b = busyTimes[thread];
+    while (!atomic_compare_and_swap(&b.lock, 0L, 1L)) {
+        cpu_relax();
+    }
+    b.time += time;
+    ork_atomic_store(&b.lock, 0L);
+}
+
 void MultithreadScheduler::clearBufferedFrames()
 {
     if (statisticsFile == NULL) {
@@ -752,6 +2204,171 @@ void MultithreadScheduler::clearBufferedFrames()
     bufferedFrames = 0;
 }
 
+void MultithreadScheduler::startTrace(const string &fileName)
+{
+    if (traceFile != NULL) {
+        stopTrace();
+    }
+    if (traceBuffers.empty()) {
+        for (unsigned int i = 0; i <= threads.size(); ++i) {
+            traceBuffers.push_back(new TraceBuffer());
+        }
+    }
+    // discards the events that may have been recorded after the end of a
+    // previous trace
+    TraceEvent e;
+    for (unsigned int i = 0; i < traceBuffers.size(); ++i) {
+        while (traceBuffers[i]->pop(e)) {
+        }
+    }
+    fopen(&traceFile, fileName.c_str(), "w");
+    if (traceFile == NULL) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("SCHEDULER", "Cannot open trace file '" + fileName + "'");
+        }
+        return;
+    }
+    fprintf(traceFile, "{\"traceEvents\":[\n");
+    for (unsigned int i = 0; i < traceBuffers.size(); ++i) {
+        fprintf(traceFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"", i == 0 ? "" : ",\n", i);
+        if (i == 0) {
+            fprintf(traceFile, "main\"}}");
+        } else {
+            fprintf(traceFile, "worker %d\"}}", i);
+        }
+    }
+    Timer timer;
+    traceStart = timer.start();
+    ork_atomic_store(&tracing, 1L);
+}
+
+void MultithreadScheduler::stopTrace()
+{
+    ork_atomic_store(&tracing, 0L);
+    if (traceFile == NULL) {
+        return;
+    }
+    flushTrace();
+    long dropped = 0;
+    for (unsigned int i = 0; i < traceBuffers.size(); ++i) {
+        dropped += traceBuffers[i]->getDropped();
+    }
+    fprintf(traceFile, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":\"%ld\"}}\n", dropped);
+    fclose(traceFile);
+    traceFile = NULL;
+}
+
+void MultithreadScheduler::startRecording()
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    record.clear();
+    record.threads = int(threads.size()) + 1;
+    recordTypes.clear();
+    Timer timer;
+    recordStart = timer.start();
+    ork_atomic_store(&recording, 1L);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void MultithreadScheduler::stopRecording(ScheduleRecord &record)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    ork_atomic_store(&recording, 0L);
+    // the nodes of the pending tasks must not refer to the returned record
+    for (int i = 0; i < nodeCount; ++i) {
+        getNode(i)->record = -1;
+    }
+    record = this->record;
+    this->record.clear();
+    recordTypes.clear();
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void MultithreadScheduler::recordTask(ptr<Task> t, int thread, double start, double duration)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    int index = t->schedulerIndex < 0 ? -1 : getNode(t->schedulerIndex)->record;
+    if (ork_atomic_load(&recording) != 0 && index >= 0) {
+        ScheduleRecord::TaskRecord &r = record.tasks[index];
+        if (r.thread < 0) {
+            r.thread = thread;
+            r.start = (float) (start - recordStart);
+            r.duration = (float) duration;
+        } else {
+            // a ResumableTask can be executed several times
+            r.duration += (float) duration;
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+const char *MultithreadScheduler::getTaskName(const ptr<Task> &t)
+{
+    // the class name is not available in release builds
+    const char *name = t->getClass();
+    if (name[0] == 0) {
+        name = t->getTypeInfo()->name();
+    }
+    return name;
+}
+
+bool MultithreadScheduler::runTask(const ptr<Task> &t)
+{
+    Profiler::Scope scope(getTaskName(t));
+    return t->run();
+}
+
+void MultithreadScheduler::trace(int thread, TraceEvent::eventType type, ptr<Task> t, double start, double end)
+{
+    TraceEvent e;
+    e.type = type;
+    e.name = NULL;
+    e.start = start;
+    e.end = end;
+    e.deadline = 0;
+    e.gpuTask = false;
+    if (t != NULL) {
+        e.name = getTaskName(t);
+        e.deadline = t->getDeadline();
+        e.gpuTask = t->isGpuTask();
+    }
+    traceBuffers[thread]->push(e);
+}
+
+void MultithreadScheduler::flushTrace()
+{
+    TraceEvent e;
+    for (unsigned int i = 0; i < traceBuffers.size(); ++i) {
+        while (traceBuffers[i]->pop(e)) {
+            double ts = e.start - traceStart;
+            double dur = e.end - e.start;
+            fprintf(traceFile, ",\n");
+            switch (e.type) {
+            case TraceEvent::TASK:
+                fprintf(traceFile, "{\"name\":\"");
+                for (const char *c = e.name; *c != 0; ++c) {
+                    if (*c == '"' || *c == '\\') {
+                        fputc('\\', traceFile);
+                    }
+                    fputc(*c, traceFile);
+                }
+                fprintf(traceFile, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,", e.gpuTask ? "gpu" : "cpu", i, ts, dur);
+                fprintf(traceFile, "\"args\":{\"deadline\":%u,\"prefetch\":%s}}", e.deadline, e.deadline > 0 ? "true" : "false");
+                break;
+            case TraceEvent::SCHEDULE:
+                fprintf(traceFile, "{\"name\":\"schedule\",\"cat\":\"scheduler\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", i, ts, dur);
+                break;
+            case TraceEvent::WAIT:
+                fprintf(traceFile, "{\"name\":\"wait\",\"cat\":\"scheduler\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", i, ts, dur);
+                break;
+            case TraceEvent::CONTEXT_SWITCH:
+                fprintf(traceFile, "{\"name\":\"contextSwitch\",\"cat\":\"gpu\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", i, ts);
+                break;
+            }
+        }
+    }
+}
+
 ptr<Task> MultithreadScheduler::getTask(SortedTaskSet &s, void *previousContext)
 {
     SortedTaskSet::iterator i = s.begin();
@@ -785,6 +2402,88 @@ ptr<Task> MultithreadScheduler::getTask(SortedTaskSet &s, void *previousContext)
     return *(i->second.begin());
 }
 
+MultithreadScheduler::TaskNode *MultithreadScheduler::getNode(int index)
+{
+    return nodes[index / NODE_CHUNK_SIZE] + index % NODE_CHUNK_SIZE;
+}
+
+MultithreadScheduler::TaskNode *MultithreadScheduler::newNode(ptr<Task> t)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    int index;
+    if (freeNodes.empty()) {
+        index = nodeCount++;
+        if (index % NODE_CHUNK_SIZE == 0) {
+            assert(index / NODE_CHUNK_SIZE < MAX_NODE_CHUNKS);
+            nodes[index / NODE_CHUNK_SIZE] = new TaskNode[NODE_CHUNK_SIZE];
+        }
+    } else {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    TaskNode *n = getNode(index);
+    n->task = t;
+    n->pending = 1;
+    n->done = false;
+    n->record = -1;
+    t->schedulerIndex = index;
+    if (ork_atomic_load(&recording) != 0) {
+        // the class name is not available in release builds
+        string type = t->getClass();
+        if (type.empty()) {
+            type = t->getTypeInfo()->name();
+        }
+        map<string, int>::iterator i = recordTypes.find(type);
+        if (i == recordTypes.end()) {
+            i = recordTypes.insert(make_pair(type, int(record.types.size()))).first;
+            record.types.push_back(type);
+        }
+        Timer timer;
+        ScheduleRecord::TaskRecord r;
+        r.type = i->second;
+        r.deadline = t->getDeadline();
+        r.gpuTask = t->isGpuTask();
+        r.thread = -1;
+        r.release = (float) (timer.start() - recordStart);
+        r.start = 0.0f;
+        r.duration = 0.0f;
+        n->record = int(record.tasks.size());
+        record.tasks.push_back(r);
+    }
+    return n;
+}
+
+void MultithreadScheduler::deleteNode(ptr<Task> t)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    TaskNode *n = getNode(t->schedulerIndex);
+    ptr<ParallelForTask> p = t.cast<ParallelForTask>();
+    if (p != NULL) {
+        p->scheduler = NULL;
+    }
+    freeNodes.push_back(t->schedulerIndex);
+    t->schedulerIndex = -1;
+    n->task = NULL;
+    n->generation += 1;
+    n->successors.clear();
+    n->predecessors.clear();
+}
+
+bool MultithreadScheduler::insertReadyTask(ptr<Task> t)
+{
+    // NOTE: the mutex should be locked before calling this method!
+    insertTask(allReadyTasks, t);
+#ifdef STRICT_PREFETCH
+    if (!t->isGpuTask() && t->getDeadline() > 0) {
+#else
+    if (!t->isGpuTask()) {
+#endif
+        insertTask(readyCpuTasks, t);
+        return true;
+    }
+    return false;
+}
+
 void MultithreadScheduler::insertTask(SortedTaskSet &s, ptr<Task> t)
 {
     // computes the key for this task and inserts it
@@ -821,8 +2520,11 @@ public:
         int prefetchRate = 0;
         int prefetchQueue = 0;
         float frameRate = 0.0;
+        float percentile = 0.0f;
         int nthreads = 0;
-        checkParameters(desc, e, "name,prefetchRate,prefetchQueue,fps,nthreads,");
+        executionMode mode = GLOBAL_QUEUE;
+        priorityMode priority = SHORTEST_FIRST;
+        checkParameters(desc, e, "name,prefetchRate,prefetchQueue,prefetchBudget,fps,nthreads,workStealing,priority,durationPercentile,spinTime,cpus,mainCpu,");
         if (e->Attribute("prefetchRate") != NULL) {
             getIntParameter(desc, e, "prefetchRate", &prefetchRate);
         }
@@ -835,7 +2537,60 @@ public:
         if (e->Attribute("nthreads") != NULL) {
             getIntParameter(desc, e, "nthreads", &nthreads);
         }
-        init(prefetchRate, prefetchQueue, frameRate, nthreads);
+        if (e->Attribute("workStealing") != NULL && strcmp(e->Attribute("workStealing"), "true") == 0) {
+            mode = WORK_STEALING;
+        }
+        if (e->Attribute("priority") != NULL) {
+            if (strcmp(e->Attribute("priority"), "criticalPath") == 0) {
+                priority = CRITICAL_PATH;
+            } else if (strcmp(e->Attribute("priority"), "shortestFirst") != 0) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    log(Logger::ERROR_LOGGER, desc, e, "Bad 'priority' attribute");
+                }
+                throw exception();
+            }
+        }
+        if (e->Attribute("durationPercentile") != NULL) {
+            getFloatParameter(desc, e, "durationPercentile", &percentile);
+            if (percentile < 0.0f || percentile >= 100.0f) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    log(Logger::ERROR_LOGGER, desc, e, "Bad 'durationPercentile' attribute");
+                }
+                throw exception();
+            }
+        }
+        init(prefetchRate, prefetchQueue, frameRate, nthreads, mode, priority);
+        setDurationPercentile(percentile);
+        if (e->Attribute("spinTime") != NULL) {
+            float spinTime;
+            getFloatParameter(desc, e, "spinTime", &spinTime);
+            setSpinTime(spinTime);
+        }
+        if (e->Attribute("prefetchBudget") != NULL) {
+            int budget;
+            getIntParameter(desc, e, "prefetchBudget", &budget);
+            if (budget < 0) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    log(Logger::ERROR_LOGGER, desc, e, "Bad 'prefetchBudget' attribute");
+                }
+                throw exception();
+            }
+            setPrefetchBudget(budget);
+        }
+        if (e->Attribute("cpus") != NULL || e->Attribute("mainCpu") != NULL) {
+            vector<int> cpus;
+            int mainCpu = -1;
+            if (e->Attribute("cpus") != NULL && !parseCpuList(e->Attribute("cpus"), cpus)) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    log(Logger::ERROR_LOGGER, desc, e, "Bad 'cpus' attribute");
+                }
+                throw exception();
+            }
+            if (e->Attribute("mainCpu") != NULL) {
+                getIntParameter(desc, e, "mainCpu", &mainCpu);
+            }
+            setThreadAffinity(cpus, mainCpu);
+        }
     }
 };
 
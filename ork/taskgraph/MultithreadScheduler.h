@@ -27,12 +27,19 @@
 #include <vector>
 #include <set>
 #include <sstream>
+#include "ork/taskgraph/ParallelForTask.h"
+#include "ork/taskgraph/ResumableTask.h"
+#include "ork/taskgraph/ScheduleRecord.h"
 #include "ork/taskgraph/Scheduler.h"
 #include "ork/taskgraph/TaskGraph.h"
+#include "ork/taskgraph/TraceBuffer.h"
+#include "ork/taskgraph/WorkStealingQueue.h"
 
 namespace ork
 {
 
+class Timer;
+
 /**
  * A Scheduler that can use multiple threads. This scheduler can work with one
  * or more threads, and it can try to follow a fixed framerate (i.e. a number
@@ -44,11 +51,54 @@ namespace ork
  * Otherwise, if several threads are used, prefetching of cpu tasks is supported,
  * but not prefetching of gpu tasks.
  *
+ * The ready tasks can be distributed to the threads in two ways (see
+ * #executionMode). By default they are stored in sorted sets shared by all
+ * threads and protected by a single mutex. In work stealing mode each thread
+ * has its own queues of ready CPU tasks (one for the tasks of the current
+ * frame, which are taken first, and one for the prefetching tasks), and takes
+ * tasks from the queues of the other threads when its own queues are empty,
+ * without locking. The GPU tasks, which can only be executed by the main
+ * thread, are then stored in a separate sorted set that only the main thread
+ * drains. While the tasks for the current frame are not completed, the main
+ * thread also executes the ready CPU tasks for the current frame.
+ *
+ * The dependencies between the scheduled tasks are stored in a flattened
+ * graph, where each primitive task has a list of successors and an atomic
+ * count of its predecessors that are not completed yet. Completing a task
+ * then only requires a few atomic decrements. A ready task can get new
+ * predecessors with a later call to #schedule, until it is selected for
+ * execution: in work stealing mode its entry in the thread queues is then
+ * skipped, and a new entry is added when it becomes ready again. Note that a
+ * task that is being executed cannot get new predecessors.
+ *
  * @ingroup taskgraph
  */
 class ORK_API MultithreadScheduler : public Scheduler
 {
 public:
+    /**
+     * The possible ways to distribute the ready tasks to the threads.
+     */
+    enum executionMode {
+        GLOBAL_QUEUE, ///< all threads share the same sorted sets of ready tasks
+        WORK_STEALING ///< each thread has its own queue of ready CPU tasks, and steals tasks from the other threads
+    };
+
+    /**
+     * The possible ways to order the ready tasks that have the same deadline
+     * and execution context. SHORTEST_FIRST is the default. CRITICAL_PATH
+     * must be explicitly requested: it helps when a long chain of dependent
+     * tasks competes with many short independent tasks, but it costs a rank
+     * computation each time a graph is scheduled, and it does not help, or
+     * is even slightly slower, on wide graphs whose paths all have similar
+     * lengths. ScheduleRecord#simulate can compare both modes on a recorded
+     * workload.
+     */
+    enum priorityMode {
+        SHORTEST_FIRST, ///< tasks with the smallest expected duration first
+        CRITICAL_PATH ///< tasks with the largest upward rank first, i.e. the tasks on the longest path to the end of their task graph
+    };
+
     /**
      * Creates a new multithread scheduler.
      *
@@ -68,8 +118,14 @@ public:
      * @param nThreads the number of threads to use in addition to the main
      *      thread of the application. Hence 0 means that only one thread will
      *      be used, the main application thread.
+     * @param mode how the ready tasks are distributed to the threads. The
+     *      WORK_STEALING mode is only used if nThreads is not 0.
+     * @param priority how the ready tasks with the same deadline and execution
+     *      context are ordered (see #priorityMode). In CRITICAL_PATH mode the
+     *      upward rank of each task is computed from the expected durations
+     *      of the tasks when a task graph is scheduled.
      */
-    MultithreadScheduler(int prefetchRate = 0, int prefetchQueue = 0, float frameRate = 0.0f, int nThreads = 0);
+    MultithreadScheduler(int prefetchRate = 0, int prefetchQueue = 0, float frameRate = 0.0f, int nThreads = 0, executionMode mode = GLOBAL_QUEUE, priorityMode priority = SHORTEST_FIRST);
 
     /**
      * Deletes this scheduler.
@@ -87,6 +143,17 @@ public:
 
     virtual void schedule(ptr<Task> task);
 
+    /**
+     * Schedules several tasks at once. This is equivalent to calling
+     * #schedule for each task, but is faster: the tasks shared by several
+     * of the given tasks are initialized and added only once, the mutex of
+     * this scheduler is locked only once, and the execution threads are
+     * woken up only once.
+     *
+     * @param tasks some tasks or task graphs whose deadline is not immediate.
+     */
+    void scheduleBatch(const std::vector< ptr<Task> > &tasks);
+
     virtual void reschedule(ptr<Task> task, Task::reason r, unsigned int deadline);
 
     virtual void run(ptr<Task> task);
@@ -96,13 +163,124 @@ public:
      */
     void monitorTask(const std::string &taskType);
 
+    /**
+     * Starts recording an execution trace in the given file. The trace
+     * contains an event for each executed task, with the thread that executed
+     * it, its type, start and end times, deadline, and whether it is a GPU or
+     * CPU task, plus events for the scheduling of each frame, the context
+     * switches between GPU tasks, and the waits used to respect the fixed
+     * framerate. It is written in the Chrome Trace Event JSON format, and
+     * can be viewed with chrome://tracing or with the Perfetto UI. Each thread
+     * records its events in its own buffer, without locking; these buffers
+     * are written to the file by the main thread at the end of each frame.
+     * If a buffer is full, new events are dropped instead of blocking the
+     * thread.
+     *
+     * @param fileName the file where the trace must be written.
+     */
+    void startTrace(const std::string &fileName);
+
+    /**
+     * Stops the recording started with #startTrace, and closes the trace file.
+     */
+    void stopTrace();
+
+    /**
+     * Starts recording the scheduled tasks, their dependencies, and the
+     * thread, start time and duration of each executed task, in memory. The
+     * record can then be saved, and replayed or simulated offline with other
+     * scheduling policies (see ScheduleRecord). The tasks already scheduled
+     * when this method is called are not recorded. Recording locks the
+     * scheduler mutex once per executed task, and should only be used to
+     * analyze performance regressions.
+     */
+    void startRecording();
+
+    /**
+     * Stops the recording started with #startRecording.
+     *
+     * @param[out] record the recorded tasks. The tasks that were not
+     *      executed yet have a thread equal to -1.
+     */
+    void stopRecording(ScheduleRecord &record);
+
+    /**
+     * Sets how long the additional threads wait actively for new tasks,
+     * before they sleep until another thread signals new tasks. Active
+     * waiting avoids the latency of the sleep and wake up operations, but
+     * consumes processor time. Each thread adapts its active waiting time
+     * between spinTime / 16 and spinTime, depending on whether its previous
+     * active waits found new tasks or not.
+     *
+     * @param spinTime the maximum active waiting time in micro seconds, or 0
+     *      to sleep immediately when no task is ready (the default).
+     */
+    void setSpinTime(float spinTime);
+
+    /**
+     * Sets how the expected duration of the tasks of this scheduler is
+     * computed from the execution times of the previous tasks of the same
+     * type (see Task#getExpectedDuration). Only affects the tasks scheduled
+     * after this call.
+     *
+     * @param percentile 0 to use the mean execution time plus two standard
+     *      deviations (the default), or a percentile of the execution times,
+     *      strictly between 0 and 100.
+     */
+    void setDurationPercentile(float percentile);
+
+    /**
+     * Sets the maximum estimated memory cost (see Task#getMemoryCost) of the
+     * prefetching tasks admitted per frame, i.e. between two calls to #run.
+     * The prefetching tasks scheduled when this budget is exhausted are
+     * deferred, and admitted in the next frames in the order in which they
+     * were scheduled. If a budget is set, #supportsPrefetch returns false
+     * when it is exhausted, instead of using the prefetch queue size.
+     *
+     * @param budget the memory budget in bytes per frame, or 0 to admit all
+     *      prefetching tasks immediately (the default).
+     */
+    void setPrefetchBudget(int budget);
+
+    /**
+     * Pins the threads of this scheduler to some processors. The main thread,
+     * i.e. the thread that calls this method and #run, can be pinned to its
+     * own processor, reserved for it. The additional threads are pinned to
+     * the given processors, one processor per thread. In work stealing mode,
+     * an idle thread then steals tasks from the threads that share its L3
+     * cache (or its processor package if the cache topology is unknown)
+     * before the other threads. Since the tasks made ready by a thread are
+     * added to its own queue, tasks tend to stay close to the thread that
+     * produced their inputs. This method is only supported on Linux and
+     * Windows.
+     *
+     * @param cpus the processors of the additional threads, used in a round
+     *      robin way if there are more threads than processors. If empty,
+     *      the additional threads can use any processor except mainCpu.
+     * @param mainCpu the processor of the main thread, or -1 to not pin the
+     *      main thread.
+     * @return true if all the threads could be pinned.
+     */
+    bool setThreadAffinity(const std::vector<int> &cpus, int mainCpu = -1);
+
+    /**
+     * Returns the fraction of time spent by each thread executing tasks,
+     * since the previous call to this method. The execution time of the
+     * tasks is only measured after a first call to this method, or if a
+     * fixed framerate is used, or if a trace is recorded.
+     *
+     * @param[out] utilization the utilization of each thread, between 0 and
+     *      1. Index 0 is for the main thread.
+     */
+    void getThreadUtilization(std::vector<float> &utilization);
+
 protected:
     /**
      * Initializes this scheduler.
      *
      * See #MultithreadScheduler.
      */
-    void init(int prefetchRate, int prefetchQueue, float frameRate, int nThreads);
+    void init(int prefetchRate, int prefetchQueue, float frameRate, int nThreads, executionMode mode = GLOBAL_QUEUE, priorityMode priority = SHORTEST_FIRST);
 
 private:
     /**
@@ -124,14 +302,24 @@ private:
     };
 
     /**
-     * A sort operator for tasks. This operator is based on the expected
-     * duration of tasks, so that shorter tasks are executed first.
+     * A sort operator for tasks. This operator is based on the upward rank of
+     * tasks, if it has been computed (see #CRITICAL_PATH), and then on the
+     * expected duration of tasks, so that shorter tasks are executed first.
      */
     struct taskSort : public std::less< ptr<Task> >
     {
         bool operator()(const ptr<Task> x, const ptr<Task> y) const;
     };
 
+    /**
+     * A sort operator for tasks, equivalent to the order of tasks in a
+     * SortedTaskSet, i.e. based on #taskKeySort and then on #taskSort.
+     */
+    struct readyTaskSort : public std::less< ptr<Task> >
+    {
+        bool operator()(const ptr<Task> x, const ptr<Task> y) const;
+    };
+
     /**
      * A sorted task set, where tasks are sorted based on their deadline,
      * execution context and expected duration.
@@ -156,11 +344,159 @@ private:
      */
     void* cpuTasksCond;
 
+    /**
+     * A condition to signal to the threads executing ParallelForTask that
+     * all the chunks of a task may be completed (see #waitParallelFor).
+     */
+    void* parallelDoneCond;
+
     /**
      * The threads used to execute tasks, in addition to the main thread.
      */
     std::vector<void*> threads;
 
+    /**
+     * How the ready tasks are distributed to the threads.
+     */
+    executionMode mode;
+
+    /**
+     * How the ready tasks with the same deadline and execution context are
+     * ordered.
+     */
+    priorityMode priority;
+
+    /**
+     * A mutex used to ensure consistent access to #mainTasks and
+     * #injectedTasks, in work stealing mode.
+     */
+    void* laneMutex;
+
+    /**
+     * The ready tasks that only the main thread can execute, in work stealing
+     * mode. These are the GPU tasks and, if STRICT_PREFETCH is defined, the
+     * CPU tasks for the current frame.
+     */
+    SortedTaskSet mainTasks;
+
+    /**
+     * The ready CPU tasks added by #schedule, in work stealing mode. The
+     * threads take batches of tasks from this set when their queue is empty.
+     */
+    SortedTaskSet injectedTasks;
+
+    /**
+     * The queues of ready CPU tasks for the current frame of each thread, in
+     * work stealing mode. The first queue is the queue of the main thread.
+     * These queues do not own the tasks they contain: these tasks are
+     * referenced by #immediateTasks until they are completed.
+     */
+    std::vector<WorkStealingQueue<Task*>*> queues;
+
+    /**
+     * The queues of ready prefetching CPU tasks of each thread, in work
+     * stealing mode. They are separate from #queues so that the tasks for
+     * the current frame are always taken before the prefetching tasks, even
+     * if the latter became ready later. These tasks are referenced by
+     * #prefetchQueue until they are completed.
+     */
+    std::vector<WorkStealingQueue<Task*>*> prefetchQueues;
+
+    /**
+     * The number of additional threads waiting for CPU tasks on
+     * #cpuTasksCond.
+     */
+    volatile long sleepingThreads;
+
+    /**
+     * A counter incremented each time new ready CPU tasks are available. The
+     * additional threads that wait actively for new tasks watch this counter
+     * (see #spinWait).
+     */
+    volatile long cpuTasksVersion;
+
+    /**
+     * The maximum active waiting time of the additional threads (see
+     * #setSpinTime).
+     */
+    float spinTime;
+
+    /**
+     * The percentile used to compute the expected duration of the tasks of
+     * this scheduler, or 0 to use the mean plus two standard deviations (see
+     * #setDurationPercentile).
+     */
+    float durationPercentile;
+
+    /**
+     * The current active waiting time of each additional thread (index 0 is
+     * unused), between #spinTime / 16 and #spinTime.
+     */
+    std::vector<float> spinTimes;
+
+    /**
+     * For each thread, the other threads in the order in which it tries to
+     * steal their tasks, in work stealing mode. The list of thread i starts
+     * at index i * #threads.size(). Entries are overwritten in place by
+     * #setThreadAffinity, so that the threads can read them concurrently.
+     */
+    std::vector<int> victims;
+
+    /**
+     * True if the execution time of the tasks must be measured for
+     * #getThreadUtilization.
+     */
+    volatile long measureUtilization;
+
+    /**
+     * The total execution time of the tasks executed by a thread.
+     */
+    struct BusyTime
+    {
+        /**
+         * The total execution time, in micro seconds.
+         */
+        double time;
+
+        /**
+         * A spin lock used to ensure consistent access to #time, which is
+         * updated by its thread and read by #getThreadUtilization.
+         */
+        volatile long lock;
+
+        /**
+         * Padding to avoid false sharing between threads.
+         */
+        char padding[64 - sizeof(double) - sizeof(long)];
+    };
+
+    /**
+     * The total execution time of the tasks executed by each thread, with
+     * one entry per thread. Index 0 is for the main thread. Each thread only
+     * updates its own entry (see #addBusyTime).
+     */
+    BusyTime *busyTimes;
+
+    /**
+     * The values of #busyTimes at the last call to #getThreadUtilization.
+     */
+    std::vector<double> lastBusyTimes;
+
+    /**
+     * The time of the last call to #getThreadUtilization.
+     */
+    double lastUtilization;
+
+    /**
+     * True if the main thread is waiting for tasks, in work stealing mode.
+     */
+    volatile long mainThreadSleeping;
+
+    /**
+     * The size of #immediateTasks, which can be read without locking #mutex.
+     */
+    volatile long immediateCount;
+
     /**
      * Target frame duration in micro seconds, or 0 if no fixed framerate.
      */
@@ -180,6 +516,25 @@ private:
      */
     unsigned int prefetchQueueSize;
 
+    /**
+     * Maximum memory cost of the prefetching tasks admitted per frame, or 0
+     * if there is no limit (see #setPrefetchBudget). Written with #mutex
+     * locked, and read with an atomic load when the mutex is not locked.
+     */
+    volatile int prefetchBudget;
+
+    /**
+     * Memory cost of the prefetching tasks admitted since the start of the
+     * current frame.
+     */
+    int prefetchCost;
+
+    /**
+     * The tasks that could not be admitted because of #prefetchBudget, in the
+     * order in which they were scheduled.
+     */
+    std::vector< ptr<Task> > deferredTasks;
+
     /**
      * Time at the end of the last call to #run.
      */
@@ -198,7 +553,9 @@ private:
     bool stop;
 
     /**
-     * The primitive tasks that must be executed at the current frame.
+     * The primitive tasks that must be executed at the current frame. In
+     * work stealing mode tasks are removed from this set when they are
+     * completed, instead of when they are selected for execution.
      */
     std::set< ptr<Task> > immediateTasks;
 
@@ -215,20 +572,54 @@ private:
     SortedTaskSet readyCpuTasks;
 
     /**
-     * The predecessors of the tasks that remain to be executed.
+     * A primitive task that remains to be executed, with its dependencies.
      */
-    std::map< ptr<Task>, std::set< ptr<Task> > > dependencies;
+    struct TaskNode;
 
     /**
-     * The successors of the tasks that remain to be executed.
+     * The flattened graph of the primitive tasks that remain to be executed.
+     * Nodes are allocated by chunks, which are never moved or deleted before
+     * this scheduler is deleted, so that the execution threads can access
+     * them while new nodes are created. The index of the node of a task is
+     * stored in its Task#schedulerIndex field.
      */
-    std::map< ptr<Task>, std::set< ptr<Task> > > inverseDependencies;
+    TaskNode **nodes;
+
+    /**
+     * The number of nodes created so far in #nodes.
+     */
+    int nodeCount;
+
+    /**
+     * The indices of the unused nodes in #nodes.
+     */
+    std::vector<int> freeNodes;
+
+    /**
+     * The nodes whose number of pending predecessors has been incremented by
+     * #addFlattenedTask, to prevent them from becoming ready while a task
+     * is being scheduled.
+     */
+    std::vector<int> heldNodes;
 
     /**
      * The prefetching tasks that remain to be executed.
      */
     std::set< ptr<Task> > prefetchQueue;
 
+    /**
+     * The GPU tasks executed by the main thread whose asynchronous work is not
+     * completed yet (see Task#checkCompletion), with the result of their
+     * Task#run method. Only accessed by the main thread.
+     */
+    std::vector< std::pair<ptr<Task>, bool> > asyncTasks;
+
+    /**
+     * The ResumableTask waiting for the completion of other tasks, for each
+     * awaited task (see ResumableTask#await).
+     */
+    std::map< Task*, std::vector< ptr<Task> > > suspendedTasks;
+
     /**
      * The task classes whose execution time must be monitored (debug).
      */
@@ -258,24 +649,200 @@ private:
     FILE *statisticsFile;
 
     /**
-     * Adds all the primitive tasks of the given task to the set of tasks to be
-     * executed. This method calls itself recursively on any TaskGraph, in order
+     * True if an execution trace is being recorded (see #startTrace).
+     */
+    volatile long tracing;
+
+    /**
+     * The buffers where each thread records its trace events (index 0 is for
+     * the main thread). Created by the first call to #startTrace.
+     */
+    std::vector<TraceBuffer*> traceBuffers;
+
+    /**
+     * File where the trace events are written, or NULL if no trace is recorded.
+     */
+    FILE *traceFile;
+
+    /**
+     * The time at which the recording of the trace started.
+     */
+    double traceStart;
+
+    /**
+     * True if the scheduled tasks are being recorded (see #startRecording).
+     */
+    volatile long recording;
+
+    /**
+     * The tasks recorded since the last call to #startRecording.
+     */
+    ScheduleRecord record;
+
+    /**
+     * The indices of the task types in ScheduleRecord#types.
+     */
+    std::map<std::string, int> recordTypes;
+
+    /**
+     * The time at which the recording started.
+     */
+    double recordStart;
+
+    /**
+     * The ParallelForTask being executed, in the order in which their
+     * execution started. The idle additional threads help executing the
+     * chunks of these tasks (see ParallelForTask#run).
+     */
+    std::vector<ParallelForTask*> parallelTasks;
+
+    /**
+     * The number of tasks in #parallelTasks.
+     */
+    volatile long parallelCount;
+
+    /**
+     * Returns the node of #nodes whose index is given.
+     */
+    TaskNode *getNode(int index);
+
+    /**
+     * Creates a new node for the given primitive task, and sets its
+     * Task#schedulerIndex accordingly.
+     */
+    TaskNode *newNode(ptr<Task> t);
+
+    /**
+     * Deletes the node of the given task, and resets its Task#schedulerIndex.
+     */
+    void deleteNode(ptr<Task> t);
+
+    /**
+     * Adds a task whose predecessors are all completed to #allReadyTasks, and
+     * to #readyCpuTasks if needed. Only used in global queue mode.
+     *
+     * @return true if the task was added to #readyCpuTasks.
+     */
+    bool insertReadyTask(ptr<Task> t);
+
+    /**
+     * Returns the flattened form of the given task graph. This flattened form
+     * is computed with #flattenTask, and is reused until the structure of the
+     * graph or of one of its sub graphs changes.
+     */
+    TaskGraph::FlattenedGraph *getFlattenedGraph(ptr<TaskGraph> tg);
+
+    /**
+     * Adds all the primitive tasks of the given task to the given flattened
+     * graph. This method calls itself recursively on any TaskGraph, in order
      * to find all the primitive tasks, whatever their level of nesting inside
-     * task graphs. It also creates all the needed dependencies with
-     * #addFlattenedDependency.
+     * task graphs. It also adds all the needed dependencies with
+     * #flattenDependency.
      *
      * @param t the task whose primitive sub tasks must be added.
-     * @param[in,out] addedTasks the already added tasks. This method adds the
-     *      tasks it adds to this set.
+     * @param[in,out] g the flattened graph to which tasks must be added.
+     * @param[in,out] indices the already added tasks, with their index in
+     *      g.tasks (or -1 for task graphs). This method adds the tasks it adds
+     *      to this map.
      */
-    void addFlattenedTask(ptr<Task> t, std::set< ptr<Task> > &addedTasks);
+    void flattenTask(ptr<Task> t, TaskGraph::FlattenedGraph &g, std::map<Task*, int> &indices);
 
     /**
-     * Adds all the primitive dependencies between the primitive first tasks of
-     * src and the primitive last tasks of dst.
+     * Adds to the given flattened graph all the primitive dependencies between
+     * the primitive first tasks of src and the primitive last tasks of dst.
      *
      * @param src a task that must be executed after dst.
      * @param dst a task that must be execute before src.
+     * @param[in,out] g the flattened graph to which dependencies must be added.
+     * @param indices the index of each primitive task in g.tasks.
+     */
+    void flattenDependency(ptr<Task> src, ptr<Task> dst, TaskGraph::FlattenedGraph &g, std::map<Task*, int> &indices);
+
+    /**
+     * Computes the reverse topological order and the successors of the tasks
+     * of the given flattened graph, if they are not already computed.
+     */
+    void computeOrder(TaskGraph::FlattenedGraph &g);
+
+    /**
+     * Computes the upward rank of the given tasks of the given flattened
+     * graph. The rank of a task is its expected duration (at least one micro
+     * second, so that the rank of tasks without statistics is the number of
+     * tasks on their longest path) plus the maximum rank of its successors.
+     *
+     * @param g a flattened graph.
+     * @param newTasks the tasks of g whose rank must be set. The other tasks
+     *      may be in sorted task sets, so their rank must not change.
+     */
+    void computeRanks(TaskGraph::FlattenedGraph &g, const std::vector<bool> &newTasks);
+
+    /**
+     * Adds a task or task graph to the set of tasks to be executed, without
+     * checking the prefetch budget (see #schedule).
+     */
+    void scheduleTask(ptr<Task> task);
+
+    /**
+     * Adds several tasks or task graphs to the set of tasks to be executed,
+     * without checking the prefetch budget (see #scheduleBatch).
+     */
+    void scheduleTasks(const std::vector< ptr<Task> > &tasks);
+
+    /**
+     * Adds the primitive tasks of a task or task graph, and their
+     * dependencies, to the flattened graph of the tasks to be executed. The
+     * nodes of these tasks are held until #releaseHeldNodes is called. The
+     * mutex must be locked before calling this method.
+     *
+     * @param task a task or task graph.
+     * @param added the primitive tasks already added by the previous calls
+     *      to this method, which are not added again, or NULL.
+     */
+    void addTask(ptr<Task> task, std::set<Task*> *added);
+
+    /**
+     * Releases the nodes held by #addTask, and signals the new ready tasks
+     * to the execution threads. The mutex must be locked before calling this
+     * method, and is unlocked by this method.
+     */
+    void releaseHeldNodes();
+
+    /**
+     * Returns true if the given task can be scheduled at this frame, given
+     * the prefetch budget and the cost of the tasks already admitted at this
+     * frame. Otherwise adds the task to #deferredTasks.
+     *
+     * @param task a task or task graph.
+     */
+    bool admitTask(ptr<Task> task);
+
+    /**
+     * Returns the memory cost of the primitive tasks of the given task that
+     * are not completed. The mutex must be locked before calling this method.
+     *
+     * @param task a task or task graph.
+     * @param[out] immediate set to true if the given task contains tasks that
+     *      must be executed at the current frame.
+     */
+    int getMemoryCost(ptr<Task> task, bool &immediate);
+
+    /**
+     * Adds a primitive task to the set of tasks to be executed. This creates
+     * a node for this task, or holds its existing node if the task has
+     * already been scheduled (see #heldNodes).
+     *
+     * @param t a primitive task that is not completed.
+     * @return true if a new node has been created for this task.
+     */
+    bool addFlattenedTask(ptr<Task> t);
+
+    /**
+     * Adds a dependency between two primitive tasks that have been added with
+     * #addFlattenedTask. The dependency is ignored if dst is already
+     * completed, or if src is already ready to be executed.
+     *
+     * @param src a primitive task that must be executed after dst.
+     * @param dst a primitive task that must be execute before src.
      */
     void addFlattenedDependency(ptr<Task> src, ptr<Task> dst);
 
@@ -293,28 +860,250 @@ private:
 
     /**
      * Updates the data structures after the execution of a task. This method
-     * removes the given task from #dependencies and #inverseDependencies. This
-     * can make new tasks ready to be executed, which are then added to
-     * #allReadyTasks and #readyCpuTasks. Finally t.setIsDone(true) is called.
+     * decrements the number of pending predecessors of the successors of the
+     * given task, and deletes its node. This can make new tasks ready to be
+     * executed, which are then added to
+     * #allReadyTasks and #readyCpuTasks (or to the queues of the threads, in
+     * work stealing mode). Finally t.setIsDone(true) is called.
      *
      * @param t a completed task.
      * @param changes true if the task execution changed the result of its
      *      previous execution.
+     * @param thread the index of the thread that executed t (0 for the main
+     *      thread).
+     */
+    void taskDone(ptr<Task> t, bool changes, int thread);
+
+    /**
+     * Suspends a ResumableTask until the task it awaits is completed. This
+     * schedules the awaited task if necessary, and adds the given task to
+     * #suspendedTasks, or to the ready tasks if the awaited task is already
+     * completed.
+     *
+     * @param t a ResumableTask whose last step called ResumableTask#await.
+     * @param thread the index of the calling thread.
      */
-    void taskDone(ptr<Task> t, bool changes);
+    void suspendTask(ptr<ResumableTask> t, int thread);
+
+    /**
+     * Calls #taskDone for the tasks of #asyncTasks whose asynchronous work is
+     * completed, and removes them from this list. Main thread only.
+     *
+     * @param wait true to wait until the work of the first task of
+     *      #asyncTasks is completed.
+     */
+    void completeAsyncTasks(bool wait);
+
+    /**
+     * Returns true if the given task can be executed as a prefetching task,
+     * given the number of prefetching tasks already executed at this frame
+     * and the time remaining until the deadline for the current frame.
+     *
+     * @param t a task whose deadline is not 0.
+     * @param prefetched the number of prefetching tasks executed at this frame.
+     * @param deadline the deadline for the end of the current frame.
+     * @param timer the timer used to measure the current time.
+     */
+    bool canPrefetch(ptr<Task> t, int prefetched, double deadline, Timer &timer);
+
+    /**
+     * Returns the next task that the main thread must execute, waiting for
+     * one if necessary. Returns NULL if the main thread must stop executing
+     * tasks for the current frame. This is the global queue version.
+     *
+     * @param timer the timer used to measure the current time.
+     * @param deadline the deadline for the end of the current frame.
+     * @param prefetched the number of prefetching tasks executed at this frame.
+     * @param previousContext the execution context of the last GPU task.
+     */
+    ptr<Task> nextTask(Timer &timer, double deadline, int prefetched, void *previousContext);
+
+    /**
+     * Work stealing version of #nextTask.
+     */
+    ptr<Task> nextTaskWorkStealing(Timer &timer, double deadline, int prefetched, void *previousContext);
+
+    /**
+     * Returns the next task that an additional thread must execute, waiting
+     * for one if necessary. Returns NULL if the scheduler is being deleted.
+     * This is the global queue version.
+     *
+     * @param thread the index of the calling thread.
+     */
+    ptr<Task> nextCpuTask(int thread);
+
+    /**
+     * Work stealing version of #nextCpuTask.
+     *
+     * @param thread the index of the calling thread.
+     */
+    ptr<Task> nextCpuTaskWorkStealing(int thread);
+
+    /**
+     * Returns a CPU task from the queue of the given thread or, if it is
+     * empty, from #injectedTasks or from the queues of the other threads.
+     * The tasks for the current frame are searched first, in #queues, and
+     * then the prefetching tasks, in #prefetchQueues. Returns NULL if no
+     * such task is found. Work stealing mode only.
+     *
+     * @param thread the index of the calling thread.
+     * @param immediateOnly true to only search tasks for the current frame.
+     */
+    ptr<Task> getCpuTask(int thread, bool immediateOnly);
+
+    /**
+     * Returns true if there are ready CPU tasks in the thread queues or in
+     * #injectedTasks. Work stealing mode only.
+     *
+     * @param immediateOnly true to only search tasks for the current frame.
+     */
+    bool hasCpuTasks(bool immediateOnly);
+
+    /**
+     * Returns the queue of the given thread where the given ready CPU task
+     * must be added, i.e. its queue in #queues or in #prefetchQueues,
+     * depending on the task deadline. Work stealing mode only.
+     */
+    WorkStealingQueue<Task*> *getQueue(int thread, const ptr<Task> &t);
+
+    /**
+     * Adds new ready tasks to #mainTasks, to the queue of the given thread or
+     * to #injectedTasks, and wakes up the threads waiting for tasks.
+     * Work stealing mode only.
+     *
+     * @param tasks some new ready tasks. This vector is sorted by this method.
+     * @param thread the index of the calling thread, or -1 if this thread is
+     *      not a thread of this scheduler.
+     */
+    void pushReadyTasks(std::vector< ptr<Task> > &tasks, int thread);
+
+    /**
+     * Wakes up the main thread if it is waiting for tasks, and as many
+     * additional threads waiting for CPU tasks as there are new ready CPU
+     * tasks. Work stealing mode only.
+     *
+     * @param cpuTasks the number of new ready CPU tasks.
+     */
+    void wakeUpThreads(int cpuTasks);
+
+    /**
+     * Wakes up as many additional threads waiting for CPU tasks as there are
+     * new ready CPU tasks. The mutex must be locked before calling this
+     * method. Global queue mode only.
+     *
+     * @param cpuTasks the number of new ready CPU tasks.
+     */
+    void signalCpuThreads(int cpuTasks);
+
+    /**
+     * Waits actively until new ready CPU tasks are available, or until the
+     * active waiting time of the given thread is elapsed. This waiting time
+     * is doubled if new tasks are found, and halved otherwise.
+     *
+     * @param thread the index of the calling thread.
+     * @param version the value of #cpuTasksVersion when the calling thread
+     *      last found no ready CPU tasks.
+     * @return true if new tasks may be available.
+     */
+    bool spinWait(int thread, long version);
 
     /**
      * The method executed by the additional threads of this scheduler. This
      * method contains an infinite loop that executes tasks when they are ready
      * to be executed. The method returns only when #stop is set to true.
+     *
+     * @param thread the index of this thread (from 1 to the number of
+     *      additional threads).
+     */
+    void schedulerThread(int thread);
+
+    /**
+     * Adds a ParallelForTask to #parallelTasks, and wakes up the additional
+     * threads so that they can help executing it. Called by the thread that
+     * executes this task.
+     */
+    void startParallelFor(ParallelForTask *t);
+
+    /**
+     * Removes a ParallelForTask from #parallelTasks. Called by the thread
+     * that executes this task, when all its chunks have been assigned.
+     */
+    void stopParallelFor(ParallelForTask *t);
+
+    /**
+     * Waits until all the chunks of a ParallelForTask are completed. Called
+     * by the thread that executes this task, after it has actively waited
+     * for a short time, so that it does not keep a processor busy while
+     * other threads complete long chunks.
+     */
+    void waitParallelFor(ParallelForTask *t);
+
+    /**
+     * Returns true if a task of #parallelTasks has chunks that are not
+     * assigned yet. The mutex must be locked before calling this method.
+     */
+    bool hasParallelChunks();
+
+    /**
+     * Executes some chunks of the first task of #parallelTasks that has
+     * chunks that are not assigned yet, if any.
+     *
+     * @param thread the index of the calling thread.
+     * @return true if at least one chunk was executed.
+     */
+    bool helpParallelFor(int thread);
+
+    /**
+     * Adds a task execution time to the #busyTimes of a thread.
+     *
+     * @param thread the index of the calling thread.
+     * @param time an execution time in micro seconds.
      */
-    void schedulerThread();
+    void addBusyTime(int thread, double time);
 
     /**
      * Writes the buffered frame statistics to the statisticsFile.
      */
     void clearBufferedFrames();
 
+    /**
+     * Records a trace event in the buffer of the given thread.
+     *
+     * @param thread the thread that produced the event (0 for the main thread).
+     * @param type the event type.
+     * @param t the executed task, for TASK events, or NULL.
+     * @param start the start time of the event.
+     * @param end the end time of the event.
+     */
+    void trace(int thread, TraceEvent::eventType type, ptr<Task> t, double start, double end);
+
+    /**
+     * Returns the name of the class of the given task.
+     */
+    static const char *getTaskName(const ptr<Task> &t);
+
+    /**
+     * Executes the given task, in a Profiler scope named after its class.
+     *
+     * @return the result of Task#run.
+     */
+    static bool runTask(const ptr<Task> &t);
+
+    /**
+     * Writes the events recorded in #traceBuffers to #traceFile.
+     */
+    void flushTrace();
+
+    /**
+     * Records the execution of the given task (see #startRecording).
+     *
+     * @param t an executed task.
+     * @param thread the thread that executed it (0 for the main thread).
+     * @param start the start time of its execution.
+     * @param duration its execution time.
+     */
+    void recordTask(ptr<Task> t, int thread, double start, double duration);
+
     /**
      * Static method needed by pthread to launch a thread. This method just
      * calls #schedulerThread on the MultithreadScheduler passed as argument.
@@ -350,6 +1139,8 @@ private:
      * @return true if the set contained t.
      */
     static bool removeTask(SortedTaskSet &s, ptr<Task> t);
+
+    friend class ParallelForTask;
 };
 
 }
@@ -0,0 +1,103 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/taskgraph/ParallelForTask.h"
+
+#include <algorithm>
+
+#include "ork/core/Atomic.h"
+#include "ork/taskgraph/MultithreadScheduler.h"
+
+using namespace std;
+
+namespace ork
+{
+
+ParallelForTask::ParallelForTask(const char *type, int begin, int end, int grain, unsigned int deadline) :
+    Task(type, false, deadline), begin(begin), end(end), grain(max(grain, 1)),
+    next(end), pending(0), changed(0), scheduler(NULL), threads(1)
+{
+}
+
+ParallelForTask::~ParallelForTask()
+{
+}
+
+int ParallelForTask::getComplexity() const
+{
+    return max(end - begin, 1);
+}
+
+bool ParallelForTask::run()
+{
+    // the pending count must be set before the chunks can be assigned, i.e.
+    // before #next is reset, so that threads still holding this task from a
+    // previous execution cannot see a completed range
+    ork_atomic_store(&changed, 0L);
+    ork_atomic_store(&pending, long(end - begin));
+    ork_atomic_store(&next, long(begin));
+    MultithreadScheduler *s = scheduler;
+    if (s != NULL) {
+        s->startParallelFor(this);
+    }
+    runChunks();
+    if (s != NULL) {
+        s->stopParallelFor(this);
+    }
+    // the chunks assigned to other threads may not be completed yet; they
+    // are generally small, so we first wait actively for a short time, and
+    // then sleep until the thread that completes the last chunk wakes us up
+    for (int i = 0; i < SPIN_COUNT && ork_atomic_load(&pending) > 0; ++i) {
+        cpu_relax();
+    }
+    if (s != NULL && ork_atomic_load(&pending) > 0) {
+        s->waitParallelFor(this);
+    }
+    return ork_atomic_load(&changed) != 0;
+}
+
+bool ParallelForTask::runChunks()
+{
+    bool executed = false;
+    while (true) {
+        long first = ork_atomic_load(&next);
+        if (first >= end) {
+            break;
+        }
+        // if this task is cancelled, all the remaining chunks are skipped
+        bool cancelled = isCancelled();
+        long size = max(long(grain), (end - first) / (2 * threads));
+        long last = cancelled ? long(end) : min(first + size, long(end));
+        if (!atomic_compare_and_swap(&next, first, last)) {
+            continue;
+        }
+        if (!cancelled && runRange(int(first), int(last))) {
+            ork_atomic_store(&changed, 1L);
+        }
+        atomic_exchange_and_add(&pending, first - last);
+        executed = true;
+    }
+    return executed;
+}
+
+}
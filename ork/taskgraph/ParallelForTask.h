@@ -0,0 +1,153 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_PARALLEL_FOR_TASK_H_
+#define _ORK_PARALLEL_FOR_TASK_H_
+
+#include "ork/taskgraph/Task.h"
+
+namespace ork
+{
+
+class MultithreadScheduler;
+
+/**
+ * An abstract CPU task that executes the same code on each element of a range
+ * of indices [begin,end). The range is split in chunks of at least grain
+ * indices, which are executed with #runRange. When this task is executed
+ * by a MultithreadScheduler, the execution threads that are idle help the
+ * thread that executes this task, by executing some chunks of the range in
+ * parallel. This task still counts as a single task for the dependencies and
+ * the execution time statistics (its complexity is the size of its range).
+ * The #runRange method must therefore be thread safe.
+ *
+ * @ingroup taskgraph
+ */
+class ORK_API ParallelForTask : public Task
+{
+public:
+    /**
+     * Creates a new parallel for task.
+     *
+     * @param type the type of the task.
+     * @param begin the first index of the range of this task.
+     * @param end the index after the last index of the range of this task.
+     * @param grain the minimum number of indices of each chunk.
+     * @param deadline the frame number before which the task must be executed.
+     *      0 means that the task must be executed immediately.
+     */
+    ParallelForTask(const char *type, int begin, int end, int grain, unsigned int deadline);
+
+    /**
+     * Deletes this parallel for task.
+     */
+    virtual ~ParallelForTask();
+
+    /**
+     * Returns the size of the range of this task.
+     */
+    virtual int getComplexity() const;
+
+    /**
+     * Executes all the chunks of this task, with the help of the idle threads
+     * of the scheduler that executes this task, if any. Returns when all the
+     * chunks are completed.
+     *
+     * @return true if the execution of a chunk changed the result of this task.
+     */
+    virtual bool run();
+
+protected:
+    /**
+     * Executes this task on a chunk of its range. This method can be called
+     * concurrently from several threads, on distinct chunks.
+     *
+     * @param begin the first index of the chunk.
+     * @param end the index after the last index of the chunk.
+     * @return true if the result of this task has changed.
+     */
+    virtual bool runRange(int begin, int end) = 0;
+
+private:
+    /**
+     * The maximum number of iterations during which #run waits actively for
+     * the chunks executed by other threads, before sleeping.
+     */
+    static const int SPIN_COUNT = 2000;
+
+    /**
+     * The first index of the range of this task.
+     */
+    int begin;
+
+    /**
+     * The index after the last index of the range of this task.
+     */
+    int end;
+
+    /**
+     * The minimum number of indices of each chunk.
+     */
+    int grain;
+
+    /**
+     * The first index of the range that has not been assigned to a thread.
+     */
+    volatile long next;
+
+    /**
+     * The number of indices that have not been executed yet.
+     */
+    volatile long pending;
+
+    /**
+     * 1 if the execution of a chunk has changed the result of this task.
+     */
+    volatile long changed;
+
+    /**
+     * The scheduler that executes this task, or NULL.
+     */
+    MultithreadScheduler *scheduler;
+
+    /**
+     * The number of threads of #scheduler (at least one).
+     */
+    int threads;
+
+    /**
+     * Executes chunks of the range of this task until all the chunks are
+     * assigned to a thread. The chunks are large at the beginning, and get
+     * smaller as the range gets consumed, down to #grain indices, to balance
+     * the load between threads.
+     *
+     * @return true if at least one chunk has been executed.
+     */
+    bool runChunks();
+
+    friend class MultithreadScheduler;
+};
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/taskgraph/ResumableTask.h"
+
+#include <cassert>
+
+#include "ork/taskgraph/TaskGraph.h"
+
+namespace ork
+{
+
+ResumableTask::ResumableTask(const char *type, unsigned int deadline) :
+    Task(type, false, deadline), step(0), awaited(NULL), changed(false)
+{
+}
+
+ResumableTask::~ResumableTask()
+{
+}
+
+bool ResumableTask::run()
+{
+    awaited = NULL;
+    changed = resume() || changed;
+    if (awaited != NULL) {
+        // this task is not completed, its result is not used by the scheduler
+        return false;
+    }
+    bool result = changed;
+    changed = false;
+    step = 0;
+    return result;
+}
+
+void ResumableTask::await(ptr<Task> t)
+{
+    assert(awaited == NULL);
+    assert(t.cast<TaskGraph>() == NULL);
+    awaited = t;
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_RESUMABLE_TASK_H_
+#define _ORK_RESUMABLE_TASK_H_
+
+#include "ork/taskgraph/Task.h"
+
+namespace ork
+{
+
+class MultithreadScheduler;
+
+/**
+ * An abstract CPU task that executes in several steps, and that can wait for
+ * the completion of other tasks between these steps, without blocking the
+ * thread that executes it. Each step is executed by a call to #resume, which
+ * can call #await before returning to wait for another task. In this case
+ * the MultithreadScheduler that executes this task schedules the awaited
+ * task, and calls #resume again, possibly in another thread, when this task
+ * is completed. The successors of this task are executed only after the last
+ * step, i.e. after the first call to #resume that does not call #await. For
+ * instance a task that loads and decodes some data can await a task that
+ * reads a file, and then a task that decodes its content:
+ *
+ * \code
+ * bool resume()
+ * {
+ *     switch (step) {
+ *     case 0:
+ *         read = new ReadFileTask(fileName);
+ *         step = 1;
+ *         await(read);
+ *         return false;
+ *     case 1:
+ *         decode = new DecodeTask(read->getData());
+ *         step = 2;
+ *         await(decode);
+ *         return false;
+ *     }
+ *     return true;
+ * }
+ * \endcode
+ *
+ * @ingroup taskgraph
+ */
+class ORK_API ResumableTask : public Task
+{
+public:
+    /**
+     * Creates a new resumable task.
+     *
+     * @param type the type of the task.
+     * @param deadline the frame number before which the task must be executed.
+     *      0 means that the task must be executed immediately.
+     */
+    ResumableTask(const char *type, unsigned int deadline);
+
+    /**
+     * Deletes this task.
+     */
+    virtual ~ResumableTask();
+
+    /**
+     * Executes the current step of this task with #resume.
+     *
+     * @return if this task is completed, true if the result of one of its
+     *      steps has changed (see Task#run).
+     */
+    virtual bool run();
+
+protected:
+    /**
+     * The current step of this task. This step is 0 when the execution of
+     * this task starts, and is then managed by #resume. It is reset to 0
+     * when this task is completed.
+     */
+    int step;
+
+    /**
+     * Executes the current step of this task.
+     *
+     * @return true if the result of this task has changed (see Task#run).
+     */
+    virtual bool resume() = 0;
+
+    /**
+     * Suspends this task until the given task is completed. This method must
+     * be called at the end of #resume, and at most once per step.
+     *
+     * @param t a primitive task. If it is not completed, it is scheduled for
+     *      execution with the deadline of this task, if it is earlier than
+     *      its own deadline.
+     */
+    void await(ptr<Task> t);
+
+private:
+    /**
+     * The task awaited by the current step, or NULL.
+     */
+    ptr<Task> awaited;
+
+    /**
+     * True if the result of one of the steps executed so far has changed.
+     */
+    bool changed;
+
+    friend class MultithreadScheduler;
+};
+
+}
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "ork/taskgraph/ScheduleRecord.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+#include "ork/core/Object.h"
+
+using namespace std;
+
+namespace ork
+{
+
+/**
+ * The first bytes of a schedule record file.
+ */
+static const char RECORD_MAGIC[8] = { 'O', 'R', 'K', 'S', 'C', 'H', 'E', '1' };
+
+template<typename T>
+static void write(FILE *f, const T &value)
+{
+    fwrite(&value, sizeof(T), 1, f);
+}
+
+template<typename T>
+static bool read(FILE *f, T &value)
+{
+    return fread(&value, sizeof(T), 1, f) == 1;
+}
+
+ScheduleRecord::ScheduleRecord() : threads(1)
+{
+}
+
+void ScheduleRecord::clear()
+{
+    types.clear();
+    tasks.clear();
+    dependencies.clear();
+    frames.clear();
+    threads = 1;
+}
+
+bool ScheduleRecord::save(const string &fileName) const
+{
+    FILE *f;
+    fopen(&f, fileName.c_str(), "wb");
+    if (f == NULL) {
+        return false;
+    }
+    fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC), f);
+    write(f, threads);
+    write(f, int(types.size()));
+    for (unsigned int i = 0; i < types.size(); ++i) {
+        write(f, int(types[i].size()));
+        fwrite(types[i].c_str(), 1, types[i].size(), f);
+    }
+    write(f, int(frames.size()));
+    for (unsigned int i = 0; i < frames.size(); ++i) {
+        write(f, frames[i]);
+    }
+    write(f, int(tasks.size()));
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+        const TaskRecord &t = tasks[i];
+        write(f, t.type);
+        write(f, t.deadline);
+        write(f, char(t.gpuTask ? 1 : 0));
+        write(f, t.thread);
+        write(f, t.release);
+        write(f, t.start);
+        write(f, t.duration);
+    }
+    write(f, int(dependencies.size()));
+    for (unsigned int i = 0; i < dependencies.size(); ++i) {
+        write(f, dependencies[i].first);
+        write(f, dependencies[i].second);
+    }
+    bool ok = ferror(f) == 0;
+    fclose(f);
+    return ok;
+}
+
+bool ScheduleRecord::load(const string &fileName)
+{
+    clear();
+    FILE *f;
+    fopen(&f, fileName.c_str(), "rb");
+    if (f == NULL) {
+        return false;
+    }
+    char magic[sizeof(RECORD_MAGIC)];
+    bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic);
+    ok = ok && memcmp(magic, RECORD_MAGIC, sizeof(magic)) == 0;
+    ok = ok && read(f, threads);
+    int n = 0;
+    ok = ok && read(f, n);
+    for (int i = 0; ok && i < n; ++i) {
+        int size = 0;
+        ok = read(f, size) && size >= 0;
+        if (ok) {
+            vector<char> name(size + 1, 0);
+            ok = int(fread(&name[0], 1, size, f)) == size;
+            types.push_back(string(&name[0]));
+        }
+    }
+    ok = ok && read(f, n);
+    for (int i = 0; ok && i < n; ++i) {
+        float frame;
+        ok = read(f, frame);
+        frames.push_back(frame);
+    }
+    ok = ok && read(f, n);
+    for (int i = 0; ok && i < n; ++i) {
+        TaskRecord t;
+        char gpuTask = 0;
+        ok = read(f, t.type) && read(f, t.deadline) && read(f, gpuTask) && read(f, t.thread);
+        ok = ok && read(f, t.release) && read(f, t.start) && read(f, t.duration);
+        t.gpuTask = gpuTask != 0;
+        tasks.push_back(t);
+    }
+    ok = ok && read(f, n);
+    for (int i = 0; ok && i < n; ++i) {
+        pair<int, int> d;
+        ok = read(f, d.first) && read(f, d.second);
+        ok = ok && d.first >= 0 && d.first < int(tasks.size());
+        ok = ok && d.second >= 0 && d.second < int(tasks.size());
+        dependencies.push_back(d);
+    }
+    fclose(f);
+    if (!ok) {
+        clear();
+    }
+    return ok;
+}
+
+float ScheduleRecord::simulate(int threads, policy p, vector<TaskRecord> *schedule) const
+{
+    int n = int(tasks.size());
+    if (p == RECORDED) {
+        threads = this->threads;
+    }
+    threads = max(threads, 1);
+    // the successors and the number of predecessors of each task
+    vector< vector<int> > successors(n);
+    vector<int> pending(n, 0);
+    for (unsigned int i = 0; i < dependencies.size(); ++i) {
+        successors[dependencies[i].second].push_back(dependencies[i].first);
+        pending[dependencies[i].first] += 1;
+    }
+    // the priority of each task: the lower the better
+    vector<float> priority(n, 0.0f);
+    if (p == RECORDED) {
+        for (int i = 0; i < n; ++i) {
+            priority[i] = tasks[i].start;
+        }
+    } else if (p == SHORTEST_FIRST) {
+        for (int i = 0; i < n; ++i) {
+            priority[i] = tasks[i].thread >= 0 ? tasks[i].duration : 0.0f;
+        }
+    } else {
+        // upward ranks, computed in reverse topological order
+        vector<int> count(n, 0);
+        vector<int> order;
+        for (int i = 0; i < n; ++i) {
+            count[i] = int(successors[i].size());
+            if (count[i] == 0) {
+                order.push_back(i);
+            }
+        }
+        vector< vector<int> > predecessors(n);
+        for (unsigned int i = 0; i < dependencies.size(); ++i) {
+            predecessors[dependencies[i].first].push_back(dependencies[i].second);
+        }
+        for (unsigned int i = 0; i < order.size(); ++i) {
+            int t = order[i];
+            float rank = 0.0f;
+            for (unsigned int j = 0; j < successors[t].size(); ++j) {
+                rank = max(rank, -priority[successors[t][j]]);
+            }
+            priority[t] = -(rank + (tasks[t].thread >= 0 ? tasks[t].duration : 0.0f));
+            for (unsigned int j = 0; j < predecessors[t].size(); ++j) {
+                if (--count[predecessors[t][j]] == 0) {
+                    order.push_back(predecessors[t][j]);
+                }
+            }
+        }
+    }
+
+    // the ready tasks that only the main thread can execute, and the others,
+    // sorted by deadline and priority; with the RECORDED policy, the ready
+    // tasks of each thread are in a separate set
+    typedef set< pair< pair<unsigned int, float>, int > > ReadySet;
+    vector<ReadySet> ready(p == RECORDED ? threads : 2);
+    // the tasks whose predecessors are completed, but not yet released
+    set< pair<float, int> > released;
+    // the end of the current task of each thread, or -1 if idle
+    vector<float> busyUntil(threads, -1.0f);
+    vector<int> running(threads, -1);
+    vector<TaskRecord> result(tasks);
+    // with the RECORDED policy, tasks are not started before their recorded
+    // start time, so that the recorded schedule is reproduced exactly
+    vector<float> release(n);
+    for (int i = 0; i < n; ++i) {
+        release[i] = p == RECORDED && tasks[i].thread >= 0 ? tasks[i].start : tasks[i].release;
+    }
+    int completed = 0;
+    float now = 0.0f;
+    float makespan = 0.0f;
+
+    for (int i = 0; i < n; ++i) {
+        if (pending[i] == 0) {
+            released.insert(make_pair(release[i], i));
+        }
+    }
+    while (completed < n) {
+        // the tasks whose release time is passed become ready; the tasks
+        // that were not executed are completed immediately
+        vector<int> done;
+        while (!released.empty() && released.begin()->first <= now) {
+            int t = released.begin()->second;
+            released.erase(released.begin());
+            const TaskRecord &r = tasks[t];
+            if (r.thread < 0) {
+                result[t].thread = -1;
+                result[t].start = now;
+                done.push_back(t);
+                continue;
+            }
+            if (p == RECORDED) {
+                ready[min(r.thread, threads - 1)].insert(make_pair(make_pair(0u, priority[t]), t));
+            } else {
+                int queue = r.gpuTask || r.deadline == 0 ? 0 : 1;
+                ready[queue].insert(make_pair(make_pair(r.deadline, priority[t]), t));
+            }
+        }
+        // the idle threads start the best ready task they can execute
+        for (int i = 0; i < threads && done.empty(); ++i) {
+            if (busyUntil[i] >= 0.0f) {
+                continue;
+            }
+            ReadySet *s = NULL;
+            if (p == RECORDED) {
+                if (!ready[i].empty()) {
+                    s = &ready[i];
+                }
+            } else if (i == 0 && !ready[0].empty() && (ready[1].empty() || *ready[0].begin() < *ready[1].begin())) {
+                s = &ready[0];
+            } else if (!ready[1].empty()) {
+                s = &ready[1];
+            }
+            if (s == NULL) {
+                continue;
+            }
+            int t = s->begin()->second;
+            s->erase(s->begin());
+            result[t].thread = i;
+            result[t].start = now;
+            busyUntil[i] = now + tasks[t].duration;
+            running[i] = t;
+        }
+        if (done.empty()) {
+            // we advance the time to the next end of task or release time
+            float next = -1.0f;
+            for (int i = 0; i < threads; ++i) {
+                if (busyUntil[i] >= 0.0f && (next < 0.0f || busyUntil[i] < next)) {
+                    next = busyUntil[i];
+                }
+            }
+            if (!released.empty() && (next < 0.0f || released.begin()->first < next)) {
+                next = released.begin()->first;
+            }
+            if (next < 0.0f) {
+                // nothing can progress, the dependencies contain a cycle
+                break;
+            }
+            now = max(now, next);
+            for (int i = 0; i < threads; ++i) {
+                if (busyUntil[i] >= 0.0f && busyUntil[i] <= now) {
+                    done.push_back(running[i]);
+                    busyUntil[i] = -1.0f;
+                    running[i] = -1;
+                }
+            }
+        }
+        for (unsigned int i = 0; i < done.size(); ++i) {
+            int t = done[i];
+            ++completed;
+            makespan = max(makespan, now);
+            for (unsigned int j = 0; j < successors[t].size(); ++j) {
+                int s = successors[t][j];
+                if (--pending[s] == 0) {
+                    released.insert(make_pair(max(release[s], now), s));
+                }
+            }
+        }
+    }
+    if (schedule != NULL) {
+        schedule->swap(result);
+    }
+    return makespan;
+}
+
+}
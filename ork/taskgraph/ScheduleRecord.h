@@ -0,0 +1,149 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_SCHEDULE_RECORD_H_
+#define _ORK_SCHEDULE_RECORD_H_
+
+#include <string>
+#include <vector>
+
+namespace ork
+{
+
+/**
+ * A record of the execution of some tasks by a MultithreadScheduler (see
+ * MultithreadScheduler#startRecording). It contains the scheduled tasks,
+ * their dependencies, and the thread, start time and duration of each
+ * executed task. A record can be saved in a compact binary file, and used
+ * to replay or to simulate the execution of the same tasks offline, with
+ * other scheduling policies or thread counts, without running them.
+ *
+ * @ingroup taskgraph
+ */
+class ORK_API ScheduleRecord
+{
+public:
+    /**
+     * A recorded task. Times are in micro seconds, relative to the start of
+     * the recording.
+     */
+    struct TaskRecord
+    {
+        int type; ///< the index of the type of this task in #types.
+
+        unsigned int deadline; ///< the deadline of this task.
+
+        bool gpuTask; ///< true if this task is a GPU task.
+
+        int thread; ///< the thread that executed this task, or -1.
+
+        float release; ///< the time at which this task was scheduled.
+
+        float start; ///< the time at which this task was executed.
+
+        float duration; ///< the execution time of this task.
+    };
+
+    /**
+     * The scheduling policies that can be simulated.
+     */
+    enum policy {
+        RECORDED, ///< each task on its recorded thread, in the recorded order.
+        SHORTEST_FIRST, ///< shortest ready task first (MultithreadScheduler default).
+        CRITICAL_PATH ///< ready task with the longest path to the end first.
+    };
+
+    /**
+     * The names of the types of the recorded tasks.
+     */
+    std::vector<std::string> types;
+
+    /**
+     * The recorded tasks, in the order in which they were scheduled.
+     */
+    std::vector<TaskRecord> tasks;
+
+    /**
+     * The dependencies between the recorded tasks. Each pair (src,dst)
+     * means that task dst must be executed before task src (see
+     * TaskGraph#addDependency).
+     */
+    std::vector< std::pair<int, int> > dependencies;
+
+    /**
+     * The start times of the recorded frames (see MultithreadScheduler#run).
+     */
+    std::vector<float> frames;
+
+    /**
+     * The number of threads used to execute the recorded tasks, including
+     * the main thread.
+     */
+    int threads;
+
+    /**
+     * Creates an empty record.
+     */
+    ScheduleRecord();
+
+    /**
+     * Removes all the content of this record.
+     */
+    void clear();
+
+    /**
+     * Saves this record in a binary file, in the byte order of this machine.
+     *
+     * @return false if the file could not be written.
+     */
+    bool save(const std::string &fileName) const;
+
+    /**
+     * Loads a record saved with #save.
+     *
+     * @return false if the file could not be read.
+     */
+    bool load(const std::string &fileName);
+
+    /**
+     * Simulates the execution of the recorded tasks, with their recorded
+     * durations. As in MultithreadScheduler, GPU tasks and tasks for the
+     * current frame (deadline 0) are executed by the main thread, and the
+     * other tasks by any thread, tasks with earlier deadlines first. The
+     * tasks that were not executed, for instance because they were up to
+     * date, take no time. With the RECORDED policy, the simulation replays
+     * the recorded schedule exactly, up to the scheduling overheads.
+     *
+     * @param threads the number of threads, including the main thread.
+     *      Ignored for the RECORDED policy.
+     * @param p the scheduling policy.
+     * @param[out] schedule if not NULL, the simulated tasks, with their
+     *      simulated thread and start time.
+     * @return the time at which the last task is completed.
+     */
+    float simulate(int threads, policy p, std::vector<TaskRecord> *schedule = NULL) const;
+};
+
+}
+
+#endif
@@ -27,7 +27,9 @@
 #include <algorithm>
 #include <sstream>
 
+#include "ork/core/Atomic.h"
 #include "ork/core/Logger.h"
+#include "ork/core/ObjectPool.h"
 
 #include <pthread.h>
 
@@ -40,22 +42,244 @@ void *Task::mutex = NULL;
 
 map<type_info const*, Task::TaskStatistics*, Task::TypeInfoSort> Task::statistics;
 
+void *Task::statisticsKey = NULL;
+
+vector<Task::ThreadStatistics*> Task::threadStatistics;
+
+/**
+ * The expected durations of the tasks of a given type (see
+ * Task#getExpectedDuration).
+ */
+struct DurationEstimates
+{
+    /**
+     * The task type, used as key in the #estimates hash table, or NULL if
+     * this entry is unused.
+     */
+    const type_info * volatile type;
+
+    /**
+     * The expected durations for a complexity of 1 (see
+     * Task::TaskStatistics#getExpectedDurations). Written by
+     * Task#mergeStatistics, with the Task mutex locked, and read without
+     * locking.
+     */
+    volatile float *durations;
+};
+
+/**
+ * The number of values in DurationEstimates#durations.
+ */
+static const int ESTIMATES_SIZE = 101;
+
+/**
+ * The capacity of the #estimates hash table. Must be a power of two.
+ */
+static const int MAX_ESTIMATES = 256;
+
+/**
+ * The expected durations of each task type, in an open addressing hash
+ * table indexed by type_info addresses. Entries are never removed, so that
+ * they can be found without locking. The task types that do not fit in the
+ * table have an expected duration of 0.
+ */
+static DurationEstimates estimates[MAX_ESTIMATES];
+
+/**
+ * Returns the expected durations of the given task type.
+ *
+ * @param create true to create them if necessary. The Task mutex must then
+ *      be locked.
+ * @return the expected durations, or NULL if not found.
+ */
+static DurationEstimates *getEstimates(const type_info *type, bool create)
+{
+    size_t h = (size_t(type) >> 3) * 2654435761u;
+    for (int i = 0; i < MAX_ESTIMATES; ++i) {
+        DurationEstimates *e = estimates + ((h + i) & (MAX_ESTIMATES - 1));
+        const type_info *t = ork_atomic_load(&e->type);
+        if (t == type) {
+            return e;
+        }
+        if (t == NULL) {
+            if (!create) {
+                return NULL;
+            }
+            // the durations are published by the store of the type
+            e->durations = new float[ESTIMATES_SIZE];
+            for (int j = 0; j < ESTIMATES_SIZE; ++j) {
+                e->durations[j] = 0.0f;
+            }
+            ork_atomic_store(&e->type, type);
+            return e;
+        }
+    }
+    return NULL;
+}
+
 bool Task::TypeInfoSort::operator()(const type_info *x, const type_info *y) const
 {
     return (*x).before(*y) != 0;
 }
 
-Task::TaskStatistics::TaskStatistics() :
-    durationSum(0.0f), durationSquareSum(0.0f), minDuration(INFINITY), maxDuration(0.0f), corrected(false), n(0)
+Task::TaskStatistics::TaskStatistics()
+{
+    clear();
+}
+
+void Task::TaskStatistics::add(float duration)
+{
+    durationSum += duration;
+    durationSquareSum += duration * duration;
+    minDuration = min(duration, minDuration);
+    maxDuration = max(duration, maxDuration);
+    n += 1;
+    // the bucket index is given by the exponent of the duration, and by the
+    // first two bits of its mantissa (which is in [0.5,1))
+    int bucket = 0;
+    if (duration > 0.0f) {
+        int e;
+        float m = frexp(duration, &e);
+        bucket = max(0, min((e + 10) * 4 + int((m - 0.5f) * 8.0f), HISTOGRAM_SIZE - 1));
+    }
+    histogram[bucket] += 1;
+}
+
+void Task::TaskStatistics::add(const TaskStatistics &s)
+{
+    durationSum += s.durationSum;
+    durationSquareSum += s.durationSquareSum;
+    minDuration = min(s.minDuration, minDuration);
+    maxDuration = max(s.maxDuration, maxDuration);
+    n += s.n;
+    for (int i = 0; i < HISTOGRAM_SIZE; ++i) {
+        histogram[i] += s.histogram[i];
+    }
+}
+
+void Task::TaskStatistics::clear()
+{
+    durationSum = 0.0f;
+    durationSquareSum = 0.0f;
+    minDuration = INFINITY;
+    maxDuration = 0.0f;
+    n = 0;
+    for (int i = 0; i < HISTOGRAM_SIZE; ++i) {
+        histogram[i] = 0;
+    }
+}
+
+float Task::TaskStatistics::getPercentile(float p) const
+{
+    float rank = p / 100.0f * n;
+    int count = 0;
+    for (int i = 0; i < HISTOGRAM_SIZE; ++i) {
+        if (histogram[i] > 0 && count + histogram[i] >= rank) {
+            return getDuration(i, rank, count);
+        }
+        count += histogram[i];
+    }
+    return maxDuration;
+}
+
+void Task::TaskStatistics::getExpectedDurations(volatile float *durations) const
+{
+    // to get "valid" statistics, we wait until we have enough samples,
+    // and we ignore the min and max values
+    const int MIN_SAMPLES = 64;
+    if (n < MIN_SAMPLES) {
+        return;
+    }
+    int m = n - 2;
+    float sum = durationSum - maxDuration - minDuration;
+    float squareSum = durationSquareSum - maxDuration * maxDuration - minDuration * minDuration;
+    float mean = sum / m;
+    float squareMean = squareSum / m;
+    float variance = max(squareMean - mean * mean, 0.0f);
+    durations[0] = mean + 2.0f * sqrt(variance);
+    // same as getPercentile, for all the percentiles in a single pass
+    int i = 0;
+    int count = 0;
+    for (int p = 1; p <= 100; ++p) {
+        float rank = p / 100.0f * n;
+        while (i < HISTOGRAM_SIZE && (histogram[i] == 0 || count + histogram[i] < rank)) {
+            count += histogram[i];
+            ++i;
+        }
+        durations[p] = i < HISTOGRAM_SIZE ? getDuration(i, rank, count) : maxDuration;
+    }
+}
+
+float Task::TaskStatistics::getDuration(int bucket, float rank, int count) const
 {
+    // bounds of the bucket (see #add), between which we interpolate
+    // linearly, assuming that the durations are evenly distributed
+    int i = bucket;
+    float lower = i == 0 ? 0.0f : ldexp(0.5f + (i % 4) / 8.0f, i / 4 - 10);
+    float upper = ldexp(0.5f + ((i % 4) + 1) / 8.0f, i / 4 - 10);
+    float d = lower + (upper - lower) * (rank - count) / histogram[i];
+    return max(minDuration, min(d, maxDuration));
 }
 
+struct Task::ThreadStatistics
+{
+    /**
+     * The statistics recorded by this thread since the last merge, for each
+     * task type. The entries are reset, but not removed, at each merge.
+     */
+    map<type_info const*, TaskStatistics*, TypeInfoSort> statistics;
+
+    /**
+     * A spin lock used to ensure consistent access to #statistics by the
+     * thread that owns them and by #mergeStatistics. It is only contended
+     * during merges.
+     */
+    volatile long lock;
+
+    /**
+     * The number of durations recorded by this thread.
+     */
+    volatile long samples;
+
+    /**
+     * The value of #samples at the last merge.
+     */
+    long merged;
+
+    ThreadStatistics() : lock(0), samples(0), merged(0)
+    {
+    }
+
+    ~ThreadStatistics()
+    {
+        map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator i = statistics.begin();
+        while (i != statistics.end()) {
+            delete i->second;
+            ++i;
+        }
+    }
+
+    void lockStatistics()
+    {
+        while (!atomic_compare_and_swap(&lock, 0L, 1L)) {
+            cpu_relax();
+        }
+    }
+
+    void unlockStatistics()
+    {
+        ork_atomic_store(&lock, 0L);
+    }
+};
+
 Task::Task(const char *type, bool gpuTask, unsigned int deadline) :
-    Object(type), completionDate(0), gpuTask(gpuTask), deadline(deadline), predecessorsCompletionDate(1), done(false), expectedDuration(-1.0f)
+    Object(type), completionDate(0), gpuTask(gpuTask), deadline(deadline), predecessorsCompletionDate(1), done(false), cancelled(0), expectedDuration(-1.0f), schedulerIndex(-1), rank(0.0f)
 {
     if (mutex == NULL) {
         mutex = new pthread_mutex_t;
         pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
+        statisticsKey = new pthread_key_t;
+        pthread_key_create((pthread_key_t*) statisticsKey, deleteThreadStatistics);
     }
 }
 
@@ -63,6 +287,18 @@ Task::~Task()
 {
 }
 
+void *Task::operator new(size_t size)
+{
+    countBytes(long(size));
+    return ObjectPool::allocate(size);
+}
+
+void Task::operator delete(void *p, size_t size)
+{
+    countBytes(-long(size));
+    ObjectPool::deallocate(p, size);
+}
+
 void* Task::getContext() const
 {
     return NULL;
@@ -88,6 +324,11 @@ int Task::getComplexity() const
     return 1;
 }
 
+int Task::getMemoryCost() const
+{
+    return 0;
+}
+
 void Task::init(set<Task*> &initialized)
 {
 }
@@ -106,11 +347,28 @@ void Task::end()
 {
 }
 
+bool Task::checkCompletion(bool /*wait*/)
+{
+    return true;
+}
+
 bool Task::isDone()
 {
     return done;
 }
 
+void Task::cancel()
+{
+    if (!done) {
+        ork_atomic_store(&cancelled, 1L);
+    }
+}
+
+bool Task::isCancelled() const
+{
+    return ork_atomic_load(&cancelled) != 0;
+}
+
 void Task::setIsDone(bool done, unsigned int t, reason r)
 {
     if (this->done != done) {
@@ -139,57 +397,44 @@ void Task::setPredecessorsCompletionDate(unsigned int t)
     predecessorsCompletionDate = max(predecessorsCompletionDate, t);
 }
 
-float Task::getExpectedDuration()
+float Task::getExpectedDuration(float percentile)
 {
     if (expectedDuration == -1.0f) {
-        expectedDuration = 0.0f;
-        const type_info *id = getTypeInfo();
-        pthread_mutex_lock((pthread_mutex_t*) mutex);
-        map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator i = statistics.find(id);
-        if (i != statistics.end()) {
-            TaskStatistics *stats = i->second;
-            // to get "valid" statistics, we wait until we have enough samples,
-            // and we ignore the min and max values
-            const int MIN_SAMPLES = 64;
-            if (stats->n >= MIN_SAMPLES) {
-                if (!stats->corrected) {
-                    float sum = stats->durationSum - stats->maxDuration - stats->minDuration;
-                    float squareSum = stats->durationSum - stats->maxDuration * stats->maxDuration - stats->minDuration * stats->minDuration;
-                    stats->durationSum = (sum * stats->n) / (stats->n - 2) ;
-                    stats->durationSquareSum = (squareSum * stats->n) / (stats->n - 2);
-                    stats->corrected = true;
-                }
-                float mean = stats->durationSum / stats->n;
-                float squareMean = stats->durationSquareSum / stats->n;
-                float variance = squareMean - mean * mean;
-                float standardDeviation = sqrt(variance);
-                expectedDuration = (mean + 2.0f * standardDeviation) * getComplexity();
-            }
+        float duration = 0.0f;
+        DurationEstimates *e = getEstimates(getTypeInfo(), false);
+        if (e != NULL) {
+            int i = percentile > 0.0f ? max(1, min(int(percentile + 0.5f), 100)) : 0;
+            duration = e->durations[i] * getComplexity();
         }
-        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        expectedDuration = duration;
     }
     return expectedDuration;
 }
 
 void Task::setActualDuration(float duration)
 {
+    ThreadStatistics *s = (ThreadStatistics*) pthread_getspecific(*((pthread_key_t*) statisticsKey));
+    if (s == NULL) {
+        s = new ThreadStatistics();
+        pthread_setspecific(*((pthread_key_t*) statisticsKey), s);
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        threadStatistics.push_back(s);
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    }
     TaskStatistics *stats;
     const type_info *id = getTypeInfo();
-    pthread_mutex_lock((pthread_mutex_t*) mutex);
-    map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator i = statistics.find(id);
-    if (i == statistics.end()) {
+    s->lockStatistics();
+    map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator i = s->statistics.find(id);
+    if (i == s->statistics.end()) {
         stats = new TaskStatistics();
-        statistics.insert(make_pair(id, stats));
+        s->statistics.insert(make_pair(id, stats));
     } else {
         stats = i->second;
     }
-    duration = duration / getComplexity();
-    stats->durationSum += duration;
-    stats->durationSquareSum += duration * duration;
-    stats->minDuration = min(duration, stats->minDuration);
-    stats->maxDuration = max(duration, stats->maxDuration);
-    stats->n += 1;
-    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    stats->add(duration / getComplexity());
+    // only this thread modifies this counter
+    ork_atomic_store(&s->samples, s->samples + 1);
+    s->unlockStatistics();
 }
 
 const type_info *Task::getTypeInfo()
@@ -212,23 +457,92 @@ void Task::removeListener(TaskListener *l)
 
 void Task::logStatistics()
 {
+    vector<Statistics> stats;
+    getStatistics(stats);
+    for (unsigned int i = 0; i < stats.size(); ++i) {
+        Statistics &s = stats[i];
+        ostringstream oss;
+        oss.setf(ios::fixed,ios::floatfield);
+        oss.precision(3);
+        oss << s.type->name() << ": " << s.mean / 1000.0 << " +/- " << s.standardDeviation / 1000.0 << "; min/max " << s.minDuration / 1000.0 << " " << s.maxDuration / 1000.0;
+        oss << "; p50/p95/p99 " << s.p50 / 1000.0 << " " << s.p95 / 1000.0 << " " << s.p99 / 1000.0;
+        Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
+    }
+
+    ostringstream oss;
+    oss << "tasks memory: " << ObjectPool::getAllocatedCount() << " allocations, " << ObjectPool::getReusedCount() << " avoided allocations";
+    Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
+}
+
+void Task::getStatistics(vector<Statistics> &result)
+{
+    result.clear();
     pthread_mutex_lock((pthread_mutex_t*) mutex);
+    mergeStatistics();
     map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator i = statistics.begin();
     while (i != statistics.end()) {
         TaskStatistics *stats = i->second;
-        float mean = stats->durationSum / stats->n;
+        Statistics s;
+        s.type = i->first;
+        s.n = stats->n;
+        s.mean = stats->durationSum / stats->n;
         float squareMean = stats->durationSquareSum / stats->n;
-        float variance = squareMean - mean * mean;
-        float standardDeviation = sqrt(variance);
-
-        ostringstream oss;
-        oss.setf(ios::fixed,ios::floatfield);
-        oss.precision(3);
-        oss << i->first->name() << ": " << mean / 1000.0 << " +/- " << standardDeviation / 1000.0 << "; min/max " << stats->minDuration / 1000.0 << " " << stats->maxDuration / 1000.0;
-        Logger::DEBUG_LOGGER->log("SCHEDULER", oss.str());
+        s.standardDeviation = sqrt(max(squareMean - s.mean * s.mean, 0.0f));
+        s.minDuration = stats->minDuration;
+        s.maxDuration = stats->maxDuration;
+        s.p50 = stats->getPercentile(50.0f);
+        s.p95 = stats->getPercentile(95.0f);
+        s.p99 = stats->getPercentile(99.0f);
+        result.push_back(s);
         i++;
     }
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
 
+void Task::updateExpectedDurations()
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    mergeStatistics();
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void Task::mergeStatistics()
+{
+    // NOTE: the mutex should be locked before calling this method!
+    for (unsigned int i = 0; i < threadStatistics.size(); ++i) {
+        ThreadStatistics *s = threadStatistics[i];
+        if (ork_atomic_load(&s->samples) == s->merged) {
+            continue;
+        }
+        s->lockStatistics();
+        map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator j = s->statistics.begin();
+        while (j != s->statistics.end()) {
+            if (j->second->n > 0) {
+                map<type_info const*, TaskStatistics*, TypeInfoSort>::iterator k = statistics.find(j->first);
+                if (k == statistics.end()) {
+                    k = statistics.insert(make_pair(j->first, new TaskStatistics())).first;
+                }
+                k->second->add(*(j->second));
+                j->second->clear();
+                DurationEstimates *e = getEstimates(j->first, true);
+                if (e != NULL) {
+                    k->second->getExpectedDurations(e->durations);
+                }
+            }
+            ++j;
+        }
+        s->merged = s->samples;
+        s->unlockStatistics();
+    }
+}
+
+void Task::deleteThreadStatistics(void *s)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    mergeStatistics();
+    threadStatistics.erase(find(threadStatistics.begin(), threadStatistics.end(), (ThreadStatistics*) s));
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    delete (ThreadStatistics*) s;
+}
+
 }
@@ -73,6 +73,31 @@ public:
         DATA_NEEDED ///< result of this task is needed again by a successor task of this task
     };
 
+    /**
+     * Execution time statistics for the tasks of a given type. The durations
+     * are in micro seconds, per unit of complexity (see #getComplexity).
+     */
+    struct Statistics
+    {
+        const std::type_info *type; ///< the type of the tasks.
+
+        int n; ///< number of executions.
+
+        float mean; ///< mean execution time.
+
+        float standardDeviation; ///< standard deviation of the execution times.
+
+        float minDuration; ///< minimum execution time.
+
+        float maxDuration; ///< maximum execution time.
+
+        float p50; ///< median execution time.
+
+        float p95; ///< 95th percentile of the execution times.
+
+        float p99; ///< 99th percentile of the execution times.
+    };
+
     /**
      * Creates a new task.
      *
@@ -88,6 +113,18 @@ public:
      */
     virtual ~Task();
 
+    /**
+     * Allocates the memory for a new task. Many tasks are created and deleted
+     * at each frame, so their memory is allocated with an ObjectPool, which
+     * reuses the memory of deleted tasks instead of returning it to the system.
+     */
+    static void *operator new(size_t size);
+
+    /**
+     * Deletes the memory of a task allocated with operator new.
+     */
+    static void operator delete(void *p, size_t size);
+
     /**
      * Returns the execution context of this task. This context is used to sort
      * GPU tasks that share the same context, in order to save context switches.
@@ -120,6 +157,15 @@ public:
      */
     virtual int getComplexity() const;
 
+    /**
+     * Returns the estimated amount of memory allocated, or of data loaded, by
+     * this task, in bytes. This cost is used by schedulers to limit the amount
+     * of prefetching work admitted per frame (see
+     * MultithreadScheduler#setPrefetchBudget). The default implementation
+     * returns 0.
+     */
+    virtual int getMemoryCost() const;
+
     /**
      * Prepares this task before its execution. This method is called when the
      * task is scheduled to be executed. It can perform work that cannot be
@@ -170,11 +216,40 @@ public:
      */
     virtual void end();
 
+    /**
+     * Returns true if the work started by the last execution of this task is
+     * completed. Tasks whose #run method only starts some asynchronous work,
+     * such as GPU commands, can override this method so that schedulers do
+     * not mark them as completed, and do not execute their successors,
+     * before this work is completed (see AsyncGpuTask). This method is only
+     * called for GPU tasks, with the same execution context as #run. The
+     * default implementation returns true.
+     *
+     * @param wait true to wait until the work of this task is completed.
+     */
+    virtual bool checkCompletion(bool wait);
+
     /**
      * Returns true if this task is completed.
      */
     virtual bool isDone();
 
+    /**
+     * Cancels the execution of this task. If this task has not started yet,
+     * it is not executed. Otherwise its #run method can check #isCancelled to
+     * abort it before its end. In both cases, a cancelled task and its
+     * successors are not marked as completed, so that they are executed
+     * again if they are scheduled again. This method has no effect if this
+     * task is already completed.
+     */
+    virtual void cancel();
+
+    /**
+     * Returns true if the execution of this task has been cancelled, and if
+     * the scheduler has not yet dropped it.
+     */
+    bool isCancelled() const;
+
     /**
      * Sets the execution %state of this task. If the task is completed and its
      * execution %state is set to "not done" then it will be executed again.
@@ -212,9 +287,17 @@ public:
 
     /**
      * Returns the expected duration of this task in micro seconds. The result
-     * is based on the complexity of this task (see #getComplexity).
+     * is based on the complexity of this task (see #getComplexity), and on
+     * the execution times of the previous tasks of the same type, as merged
+     * by the last call to #updateExpectedDurations. It is computed at the
+     * first call and then cached, and does not require any lock.
+     *
+     * @param percentile 0 to use the mean execution time plus two standard
+     *      deviations (the default), or a percentile of the execution times,
+     *      strictly between 0 and 100, rounded to the nearest integer. Only
+     *      used at the first call.
      */
-    float getExpectedDuration();
+    float getExpectedDuration(float percentile = 0.0f);
 
     /**
      * Sets the actual duration of this task. This actual duration is used to
@@ -246,6 +329,22 @@ public:
      */
     static void logStatistics();
 
+    /**
+     * Returns the statistics about the execution time of the tasks, for each
+     * task type.
+     *
+     * @param[out] statistics the statistics for each task type.
+     */
+    static void getStatistics(std::vector<Statistics> &statistics);
+
+    /**
+     * Merges the execution times recorded by all the threads, and updates
+     * the estimates used by #getExpectedDuration. <i>For internal use
+     * only</i>. This method is called by schedulers at each frame, it must
+     * not called directly by users.
+     */
+    static void updateExpectedDurations();
+
 protected:
     unsigned int completionDate; ///< time at which this task was completed.
 
@@ -271,6 +370,13 @@ private:
      */
     struct TaskStatistics
     {
+        /**
+         * The number of buckets of #histogram. The bucket boundaries are
+         * spaced logarithmically, with four buckets per power of two, from
+         * 2^-10 to 2^22 micro seconds.
+         */
+        static const int HISTOGRAM_SIZE = 128;
+
         float durationSum; ///< sum of the execution times.
 
         float durationSquareSum; ///< sum of the squares of the execution times.
@@ -279,13 +385,63 @@ private:
 
         float maxDuration; ///< maximum execution time.
 
-        bool corrected; ///< true if min and max values have been removed from sum and squareSum
-
         int n; ///< number of executions.
 
+        int histogram[HISTOGRAM_SIZE]; ///< number of executions in each duration bucket.
+
         TaskStatistics();
+
+        /**
+         * Adds an execution time to these statistics.
+         */
+        void add(float duration);
+
+        /**
+         * Adds the given statistics to these statistics.
+         */
+        void add(const TaskStatistics &s);
+
+        /**
+         * Resets these statistics to their initial empty state.
+         */
+        void clear();
+
+        /**
+         * Returns an approximation of the given percentile of the execution
+         * times, interpolated in the corresponding histogram bucket.
+         *
+         * @param p a percentile between 0 and 100.
+         */
+        float getPercentile(float p) const;
+
+        /**
+         * Computes the expected duration for a complexity of 1, with each
+         * method supported by Task#getExpectedDuration.
+         *
+         * @param[out] durations the mean execution time plus two standard
+         *      deviations, followed by the 100 integer percentiles of the
+         *      execution times. Unchanged if there are not enough samples.
+         */
+        void getExpectedDurations(volatile float *durations) const;
+
+        /**
+         * Returns the execution time corresponding to the given rank, in the
+         * given bucket of #histogram.
+         *
+         * @param bucket a bucket index.
+         * @param rank the rank of the execution time.
+         * @param count the number of execution times in the buckets before
+         *      the given one.
+         */
+        float getDuration(int bucket, float rank, int count) const;
     };
 
+    /**
+     * The execution time statistics recorded by a thread, which have not yet
+     * been merged in #statistics. Defined in Task.cpp.
+     */
+    struct ThreadStatistics;
+
     bool gpuTask; ///< true is this task is a GPU task.
 
     unsigned int deadline; ///< frame number before which this tasks must be completed.
@@ -294,8 +450,27 @@ private:
 
     bool done; ///< true is the task is completed.
 
+    /**
+     * True if the execution of this task has been cancelled (see #cancel).
+     * Reset by the scheduler when it drops the task.
+     */
+    volatile long cancelled;
+
     float expectedDuration; ///< expected duration of this task.
 
+    /**
+     * The index of this task in the flattened task graph of the scheduler
+     * that executes it, or -1 if this task is not currently scheduled.
+     */
+    int schedulerIndex;
+
+    /**
+     * The upward rank of this task, i.e. the expected duration of the longest
+     * path from this task to a task without successors. Only computed by
+     * the MultithreadScheduler in critical path priority mode (0 otherwise).
+     */
+    float rank;
+
     static void* mutex; ///< mutex used to synchronize accesses to #statistics
 
     /**
@@ -303,6 +478,35 @@ private:
      *std::type_info objects.
      */
     static std::map<std::type_info const*, TaskStatistics*, TypeInfoSort> statistics;
+
+    /**
+     * The pthread key of the ThreadStatistics of each thread. Each thread
+     * records the actual durations of the tasks it executes in its own
+     * ThreadStatistics, without contention with the other threads. These
+     * statistics are merged in #statistics when they are needed.
+     */
+    static void *statisticsKey;
+
+    /**
+     * The ThreadStatistics of all the threads that executed tasks.
+     */
+    static std::vector<ThreadStatistics*> threadStatistics;
+
+    /**
+     * Merges the statistics of #threadStatistics in #statistics, and updates
+     * the expected durations of the task types with new statistics. The
+     * mutex must be locked before calling this method.
+     */
+    static void mergeStatistics();
+
+    /**
+     * Merges and deletes the ThreadStatistics of a thread that terminates.
+     *
+     * @param s a ThreadStatistics.
+     */
+    static void deleteThreadStatistics(void *s);
+
+    friend class MultithreadScheduler;
 };
 
 /**
@@ -28,11 +28,11 @@ using namespace std;
 namespace ork
 {
 
-TaskGraph::TaskGraph() : Task("TaskGraph", false, 0)
+TaskGraph::TaskGraph() : Task("TaskGraph", false, 0), version(0), flattened(NULL)
 {
 }
 
-TaskGraph::TaskGraph(ptr<Task> task) : Task("TaskGraph", false, 0)
+TaskGraph::TaskGraph(ptr<Task> task) : Task("TaskGraph", false, 0), version(0), flattened(NULL)
 {
     addTask(task);
 }
@@ -43,6 +43,9 @@ TaskGraph::~TaskGraph()
     while (i.hasNext()) {
         i.next()->removeListener(this);
     }
+    if (flattened != NULL) {
+        delete flattened;
+    }
 }
 
 void TaskGraph::setIsDone(bool done, unsigned int t, reason r)
@@ -62,6 +65,14 @@ void TaskGraph::setIsDone(bool done, unsigned int t, reason r)
     }
 }
 
+void TaskGraph::cancel()
+{
+    TaskIterator i = getAllTasks();
+    while (i.hasNext()) {
+        i.next()->cancel();
+    }
+}
+
 void TaskGraph::setPredecessorsCompletionDate(unsigned int t)
 {
     TaskIterator i = getFirstTasks();
@@ -137,7 +148,7 @@ TaskGraph::TaskIterator TaskGraph::getInverseDependencies(ptr<Task> t)
     return TaskIterator();
 }
 
-void TaskGraph::addTask(ptr<Task> t)
+void TaskGraph::addTask(const ptr<Task> &t)
 {
     assert(t.cast<TaskGraph>() == NULL || !t.cast<TaskGraph>()->isEmpty());
     if (allTasks.find(t) == allTasks.end()) {
@@ -147,6 +158,7 @@ void TaskGraph::addTask(ptr<Task> t)
         allTasks.insert(t);
         firstTasks.insert(t);
         lastTasks.insert(t);
+        ++version;
     }
 }
 
@@ -162,10 +174,11 @@ void TaskGraph::removeTask(ptr<Task> t)
         lastTasks.erase(t);
         assert(dependencies.find(t) == dependencies.end());
         assert(inverseDependencies.find(t) == inverseDependencies.end());
+        ++version;
     }
 }
 
-void TaskGraph::addDependency(ptr<Task> src, ptr<Task> dst)
+void TaskGraph::addDependency(const ptr<Task> &src, const ptr<Task> &dst)
 {
     assert(allTasks.find(src) != allTasks.end());
     assert(allTasks.find(dst) != allTasks.end());
@@ -178,6 +191,7 @@ void TaskGraph::addDependency(ptr<Task> src, ptr<Task> dst)
     // updates the successors and predecessors maps
     dependencies[src].insert(dst);
     inverseDependencies[dst].insert(src);
+    ++version;
 }
 
 void TaskGraph::removeDependency(ptr<Task> src, ptr<Task> dst)
@@ -199,6 +213,7 @@ void TaskGraph::removeDependency(ptr<Task> src, ptr<Task> dst)
         // so it must be added to the set of tasks without successor
         lastTasks.insert(dst);
     }
+    ++version;
 }
 
 void TaskGraph::removeAndGetDependencies(ptr<Task> src, set< ptr<Task> >& deletedDependencies)
@@ -224,6 +239,7 @@ void TaskGraph::removeAndGetDependencies(ptr<Task> src, set< ptr<Task> >& delete
         // src has no more predecessors,
         // so it must be added to the set of tasks without predecessors
         firstTasks.insert(src);
+        ++version;
     }
 }
 
@@ -233,6 +249,7 @@ void TaskGraph::clearDependencies()
     lastTasks.insert(allTasks.begin(), allTasks.end());
     dependencies.clear();
     inverseDependencies.clear();
+    ++version;
 }
 
 void TaskGraph::taskStateChanged(ptr<Task> t, bool done, reason r)
@@ -292,6 +309,23 @@ void TaskGraph::cleanup()
 {
     flattenedFirstTasks.clear();
     flattenedLastTasks.clear();
+    if (flattened != NULL) {
+        delete flattened;
+        flattened = NULL;
+    }
+}
+
+bool TaskGraph::FlattenedGraph::isValid() const
+{
+    // since a graph appears before its sub graphs, a sub graph that has been
+    // removed (and possibly deleted) is never accessed: the version of its
+    // parent graph has changed, and this loop stops there
+    for (unsigned int i = 0; i < graphs.size(); ++i) {
+        if (graphs[i].first->version != graphs[i].second) {
+            return false;
+        }
+    }
+    return true;
 }
 
 }
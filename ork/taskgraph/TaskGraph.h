@@ -26,6 +26,7 @@
 
 #include <set>
 #include <map>
+#include <vector>
 #include "ork/core/Iterator.h"
 #include "ork/taskgraph/Task.h"
 
@@ -76,6 +77,11 @@ public:
      */
     virtual void setIsDone(bool done, unsigned int t, reason r);
 
+    /**
+     * Calls #cancel recursively on all sub tasks of this task graph.
+     */
+    virtual void cancel();
+
     /**
      * Calls #setPredecessorsCompletionDate on the sub tasks of this task
      * without predecessors.
@@ -128,7 +134,7 @@ public:
      * @param t the task to be added to this sub graph. This task can be a task
      *      graph itself.
      */
-    void addTask(ptr<Task> t);
+    void addTask(const ptr<Task> &t);
 
     /**
      * Removes a sub task from this task graph. This sub task must not have any
@@ -144,7 +150,7 @@ public:
      * @param src a sub task of this graph that must be executed after dst.
      * @param dst a sub task of this graph that must be executed before src.
      */
-    void addDependency(ptr<Task> src, ptr<Task> dst);
+    void addDependency(const ptr<Task> &src, const ptr<Task> &dst);
 
     /**
      * Removes a dependency between two sub tasks of this task graph.
@@ -190,6 +196,63 @@ protected:
     void cleanup();
 
 private:
+    /**
+     * A flattened form of a task graph, made of its primitive sub tasks,
+     * recursively, and of the dependencies between them. This flattened form
+     * is computed by schedulers, and reused as long as the structure of the
+     * graph and of its sub graphs does not change. Note that this only helps
+     * when the same graph is scheduled several times: the task graphs
+     * created by the scene graph methods are new at each frame (see
+     * TaskFactory), and are always flattened again.
+     */
+    struct FlattenedGraph
+    {
+        /**
+         * The graph and its sub graphs, recursively, with the value of their
+         * #version field when this flattened graph was computed. A graph
+         * always appears before its sub graphs in this vector.
+         */
+        std::vector< std::pair<TaskGraph*, unsigned int> > graphs;
+
+        /**
+         * The primitive sub tasks of the graph, recursively.
+         */
+        std::vector< ptr<Task> > tasks;
+
+        /**
+         * The dependencies between the primitive sub tasks of the graph. Each
+         * dependency is a pair of indices (src,dst) in #tasks, meaning that
+         * dst must be executed before src.
+         */
+        std::vector< std::pair<int, int> > dependencies;
+
+        /**
+         * The indices in #tasks of the tasks in reverse topological order,
+         * i.e. each task appears before its predecessors. Only computed by
+         * schedulers that need it (empty otherwise).
+         */
+        std::vector<int> order;
+
+        /**
+         * The index in #successors of the first successor of each task of
+         * #tasks, plus a last element equal to the size of #successors. Only
+         * computed with #order.
+         */
+        std::vector<int> firstSuccessor;
+
+        /**
+         * The indices in #tasks of the successors of each task, stored
+         * contiguously (see #firstSuccessor).
+         */
+        std::vector<int> successors;
+
+        /**
+         * Returns true if the structure of the graph has not changed since
+         * this flattened graph was computed.
+         */
+        bool isValid() const;
+    };
+
     std::set< ptr<Task> > allTasks; ///< all the tasks of this graph
 
     std::set< ptr<Task> > firstTasks; ///< the tasks without predecessors
@@ -212,6 +275,18 @@ private:
      */
     std::map< ptr<Task>, std::set< ptr<Task> > > inverseDependencies;
 
+    /**
+     * The structure version of this graph. This number is incremented each
+     * time a sub task or a dependency is added or removed.
+     */
+    unsigned int version;
+
+    /**
+     * The flattened form of this graph, or NULL if it has not been computed
+     * yet or if it has been invalidated.
+     */
+    FlattenedGraph *flattened;
+
     friend class MultithreadScheduler;
 };
 
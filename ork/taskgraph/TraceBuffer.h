@@ -0,0 +1,148 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_TRACE_BUFFER_H_
+#define _ORK_TRACE_BUFFER_H_
+
+#include "ork/core/Atomic.h"
+
+namespace ork
+{
+
+/**
+ * An event recorded by a MultithreadScheduler while tracing (see
+ * MultithreadScheduler#startTrace).
+ *
+ * @ingroup taskgraph
+ */
+struct TraceEvent
+{
+    /**
+     * The possible types of events.
+     */
+    enum eventType {
+        TASK, ///< the execution of a task
+        SCHEDULE, ///< the scheduling of the tasks for a frame
+        WAIT, ///< a wait to respect the fixed framerate
+        CONTEXT_SWITCH ///< a change of execution context between two GPU tasks
+    };
+
+    eventType type; ///< the type of this event.
+
+    const char *name; ///< the type of the executed task, for TASK events.
+
+    double start; ///< the start time of this event, in micro seconds.
+
+    double end; ///< the end time of this event, in micro seconds.
+
+    unsigned int deadline; ///< the deadline of the executed task.
+
+    bool gpuTask; ///< true if the executed task is a GPU task.
+};
+
+/**
+ * A fixed size circular buffer of trace events, written by a single thread
+ * and read by a single other thread, without locking. If the buffer is full
+ * new events are dropped, so that the writer thread is never blocked.
+ *
+ * @ingroup taskgraph
+ */
+class TraceBuffer
+{
+public:
+    /**
+     * Creates a new, empty buffer.
+     *
+     * @param capacity the capacity of this buffer. Must be a power of two.
+     */
+    TraceBuffer(int capacity = 4096) :
+        events(new TraceEvent[capacity]), mask(capacity - 1), head(0), tail(0), dropped(0)
+    {
+    }
+
+    /**
+     * Deletes this buffer.
+     */
+    ~TraceBuffer()
+    {
+        delete[] events;
+    }
+
+    /**
+     * Adds an event to this buffer. Must only be called by the writer thread.
+     *
+     * @return false if the buffer was full (the event is then dropped).
+     */
+    bool push(const TraceEvent &e)
+    {
+        long h = head;
+        if (h - ork_atomic_load(&tail) > mask) {
+            atomic_increment(&dropped);
+            return false;
+        }
+        events[h & mask] = e;
+        ork_atomic_store(&head, h + 1);
+        return true;
+    }
+
+    /**
+     * Removes the oldest event from this buffer. Must only be called by the
+     * reader thread.
+     *
+     * @param[out] e the removed event.
+     * @return false if the buffer was empty.
+     */
+    bool pop(TraceEvent &e)
+    {
+        long t = tail;
+        if (t == ork_atomic_load(&head)) {
+            return false;
+        }
+        e = events[t & mask];
+        ork_atomic_store(&tail, t + 1);
+        return true;
+    }
+
+    /**
+     * Returns the number of events dropped so far because the buffer was full.
+     */
+    long getDropped()
+    {
+        return ork_atomic_load(&dropped);
+    }
+
+private:
+    TraceEvent *events; ///< the events of this buffer.
+
+    long mask; ///< the capacity of this buffer, minus one.
+
+    volatile long head; ///< the index after the last written event.
+
+    volatile long tail; ///< the index of the oldest event not read yet.
+
+    volatile long dropped; ///< the number of dropped events.
+};
+
+}
+
+#endif
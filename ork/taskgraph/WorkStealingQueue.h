@@ -0,0 +1,224 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _ORK_WORK_STEALING_QUEUE_H_
+#define _ORK_WORK_STEALING_QUEUE_H_
+
+#include <vector>
+
+#include "ork/core/Atomic.h"
+
+namespace ork
+{
+
+/**
+ * A double ended queue of pointers, owned by a thread, from which other
+ * threads can steal elements without locking. Only the owner thread can
+ * #push and #pop elements, at the bottom of the queue. Other threads can
+ * #steal elements at the top of the queue. This is the dynamic circular
+ * work-stealing deque of Chase and Lev, with the memory barriers described by
+ * Le et al. in "Correct and Efficient Work-Stealing for Weak Memory Models".
+ * The queue does not own the elements it contains.
+ *
+ * @ingroup taskgraph
+ */
+template <class T>
+class WorkStealingQueue
+{
+public:
+    /**
+     * Creates a new, empty queue.
+     *
+     * @param capacity the initial capacity of the queue. Must be a power of
+     *      two. The capacity is automatically increased when needed.
+     */
+    WorkStealingQueue(int capacity = 256);
+
+    /**
+     * Deletes this queue.
+     */
+    ~WorkStealingQueue();
+
+    /**
+     * Returns an estimate of the number of elements in this queue. The
+     * returned value can be wrong if other threads modify the queue
+     * concurrently.
+     */
+    long size() const;
+
+    /**
+     * Adds an element at the bottom of this queue. Must only be called by
+     * the owner thread.
+     *
+     * @param t an element, which must not be NULL.
+     */
+    void push(T t);
+
+    /**
+     * Removes and returns the element at the bottom of this queue. Must only
+     * be called by the owner thread.
+     *
+     * @return the last pushed element, or NULL if the queue is empty.
+     */
+    T pop();
+
+    /**
+     * Removes and returns the element at the top of this queue. Can be
+     * called from any thread.
+     *
+     * @return the oldest element of this queue, or NULL if the queue is empty
+     *      or if another thread removed the same element concurrently.
+     */
+    T steal();
+
+private:
+    /**
+     * A circular array of elements.
+     */
+    struct Array
+    {
+        long mask; ///< the capacity of this array, minus one.
+
+        T volatile *items; ///< the elements of this array.
+
+        Array(long capacity) : mask(capacity - 1), items(new T[capacity])
+        {
+        }
+
+        ~Array()
+        {
+            delete[] (T*) items;
+        }
+
+        T get(long i) const
+        {
+            return ork_atomic_load(&items[i & mask]);
+        }
+
+        void put(long i, T t)
+        {
+            ork_atomic_store(&items[i & mask], t);
+        }
+    };
+
+    volatile long top; ///< the index of the oldest element, for #steal.
+
+    volatile long bottom; ///< the index after the last pushed element.
+
+    Array * volatile array; ///< the current circular array.
+
+    /**
+     * The previous, smaller arrays. They are not deleted before this queue is
+     * deleted, because concurrent #steal calls may still be reading them.
+     */
+    std::vector<Array*> oldArrays;
+};
+
+template <class T>
+WorkStealingQueue<T>::WorkStealingQueue(int capacity) :
+    top(0), bottom(0), array(new Array(capacity))
+{
+}
+
+template <class T>
+WorkStealingQueue<T>::~WorkStealingQueue()
+{
+    delete array;
+    for (unsigned int i = 0; i < oldArrays.size(); ++i) {
+        delete oldArrays[i];
+    }
+}
+
+template <class T>
+long WorkStealingQueue<T>::size() const
+{
+    long b = ork_atomic_load(&bottom);
+    long t = ork_atomic_load(&top);
+    return b > t ? b - t : 0;
+}
+
+template <class T>
+void WorkStealingQueue<T>::push(T t)
+{
+    long b = bottom;
+    long tp = ork_atomic_load(&top);
+    Array *a = array;
+    if (b - tp > a->mask) {
+        // the array is full, we replace it with a larger copy
+        Array *na = new Array(2 * (a->mask + 1));
+        for (long i = tp; i < b; ++i) {
+            na->put(i, a->get(i));
+        }
+        oldArrays.push_back(a);
+        ork_atomic_store(&array, na);
+        a = na;
+    }
+    a->put(b, t);
+    atomic_fence();
+    ork_atomic_store(&bottom, b + 1);
+}
+
+template <class T>
+T WorkStealingQueue<T>::pop()
+{
+    long b = bottom - 1;
+    Array *a = array;
+    ork_atomic_store(&bottom, b);
+    atomic_fence();
+    long t = ork_atomic_load(&top);
+    T result = NULL;
+    if (t <= b) {
+        result = a->get(b);
+        if (t == b) {
+            // last element: we compete with concurrent steal operations
+            if (!atomic_compare_and_swap(&top, t, t + 1)) {
+                result = NULL;
+            }
+            ork_atomic_store(&bottom, b + 1);
+        }
+    } else {
+        // the queue was empty
+        ork_atomic_store(&bottom, b + 1);
+    }
+    return result;
+}
+
+template <class T>
+T WorkStealingQueue<T>::steal()
+{
+    long t = ork_atomic_load(&top);
+    atomic_fence();
+    long b = ork_atomic_load(&bottom);
+    if (t < b) {
+        Array *a = ork_atomic_load(&array);
+        T result = a->get(t);
+        if (atomic_compare_and_swap(&top, t, t + 1)) {
+            return result;
+        }
+    }
+    return NULL;
+}
+
+}
+
+#endif
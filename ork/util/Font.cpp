@@ -146,17 +146,22 @@ vec2f Font::addLine(const vec4f &viewport, float xs, float ys, const string &lin
         float ys0 = ys / viewport.w;
         float ys1 = (ys + height) / viewport.w;
 
-        vec4h pos_uv0 = vec4f(xs0 * 2.0f - 1.0f, 1.0f - ys1 * 2.0f, u0, v0).cast<half>();
-        vec4h pos_uv1 = vec4f(xs1 * 2.0f - 1.0f, 1.0f - ys1 * 2.0f, u1, v0).cast<half>();
-        vec4h pos_uv2 = vec4f(xs1 * 2.0f - 1.0f, 1.0f - ys0 * 2.0f, u1, v1).cast<half>();
-        vec4h pos_uv3 = vec4f(xs0 * 2.0f - 1.0f, 1.0f - ys0 * 2.0f, u0, v1).cast<half>();
-
-        textMesh->addVertex(Vertex(pos_uv0, color));
-        textMesh->addVertex(Vertex(pos_uv1, color));
-        textMesh->addVertex(Vertex(pos_uv2, color));
-        textMesh->addVertex(Vertex(pos_uv2, color));
-        textMesh->addVertex(Vertex(pos_uv3, color));
-        textMesh->addVertex(Vertex(pos_uv0, color));
+        vec4f pos_uv[4] = {
+            vec4f(xs0 * 2.0f - 1.0f, 1.0f - ys1 * 2.0f, u0, v0),
+            vec4f(xs1 * 2.0f - 1.0f, 1.0f - ys1 * 2.0f, u1, v0),
+            vec4f(xs1 * 2.0f - 1.0f, 1.0f - ys0 * 2.0f, u1, v1),
+            vec4f(xs0 * 2.0f - 1.0f, 1.0f - ys0 * 2.0f, u0, v1)
+        };
+        // converts the 16 coordinates at once (a half is an unsigned short)
+        vec4h pos_uvh[4];
+        floatToHalf(&pos_uv[0].x, (unsigned short*) &pos_uvh[0].x, 16);
+
+        textMesh->addVertex(Vertex(pos_uvh[0], color));
+        textMesh->addVertex(Vertex(pos_uvh[1], color));
+        textMesh->addVertex(Vertex(pos_uvh[2], color));
+        textMesh->addVertex(Vertex(pos_uvh[2], color));
+        textMesh->addVertex(Vertex(pos_uvh[3], color));
+        textMesh->addVertex(Vertex(pos_uvh[0], color));
 
         xs += (height * width) / getTileWidth();
     }
@@ -0,0 +1,239 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+
+#include "test/Test.h"
+
+#include <cstdlib>
+#include <sstream>
+
+#include <pthread.h>
+
+#include "ork/core/AsyncLogger.h"
+
+using namespace std;
+using namespace ork;
+
+/**
+ * A logger that stores the messages it receives. It can block the thread
+ * that calls #log until #open is called.
+ */
+class CollectLogger : public Logger
+{
+public:
+    vector<string> topics;
+
+    vector<string> messages;
+
+    bool closed;
+
+    bool blocked;
+
+    pthread_mutex_t lock;
+
+    pthread_cond_t cond;
+
+    CollectLogger(bool closed) : Logger("COLLECT"), closed(closed), blocked(false)
+    {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+    }
+
+    virtual ~CollectLogger()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+    }
+
+    virtual void log(const string &topic, const string &msg)
+    {
+        pthread_mutex_lock(&lock);
+        while (closed) {
+            blocked = true;
+            pthread_cond_broadcast(&cond);
+            pthread_cond_wait(&cond, &lock);
+        }
+        topics.push_back(topic);
+        messages.push_back(msg);
+        pthread_mutex_unlock(&lock);
+    }
+
+    virtual void flush()
+    {
+    }
+
+    /**
+     * Waits until a thread is blocked in #log.
+     */
+    void waitBlocked()
+    {
+        pthread_mutex_lock(&lock);
+        while (!blocked) {
+            pthread_cond_wait(&cond, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+
+    /**
+     * Unblocks the threads waiting in #log.
+     */
+    void open()
+    {
+        pthread_mutex_lock(&lock);
+        closed = false;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+};
+
+/**
+ * Logs 500 messages "id i" in the logger given by a LogThread.
+ */
+struct LogThread
+{
+    AsyncLogger *logger;
+
+    int id;
+};
+
+static void *logMessages(void *arg)
+{
+    LogThread *t = (LogThread*) arg;
+    for (int i = 0; i < 500; ++i) {
+        ostringstream oss;
+        oss << t->id << " " << i;
+        t->logger->log("TEST", oss.str());
+    }
+    return NULL;
+}
+
+/**
+ * Returns true if the "id i" messages of each thread are all present, once,
+ * and in the order in which they were logged.
+ */
+static bool isOrdered(const vector<string> &messages, int threads)
+{
+    vector<int> next(threads, 0);
+    for (unsigned int i = 0; i < messages.size(); ++i) {
+        istringstream iss(messages[i]);
+        int id;
+        int n;
+        iss >> id >> n;
+        if (id < 0 || id >= threads || n != next[id]) {
+            return false;
+        }
+        next[id] += 1;
+    }
+    for (int i = 0; i < threads; ++i) {
+        if (next[i] != 500) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(testAsyncLoggerOrder)
+{
+    ptr<CollectLogger> c = new CollectLogger(false);
+    ptr<AsyncLogger> l = new AsyncLogger("TEST", c);
+    l->log("TEST", "first");
+    pthread_t threads[4];
+    LogThread args[4];
+    for (int i = 0; i < 4; ++i) {
+        args[i].logger = l.get();
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, logMessages, &args[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    l->log("TEST", "last");
+    l->flush();
+    ASSERT(l->getDropped() == 0);
+    ASSERT(c->messages.size() == 2002);
+    ASSERT(c->messages.front() == "first");
+    ASSERT(c->messages.back() == "last");
+    vector<string> messages(c->messages.begin() + 1, c->messages.end() - 1);
+    ASSERT(isOrdered(messages, 4));
+}
+
+TEST(testAsyncLoggerThreadExit)
+{
+    ptr<CollectLogger> c = new CollectLogger(false);
+    ptr<AsyncLogger> l = new AsyncLogger("TEST", c);
+    // the buffers of the exited threads are written and reused
+    for (int i = 0; i < 8; ++i) {
+        pthread_t thread;
+        LogThread arg;
+        arg.logger = l.get();
+        arg.id = i;
+        pthread_create(&thread, NULL, logMessages, &arg);
+        pthread_join(thread, NULL);
+        if (i % 2 == 1) {
+            l->flush();
+        }
+    }
+    l->flush();
+    ASSERT(l->getDropped() == 0);
+    ASSERT(isOrdered(c->messages, 8));
+}
+
+TEST(testAsyncLoggerDrops)
+{
+    ptr<CollectLogger> c = new CollectLogger(true);
+    ptr<AsyncLogger> l = new AsyncLogger("TEST", c, 256, 1);
+    // blocks the background thread while it writes the first message
+    l->log("TEST", "first");
+    c->waitBlocked();
+    for (int i = 0; i < 100; ++i) {
+        ostringstream oss;
+        oss << "0 " << i;
+        l->log("TEST", oss.str());
+    }
+    long dropped = l->getDropped();
+    ASSERT(dropped > 0);
+    c->open();
+    l->flush();
+    ASSERT(l->getDropped() == dropped);
+
+    // the messages that were not dropped are written in order, followed by
+    // the number of dropped messages
+    long written = 0;
+    long reported = 0;
+    int last = -1;
+    bool ordered = true;
+    for (unsigned int i = 1; i < c->messages.size(); ++i) {
+        if (c->topics[i] == "LOGGER") {
+            reported += atol(c->messages[i].c_str());
+        } else {
+            int n = atoi(c->messages[i].c_str() + 2);
+            ordered = ordered && n > last;
+            last = n;
+            written += 1;
+        }
+    }
+    ASSERT(c->messages[0] == "first");
+    ASSERT(ordered);
+    ASSERT(written + dropped == 100);
+    ASSERT(reported == dropped);
+}
@@ -0,0 +1,163 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+
+#include "test/Test.h"
+
+#include <pthread.h>
+
+#include "ork/core/ObjectPool.h"
+#include "ork/taskgraph/Task.h"
+
+using namespace ork;
+
+TEST(testObjectPoolReuse)
+{
+    void *p = ObjectPool::allocate(40);
+    ObjectPool::deallocate(p, 40);
+    unsigned int allocated = ObjectPool::getAllocatedCount();
+    unsigned int reused = ObjectPool::getReusedCount();
+    // 33 and 40 bytes are in the same size class
+    void *q = ObjectPool::allocate(33);
+    ASSERT(q == p);
+    ASSERT(ObjectPool::getAllocatedCount() == allocated);
+    ASSERT(ObjectPool::getReusedCount() == reused + 1);
+    ObjectPool::deallocate(q, 33);
+}
+
+TEST(testObjectPoolSizeClasses)
+{
+    void *p = ObjectPool::allocate(40);
+    ObjectPool::deallocate(p, 40);
+    void *q = ObjectPool::allocate(100);
+    ASSERT(q != p);
+    void *r = ObjectPool::allocate(48);
+    ASSERT(r == p);
+    ObjectPool::deallocate(q, 100);
+    ObjectPool::deallocate(r, 48);
+}
+
+TEST(testObjectPoolLargeBlocks)
+{
+    unsigned int allocated = ObjectPool::getAllocatedCount();
+    unsigned int reused = ObjectPool::getReusedCount();
+    void *p = ObjectPool::allocate(4096);
+    ObjectPool::deallocate(p, 4096);
+    void *q = ObjectPool::allocate(4096);
+    ObjectPool::deallocate(q, 4096);
+    ASSERT(ObjectPool::getAllocatedCount() == allocated);
+    ASSERT(ObjectPool::getReusedCount() == reused);
+}
+
+TEST(testObjectPoolTrim)
+{
+    void *p = ObjectPool::allocate(200);
+    ObjectPool::deallocate(p, 200);
+    ObjectPool::trim();
+    unsigned int allocated = ObjectPool::getAllocatedCount();
+    unsigned int reused = ObjectPool::getReusedCount();
+    // the free block has been returned to the system
+    void *q = ObjectPool::allocate(200);
+    ASSERT(ObjectPool::getAllocatedCount() == allocated + 1);
+    ASSERT(ObjectPool::getReusedCount() == reused);
+    ObjectPool::deallocate(q, 200);
+}
+
+TEST(testObjectPoolMaxFreeBlocks)
+{
+    const int N = ObjectPool::MAX_FREE_BLOCKS + 16;
+    ObjectPool::trim();
+    void **blocks = new void*[N];
+    for (int i = 0; i < N; ++i) {
+        blocks[i] = ObjectPool::allocate(300);
+    }
+    for (int i = 0; i < N; ++i) {
+        ObjectPool::deallocate(blocks[i], 300);
+    }
+    unsigned int allocated = ObjectPool::getAllocatedCount();
+    unsigned int reused = ObjectPool::getReusedCount();
+    // only MAX_FREE_BLOCKS blocks have been kept in the free list
+    for (int i = 0; i < N; ++i) {
+        blocks[i] = ObjectPool::allocate(300);
+    }
+    ASSERT(ObjectPool::getReusedCount() == reused + ObjectPool::MAX_FREE_BLOCKS);
+    ASSERT(ObjectPool::getAllocatedCount() == allocated + 16);
+    for (int i = 0; i < N; ++i) {
+        ObjectPool::deallocate(blocks[i], 300);
+    }
+    delete[] blocks;
+    ObjectPool::trim();
+}
+
+TEST(testTaskReuse)
+{
+    Task *t = new Task("Task", false, 0);
+    delete t;
+    unsigned int reused = ObjectPool::getReusedCount();
+    Task *u = new Task("Task", false, 0);
+    ASSERT(u == t);
+    ASSERT(ObjectPool::getReusedCount() == reused + 1);
+    delete u;
+}
+
+/**
+ * Allocates and deletes blocks, and checks that no block is used by two
+ * threads at the same time.
+ */
+static void *allocateBlocks(void *arg)
+{
+    long id = (long) (size_t) arg;
+    bool *ok = new bool(true);
+    for (int i = 0; i < 10000; ++i) {
+        long *blocks[8];
+        for (int j = 0; j < 8; ++j) {
+            blocks[j] = (long*) ObjectPool::allocate(64);
+            for (int k = 0; k < 8; ++k) {
+                blocks[j][k] = id;
+            }
+        }
+        for (int j = 0; j < 8; ++j) {
+            for (int k = 0; k < 8; ++k) {
+                *ok = *ok && blocks[j][k] == id;
+            }
+            ObjectPool::deallocate(blocks[j], 64);
+        }
+    }
+    return ok;
+}
+
+TEST(testObjectPoolThreads)
+{
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, allocateBlocks, (void*) (size_t) (i + 1));
+    }
+    bool ok = true;
+    for (int i = 0; i < 4; ++i) {
+        void *result;
+        pthread_join(threads[i], &result);
+        ok = ok && *((bool*) result);
+        delete (bool*) result;
+    }
+    ASSERT(ok);
+}
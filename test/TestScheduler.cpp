@@ -0,0 +1,561 @@
+/*
+ * Ork: a small object-oriented OpenGL Rendering Kernel.
+ * Copyright (c) 2008-2010 INRIA
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "test/Test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "ork/core/Atomic.h"
+#include "ork/taskgraph/MultithreadScheduler.h"
+#include "ork/taskgraph/ParallelForTask.h"
+#include "ork/taskgraph/ScheduleRecord.h"
+
+using namespace ork;
+using namespace std;
+
+/**
+ * A logical clock incremented at the start and at the end of each OrderTask.
+ */
+static volatile long orderClock = 0;
+
+/**
+ * A CPU task that records the logical times at which it starts and ends.
+ */
+class OrderTask : public Task
+{
+public:
+    long start;
+
+    long end;
+
+    vector<OrderTask*> predecessors;
+
+    OrderTask(unsigned int deadline) :
+        Task("OrderTask", false, deadline), start(0), end(0)
+    {
+    }
+
+    virtual bool run()
+    {
+        start = atomic_exchange_and_add(&orderClock, 1L) + 1;
+        // some work, so that several tasks can run in parallel
+        volatile int n = 0;
+        for (int i = 0; i < 1000 + int(size_t(this) / 16 % 1000); ++i) {
+            n = n + i;
+        }
+        end = atomic_exchange_and_add(&orderClock, 1L) + 1;
+        return true;
+    }
+
+    /**
+     * Returns true if this task has been executed after its predecessors.
+     */
+    bool isOrdered()
+    {
+        if (start == 0 || end < start) {
+            return false;
+        }
+        for (unsigned int i = 0; i < predecessors.size(); ++i) {
+            if (predecessors[i]->end == 0 || predecessors[i]->end > start) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * A CPU task that waits until it is opened.
+ */
+class GateTask : public Task
+{
+public:
+    volatile long started;
+
+    volatile long opened;
+
+    GateTask() :
+        Task("GateTask", false, 1), started(0), opened(0)
+    {
+    }
+
+    virtual bool run()
+    {
+        ork_atomic_store(&started, 1L);
+        while (ork_atomic_load(&opened) == 0) {
+            sched_yield();
+        }
+        return true;
+    }
+};
+
+/**
+ * Returns a random DAG of OrderTask, made of several nested task graphs.
+ * The dependencies between tasks are random, and the dependencies between
+ * the nested graphs go from each graph to the previous one.
+ *
+ * @param deadline the deadline of the tasks, or -1 for random deadlines.
+ * @param[out] tasks the primitive tasks of the returned graph.
+ */
+static ptr<TaskGraph> randomGraph(int deadline, vector< ptr<OrderTask> > &tasks)
+{
+    ptr<TaskGraph> root = new TaskGraph();
+    ptr<TaskGraph> previous = NULL;
+    vector<OrderTask*> previousTasks;
+    for (int i = 0; i < 8; ++i) {
+        ptr<TaskGraph> g = new TaskGraph();
+        vector< ptr<OrderTask> > local;
+        for (int j = 0; j < 40; ++j) {
+            ptr<OrderTask> t = new OrderTask(deadline < 0 ? rand() % 2 : deadline);
+            g->addTask(t);
+            int n = j == 0 ? 0 : 1 + rand() % 2;
+            for (int k = 0; k < n; ++k) {
+                ptr<OrderTask> u = local[rand() % j];
+                g->addDependency(t, u);
+                t->predecessors.push_back(u.get());
+            }
+            local.push_back(t);
+        }
+        root->addTask(g);
+        if (previous != NULL) {
+            // all the tasks of g depend on all the tasks of previous
+            root->addDependency(g, previous);
+            for (unsigned int j = 0; j < local.size(); ++j) {
+                local[j]->predecessors.insert(local[j]->predecessors.end(), previousTasks.begin(), previousTasks.end());
+            }
+        }
+        previous = g;
+        previousTasks.clear();
+        for (unsigned int j = 0; j < local.size(); ++j) {
+            previousTasks.push_back(local[j].get());
+        }
+        tasks.insert(tasks.end(), local.begin(), local.end());
+    }
+    return root;
+}
+
+/**
+ * Waits until all the tasks of an already scheduled task graph are
+ * completed.
+ */
+static void wait(ptr<MultithreadScheduler> scheduler, ptr<Task> g)
+{
+    scheduler->run(g);
+    while (!g->isDone()) {
+        scheduler->run(g);
+        sched_yield();
+    }
+}
+
+/**
+ * Executes a task graph with the given scheduler, and waits until all its
+ * tasks are completed.
+ */
+static void execute(ptr<MultithreadScheduler> scheduler, ptr<TaskGraph> g)
+{
+    scheduler->schedule(g);
+    wait(scheduler, g);
+}
+
+/**
+ * Returns true if all the given tasks have been executed after their
+ * predecessors.
+ */
+static bool isOrdered(const vector< ptr<OrderTask> > &tasks)
+{
+    for (unsigned int i = 0; i < tasks.size(); ++i) {
+        if (!tasks[i]->isOrdered()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool testDependencies(MultithreadScheduler::executionMode mode, MultithreadScheduler::priorityMode priority)
+{
+    bool ok = true;
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 3, mode, priority);
+    srand(0);
+    int deadlines[3] = { 0, 1, -1 };
+    for (int i = 0; i < 3; ++i) {
+        vector< ptr<OrderTask> > tasks;
+        ptr<TaskGraph> g = randomGraph(deadlines[i], tasks);
+        execute(scheduler, g);
+        ok = ok && isOrdered(tasks);
+    }
+    return ok;
+}
+
+TEST(testGlobalQueueDependencies)
+{
+    ASSERT(testDependencies(MultithreadScheduler::GLOBAL_QUEUE, MultithreadScheduler::SHORTEST_FIRST));
+}
+
+TEST(testWorkStealingDependencies)
+{
+    ASSERT(testDependencies(MultithreadScheduler::WORK_STEALING, MultithreadScheduler::SHORTEST_FIRST));
+}
+
+TEST(testCriticalPathDependencies)
+{
+    ASSERT(testDependencies(MultithreadScheduler::WORK_STEALING, MultithreadScheduler::CRITICAL_PATH));
+}
+
+/**
+ * Adds a dependency to a task that is ready, but not executed yet because
+ * the only worker thread is busy.
+ */
+static bool testNewPredecessorOfReadyTask(MultithreadScheduler::executionMode mode)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 1, mode);
+    ptr<GateTask> gate = new GateTask();
+    scheduler->schedule(gate);
+    while (ork_atomic_load(&gate->started) == 0) {
+        sched_yield();
+    }
+    ptr<OrderTask> b = new OrderTask(1);
+    scheduler->schedule(b);
+    ptr<OrderTask> c = new OrderTask(1);
+    ptr<TaskGraph> g = new TaskGraph();
+    g->addTask(b);
+    g->addTask(c);
+    g->addDependency(b, c);
+    b->predecessors.push_back(c.get());
+    scheduler->schedule(g);
+    ork_atomic_store(&gate->opened, 1L);
+    wait(scheduler, g);
+    wait(scheduler, gate);
+    return b->isOrdered() && c->isOrdered();
+}
+
+/**
+ * Adds a dependency to a task while its last predecessor is completing.
+ */
+static bool testNewPredecessorOfFinishingTask(MultithreadScheduler::executionMode mode)
+{
+    bool ok = true;
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2, mode);
+    for (int i = 0; i < 500; ++i) {
+        // b is executed by the main thread, which cannot select it while it
+        // schedules g2, so the dependency from b to c must always be honored
+        ptr<OrderTask> a = new OrderTask(1);
+        ptr<OrderTask> b = new OrderTask(0);
+        ptr<OrderTask> c = new OrderTask(1);
+        ptr<TaskGraph> g1 = new TaskGraph();
+        g1->addTask(a);
+        g1->addTask(b);
+        g1->addDependency(b, a);
+        ptr<TaskGraph> g2 = new TaskGraph();
+        g2->addTask(b);
+        g2->addTask(c);
+        g2->addDependency(b, c);
+        b->predecessors.push_back(a.get());
+        b->predecessors.push_back(c.get());
+        scheduler->schedule(g1);
+        // a may be running, completing or completed at this point
+        scheduler->schedule(g2);
+        wait(scheduler, g1);
+        wait(scheduler, g2);
+        ok = ok && a->isOrdered() && b->isOrdered() && c->isOrdered();
+    }
+    return ok;
+}
+
+TEST(testGlobalQueueNewPredecessor)
+{
+    ASSERT(testNewPredecessorOfReadyTask(MultithreadScheduler::GLOBAL_QUEUE));
+    ASSERT(testNewPredecessorOfFinishingTask(MultithreadScheduler::GLOBAL_QUEUE));
+}
+
+TEST(testWorkStealingNewPredecessor)
+{
+    ASSERT(testNewPredecessorOfReadyTask(MultithreadScheduler::WORK_STEALING));
+    ASSERT(testNewPredecessorOfFinishingTask(MultithreadScheduler::WORK_STEALING));
+}
+
+/**
+ * Changes the structure of a task graph between two executions, so that its
+ * flattened form computed for the first execution becomes invalid.
+ */
+static bool testChangedGraph(MultithreadScheduler::executionMode mode)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2, mode);
+    ptr<OrderTask> x = new OrderTask(0);
+    ptr<OrderTask> y = new OrderTask(0);
+    ptr<TaskGraph> h = new TaskGraph();
+    h->addTask(x);
+    h->addTask(y);
+    h->addDependency(y, x);
+    y->predecessors.push_back(x.get());
+    ptr<TaskGraph> g = new TaskGraph();
+    g->addTask(h);
+    execute(scheduler, g);
+    bool ok = x->isOrdered() && y->isOrdered();
+
+    // reverses the dependency in the nested graph only
+    h->removeDependency(y, x);
+    h->addDependency(x, y);
+    x->predecessors.assign(1, y.get());
+    y->predecessors.clear();
+    scheduler->reschedule(g, Task::DEPENDENCY_CHANGED, 0);
+    execute(scheduler, g);
+    ok = ok && x->isOrdered() && y->isOrdered();
+
+    // adds a task after the nested graph
+    ptr<OrderTask> z = new OrderTask(0);
+    g->addTask(z);
+    g->addDependency(z, h);
+    z->predecessors.push_back(x.get());
+    z->predecessors.push_back(y.get());
+    scheduler->reschedule(g, Task::DEPENDENCY_CHANGED, 0);
+    execute(scheduler, g);
+    return ok && x->isOrdered() && y->isOrdered() && z->isOrdered();
+}
+
+TEST(testChangedGraph)
+{
+    ASSERT(testChangedGraph(MultithreadScheduler::GLOBAL_QUEUE));
+    ASSERT(testChangedGraph(MultithreadScheduler::WORK_STEALING));
+}
+
+/**
+ * A parallel for task that counts how many times each index is executed.
+ */
+class CountTask : public ParallelForTask
+{
+public:
+    std::vector<long> counts;
+
+    CountTask(int begin, int end, int grain) :
+        ParallelForTask("CountTask", begin, end, grain, 0), counts(end + 10, 0L)
+    {
+    }
+
+    /**
+     * Returns true if each index of [begin,end) has been executed n times,
+     * and no other index has been executed.
+     */
+    bool isCovered(int begin, int end, long n)
+    {
+        for (int i = 0; i < int(counts.size()); ++i) {
+            if (counts[i] != (i >= begin && i < end ? n : 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+    virtual bool runRange(int begin, int end)
+    {
+        for (int i = begin; i < end; ++i) {
+            atomic_increment(&counts[i]);
+        }
+        // the first chunks are slow, so that the thread executing the task
+        // must wait for the other threads
+        if (begin < 100) {
+            usleep(2000);
+        }
+        return true;
+    }
+};
+
+static bool testParallelFor(MultithreadScheduler::executionMode mode)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 3, mode);
+    ptr<CountTask> t = new CountTask(3, 10003, 7);
+    scheduler->run(t);
+    bool ok = t->isDone() && t->isCovered(3, 10003, 1);
+    // a second execution of the same task
+    scheduler->reschedule(t, Task::DATA_CHANGED, 0);
+    scheduler->run(t);
+    return ok && t->isDone() && t->isCovered(3, 10003, 2);
+}
+
+TEST(testParallelFor)
+{
+    ASSERT(testParallelFor(MultithreadScheduler::GLOBAL_QUEUE));
+    ASSERT(testParallelFor(MultithreadScheduler::WORK_STEALING));
+}
+
+/**
+ * Returns true if two schedule records have the same content.
+ */
+static bool equals(const ScheduleRecord &r, const ScheduleRecord &s)
+{
+    if (r.types != s.types || r.tasks.size() != s.tasks.size() || r.dependencies != s.dependencies || r.frames != s.frames || r.threads != s.threads) {
+        return false;
+    }
+    for (unsigned int i = 0; i < r.tasks.size(); ++i) {
+        const ScheduleRecord::TaskRecord &a = r.tasks[i];
+        const ScheduleRecord::TaskRecord &b = s.tasks[i];
+        if (a.type != b.type || a.deadline != b.deadline || a.gpuTask != b.gpuTask || a.thread != b.thread ||
+                a.release != b.release || a.start != b.start || a.duration != b.duration) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Saves a record in a file and loads it back.
+ */
+static bool roundTrip(const ScheduleRecord &r, ScheduleRecord &loaded)
+{
+    const char *fileName = "testScheduleRecord.dat";
+    bool ok = r.save(fileName) && loaded.load(fileName);
+    remove(fileName);
+    return ok;
+}
+
+TEST(testScheduleRecordRoundTrip)
+{
+    ScheduleRecord r;
+    r.types.push_back("A");
+    r.types.push_back("B");
+    for (int i = 0; i < 5; ++i) {
+        ScheduleRecord::TaskRecord t;
+        t.type = i % 2;
+        t.deadline = i;
+        t.gpuTask = i == 3;
+        t.thread = i == 4 ? -1 : i % 3;
+        t.release = 0.5f * i;
+        t.start = 1.25f * i;
+        t.duration = 100.0f + i;
+        r.tasks.push_back(t);
+    }
+    r.dependencies.push_back(std::make_pair(1, 0));
+    r.dependencies.push_back(std::make_pair(4, 2));
+    r.frames.push_back(0.0f);
+    r.frames.push_back(16666.5f);
+    r.threads = 3;
+    ScheduleRecord loaded;
+    ASSERT(roundTrip(r, loaded));
+    ASSERT(equals(r, loaded));
+    ASSERT(!loaded.load("testScheduleRecordMissing.dat"));
+}
+
+TEST(testScheduleRecordExecution)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2);
+    srand(1);
+    vector< ptr<OrderTask> > tasks;
+    ptr<TaskGraph> g = randomGraph(1, tasks);
+    ScheduleRecord r;
+    scheduler->startRecording();
+    execute(scheduler, g);
+    scheduler->stopRecording(r);
+    // all the tasks are recorded and executed by one of the 3 threads
+    bool ok = r.tasks.size() == tasks.size() && r.threads == 3 && !r.dependencies.empty();
+    for (unsigned int i = 0; i < r.tasks.size(); ++i) {
+        ok = ok && r.tasks[i].thread >= 0 && r.tasks[i].thread < 3;
+    }
+    ASSERT(ok);
+    ScheduleRecord loaded;
+    ASSERT(roundTrip(r, loaded));
+    ASSERT(equals(r, loaded));
+    ASSERT(loaded.simulate(0, ScheduleRecord::RECORDED) == r.simulate(0, ScheduleRecord::RECORDED));
+}
+
+/**
+ * A task type used only to record execution times.
+ */
+class DurationTask : public Task
+{
+public:
+    DurationTask() : Task("DurationTask", false, 0)
+    {
+    }
+};
+
+TEST(testExpectedDurations)
+{
+    ptr<Task> t = new DurationTask();
+    for (int i = 1; i <= 100; ++i) {
+        t->setActualDuration(float(i));
+    }
+    ptr<Task> before = new DurationTask();
+    ASSERT(before->getExpectedDuration() == 0.0f);
+    Task::updateExpectedDurations();
+    // the expected duration of a task is cached at the first call
+    ASSERT(before->getExpectedDuration() == 0.0f);
+    ptr<Task> mean = new DurationTask();
+    ptr<Task> median = new DurationTask();
+    ptr<Task> p95 = new DurationTask();
+    float m = mean->getExpectedDuration();
+    float p = median->getExpectedDuration(50.0f);
+    float q = p95->getExpectedDuration(95.0f);
+    // mean + 2 standard deviations of 2..99 is about 106
+    ASSERT(m > 100.0f && m < 110.0f);
+    ASSERT(p > 40.0f && p < 60.0f);
+    ASSERT(q > 85.0f && q <= 100.0f);
+    ASSERT(p95->getExpectedDuration(50.0f) == q);
+}
+
+/**
+ * A prefetching CPU task with a memory cost.
+ */
+class CostTask : public Task
+{
+public:
+    CostTask() : Task("CostTask", false, 1)
+    {
+    }
+
+    virtual bool run()
+    {
+        return true;
+    }
+
+    virtual int getMemoryCost() const
+    {
+        return 100;
+    }
+};
+
+TEST(testRemovedPrefetchBudget)
+{
+    ptr<MultithreadScheduler> scheduler = new MultithreadScheduler(0, 0, 0.0f, 2);
+    scheduler->setPrefetchBudget(100);
+    ptr<Task> tasks[3];
+    for (int i = 0; i < 3; ++i) {
+        tasks[i] = new CostTask();
+        scheduler->schedule(tasks[i]);
+    }
+    // the last two tasks exceed the budget of this frame and are deferred;
+    // without budget they must be executed
+    scheduler->setPrefetchBudget(0);
+    for (int i = 0; i < 1000; ++i) {
+        if (tasks[0]->isDone() && tasks[1]->isDone() && tasks[2]->isDone()) {
+            break;
+        }
+        scheduler->run(new TaskGraph());
+        usleep(1000);
+    }
+    ASSERT(tasks[0]->isDone());
+    ASSERT(tasks[1]->isDone());
+    ASSERT(tasks[2]->isDone());
+}